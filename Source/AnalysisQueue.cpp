@@ -0,0 +1,121 @@
+#include "AnalysisQueue.h"
+
+//==============================================================================
+void AnalysisQueue::add (const juce::Array<juce::File>& files)
+{
+    const juce::ScopedLock sl (lock);
+
+    if (pending.empty() && numInFlight == 0)
+        numQueuedThisRun = numFinishedThisRun = 0;
+
+    for (auto& file : files)
+    {
+        if (pending.insert (file.getFullPathName()).second)
+        {
+            backlog.files.push_back (file);
+            ++numQueuedThisRun;
+        }
+    }
+}
+
+void AnalysisQueue::prioritise (const juce::Array<juce::File>& files, Priority priority)
+{
+    const juce::ScopedLock sl (lock);
+
+    auto& list = prioritised[(size_t) priority];
+    list = {};
+
+    for (auto& file : files)
+        if (pending.count (file.getFullPathName()) != 0)
+            list.files.push_back (file);
+}
+
+juce::Array<juce::File> AnalysisQueue::takeBatch (int maxFiles)
+{
+    const juce::ScopedLock sl (lock);
+    juce::Array<juce::File> batch;
+
+    // Lists are walked in priority order; entries taken through another
+    // list are no longer pending and get skipped
+    auto takeFrom = [this, &batch, maxFiles] (List& list)
+    {
+        while (batch.size() < maxFiles && list.next < list.files.size())
+        {
+            auto& file = list.files[list.next++];
+
+            if (pending.erase (file.getFullPathName()) != 0)
+                batch.add (file);
+        }
+
+        if (list.next == list.files.size())
+            list = {};
+    };
+
+    for (auto& list : prioritised)
+        takeFrom (list);
+
+    takeFrom (backlog);
+
+    numInFlight += batch.size();
+    return batch;
+}
+
+void AnalysisQueue::markFinished (int numFiles)
+{
+    const juce::ScopedLock sl (lock);
+    numInFlight -= numFiles;
+    numFinishedThisRun += numFiles;
+}
+
+void AnalysisQueue::removeFilesIn (const juce::File& folder)
+{
+    const juce::ScopedLock sl (lock);
+
+    // Dropping paths from the pending set is enough: takeBatch skips the rest
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        if (juce::File (*it).isAChildOf (folder))
+        {
+            it = pending.erase (it);
+            ++numFinishedThisRun;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void AnalysisQueue::clear()
+{
+    const juce::ScopedLock sl (lock);
+
+    numFinishedThisRun += (int) pending.size();
+    pending.clear();
+    backlog = {};
+
+    for (auto& list : prioritised)
+        list = {};
+}
+
+int AnalysisQueue::getNumPending() const
+{
+    const juce::ScopedLock sl (lock);
+    return (int) pending.size();
+}
+
+bool AnalysisQueue::isIdle() const
+{
+    const juce::ScopedLock sl (lock);
+    return pending.empty() && numInFlight == 0;
+}
+
+float AnalysisQueue::getProgress() const
+{
+    const juce::ScopedLock sl (lock);
+
+    if (pending.empty() && numInFlight == 0)
+        return 1.0f;
+
+    return (float) numFinishedThisRun / (float) juce::jmax (1, numQueuedThisRun);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Files waiting for background analysis, handed out most wanted first.
+//
+// Files are queued in the order a scan wants to read them. The UI can move
+// files ahead of that backlog: rows on screen go first, then the rest of the
+// current query result. Each call to prioritise() replaces the earlier list
+// at that level, so scrolling away from rows drops their urgency.
+//
+// A file is handed out once, however many lists it is on. All methods are
+// thread-safe.
+//==============================================================================
+class AnalysisQueue
+{
+public:
+    enum Priority
+    {
+        visibleRows = 0,
+        queryResults,
+        numPriorities
+    };
+
+    AnalysisQueue() = default;
+
+    void add (const juce::Array<juce::File>& files);
+    void prioritise (const juce::Array<juce::File>& files, Priority priority);
+
+    // Takes up to maxFiles files, most urgent first. They count as in flight
+    // until markFinished() is called for them.
+    juce::Array<juce::File> takeBatch (int maxFiles);
+    void markFinished (int numFiles);
+
+    // Forgets queued files inside the folder, or all of them
+    void removeFilesIn (const juce::File& folder);
+    void clear();
+
+    int getNumPending() const;
+
+    // True once nothing is queued or in flight
+    bool isIdle() const;
+
+    // Fraction of the files queued since the queue was last idle that have
+    // been analysed; 1 when idle
+    float getProgress() const;
+
+private:
+    struct List
+    {
+        std::vector<juce::File> files;
+        size_t next = 0;
+    };
+
+    juce::CriticalSection lock;
+    std::unordered_set<juce::String> pending;   // paths queued and not yet taken
+    List backlog;
+    std::array<List, numPriorities> prioritised;
+
+    int numInFlight = 0;
+    int numQueuedThisRun = 0;
+    int numFinishedThisRun = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnalysisQueue)
+};
@@ -0,0 +1,461 @@
+#include "AnalysisWorkerPool.h"
+#include "PerformanceCounters.h"
+
+// Messages in both directions start with a count. A batch is that many
+// (request index, request) pairs, a chunk that many (request index, result)
+// pairs; a chunk of none is the worker's hello, and a count of -1 says the
+// worker is still reading its current file.
+static const char* const workerProcessId = "soundxplorerAnalysisWorker";
+
+//==============================================================================
+struct AnalysisWorkerPool::Worker : public juce::ChildProcessCoordinator
+{
+    explicit Worker (AnalysisWorkerPool& p) : pool (p) {}
+
+    // The connection calls back on its own thread, which must be gone before
+    // this object is
+    ~Worker() override { killWorkerProcess(); }
+
+    void handleMessageFromWorker (const juce::MemoryBlock& message) override
+    {
+        pool.post ({ this, launch.load(), message });
+    }
+
+    void handleConnectionLost() override
+    {
+        pool.post ({ this, launch.load(), {} });
+    }
+
+    AnalysisWorkerPool& pool;
+
+    std::atomic<int> launch { 0 };
+    bool isRunning = false;
+    bool isReady = false;               // has said hello, so it got as far as taking files
+    juce::Array<int> batch;             // request indices sent and not yet returned
+    double lastHeardFrom = 0.0;
+};
+
+//==============================================================================
+class AnalysisWorkerProcess : public juce::ChildProcessWorker
+{
+public:
+    // Analyses batches as they arrive until the coordinator goes away
+    void run()
+    {
+        // Not from handleConnectionMade(): that comes before the connection
+        // can send anything
+        juce::MemoryOutputStream hello;
+        hello.writeCompressedInt (0);
+        sendMessageToCoordinator (hello.getMemoryBlock());
+
+        // Long files take a while, so the worker reports each time it reads
+        // more of one; only a decoder stuck inside a read goes quiet
+        FileProber prober;
+        prober.onProgress = [this] { sendHeartbeatIfDue(); };
+
+        while (! connectionLost)
+        {
+            juce::MemoryBlock batch;
+
+            {
+                const juce::ScopedLock sl (batchLock);
+
+                if (! batches.empty())
+                {
+                    batch = std::move (batches.front());
+                    batches.pop_front();
+                }
+            }
+
+            if (batch.isEmpty())
+                batchArrived.wait (-1);
+            else
+                analyseBatch (prober, batch);
+        }
+    }
+
+    void handleMessageFromCoordinator (const juce::MemoryBlock& message) override
+    {
+        {
+            const juce::ScopedLock sl (batchLock);
+            batches.push_back (message);
+        }
+
+        batchArrived.signal();
+    }
+
+    void handleConnectionLost() override
+    {
+        connectionLost = true;
+        batchArrived.signal();
+
+        // A worker stuck in a decoder would never notice, so it's ended from
+        // here once the current file has had a moment to finish
+        for (int waited = 0; isProbing && waited < exitTimeoutMs; waited += 10)
+            juce::Thread::sleep (10);
+
+        if (isProbing)
+            juce::Process::terminate();
+    }
+
+private:
+    static constexpr double chunkIntervalMs = 100.0;
+    static constexpr double heartbeatIntervalMs = 1000.0;
+    static constexpr int exitTimeoutMs = 2000;
+
+    void sendHeartbeatIfDue()
+    {
+        auto now = juce::Time::getMillisecondCounterHiRes();
+
+        if (now - lastSendTime < heartbeatIntervalMs)
+            return;
+
+        juce::MemoryOutputStream heartbeat;
+        heartbeat.writeCompressedInt (-1);
+        sendMessageToCoordinator (heartbeat.getMemoryBlock());
+        lastSendTime = now;
+    }
+
+    void analyseBatch (FileProber& prober, const juce::MemoryBlock& batch)
+    {
+        juce::MemoryInputStream in (batch, false);
+        auto numRequests = in.readCompressedInt();
+
+        // Results go back every chunkIntervalMs and at the end of the batch,
+        // so the coordinator hears from a busy worker at least once per file
+        std::vector<std::pair<int, FileProber::Result>> pending;
+        lastSendTime = juce::Time::getMillisecondCounterHiRes();
+
+        auto sendPending = [&]
+        {
+            juce::MemoryOutputStream chunk;
+            chunk.writeCompressedInt ((int) pending.size());
+
+            for (auto& [index, result] : pending)
+            {
+                chunk.writeCompressedInt (index);
+                FileProber::writeResult (chunk, result);
+            }
+
+            sendMessageToCoordinator (chunk.getMemoryBlock());
+            pending.clear();
+            lastSendTime = juce::Time::getMillisecondCounterHiRes();
+        };
+
+        for (int i = 0; i < numRequests && ! in.isExhausted() && ! connectionLost; ++i)
+        {
+            auto index = in.readCompressedInt();
+            auto request = FileProber::readRequest (in);
+
+            FileProber::Result result;
+            isProbing = true;
+            prober.probe (request, result);
+            isProbing = false;
+
+            pending.emplace_back (index, std::move (result));
+
+            if (juce::Time::getMillisecondCounterHiRes() - lastSendTime >= chunkIntervalMs)
+                sendPending();
+        }
+
+        if (! pending.empty())
+            sendPending();
+    }
+
+    juce::CriticalSection batchLock;
+    std::deque<juce::MemoryBlock> batches;
+    juce::WaitableEvent batchArrived;
+
+    std::atomic<bool> connectionLost { false };
+    std::atomic<bool> isProbing { false };
+    double lastSendTime = 0.0;          // of anything, as any message shows the worker is alive
+};
+
+//==============================================================================
+AnalysisWorkerPool::AnalysisWorkerPool (const juce::File& workerExecutable, int numWorkers)
+    : executable (workerExecutable)
+{
+    for (int i = 0; i < juce::jmax (1, numWorkers); ++i)
+        workers.push_back (std::make_unique<Worker> (*this));
+}
+
+AnalysisWorkerPool::~AnalysisWorkerPool()
+{
+    for (auto& worker : workers)
+        stopWorker (*worker);
+}
+
+juce::File AnalysisWorkerPool::findWorkerExecutable()
+{
+    auto overridePath = juce::SystemStats::getEnvironmentVariable ("SOUNDXPLORER_WORKER", {});
+
+    if (juce::File::isAbsolutePath (overridePath))
+        return juce::File (overridePath).existsAsFile() ? juce::File (overridePath) : juce::File();
+
+   #if JUCE_WINDOWS
+    const juce::String name ("Sound Xplorer Indexer.exe");
+   #else
+    const juce::String name ("Sound Xplorer Indexer");
+   #endif
+
+    // For a plug-in this is its own binary, which sits a few levels inside
+    // its bundle; the indexer is installed next to the binary or the bundle
+    auto folder = juce::File::getSpecialLocation (juce::File::currentExecutableFile).getParentDirectory();
+
+    for (int level = 0; level < 4; ++level, folder = folder.getParentDirectory())
+    {
+        auto candidate = folder.getChildFile (name);
+
+        if (candidate.existsAsFile())
+            return candidate;
+    }
+
+    return {};
+}
+
+bool AnalysisWorkerPool::runWorkerIfRequested (const juce::String& commandLine)
+{
+    AnalysisWorkerProcess worker;
+
+    if (! worker.initialiseFromCommandLine (commandLine, workerProcessId))
+        return false;
+
+    worker.run();
+    return true;
+}
+
+//==============================================================================
+void AnalysisWorkerPool::probe (const std::vector<FileProber::Request>& requests,
+                                std::vector<FileProber::Result>& results,
+                                const std::function<bool()>& shouldStop)
+{
+    const juce::ScopedLock sl (probeLock);
+    auto& counters = PerformanceCounters::getInstance();
+
+    auto numRequests = (int) requests.size();
+    int nextRequest = 0;
+
+    // Retried files and batches handed back go out before fresh ones
+    std::deque<juce::Array<int>> pendingBatches;
+
+    auto takeBatch = [&]
+    {
+        juce::Array<int> batch;
+
+        if (! pendingBatches.empty())
+        {
+            batch = std::move (pendingBatches.front());
+            pendingBatches.pop_front();
+        }
+        else
+        {
+            while (nextRequest < numRequests && batch.size() < batchSize)
+                batch.add (nextRequest++);
+        }
+
+        return batch;
+    };
+
+    // A file is only blamed for a hang once it has hung a worker twice on
+    // its own, as a slow volume can stall one read for a long time
+    std::vector<int> numHangs ((size_t) numRequests);
+
+    auto handleLostWorker = [&] (Worker& worker, bool hung)
+    {
+        auto lostBatch = worker.batch;
+        auto wasReady = worker.isReady;
+        stopWorker (worker);
+
+        // Gone before it took any file, so no file is to blame
+        if (! wasReady)
+        {
+            if (! lostBatch.isEmpty())
+                pendingBatches.push_front (lostBatch);
+
+            if (++consecutiveLaunchFailures >= maxLaunchFailures)
+                setUnavailable();
+
+            return;
+        }
+
+        ++counters.analysisWorkerRestarts;
+
+        if (lostBatch.size() == 1)
+        {
+            auto index = lostBatch.getFirst();
+
+            if (hung && ++numHangs[(size_t) index] < maxHangsPerFile)
+            {
+                pendingBatches.push_back (lostBatch);
+                return;
+            }
+
+            results[(size_t) index] = FileProber::makeQuarantined (requests[(size_t) index]);
+            ++counters.filesQuarantined;
+        }
+        else
+        {
+            for (int i = lostBatch.size(); --i >= 0;)
+                pendingBatches.push_front (juce::Array<int> { lostBatch[i] });
+        }
+    };
+
+    while (! shouldStop())
+    {
+        bool anyBusy = false;
+
+        for (auto& worker : workers)
+        {
+            if (worker->batch.isEmpty() && available)
+            {
+                auto batch = takeBatch();
+
+                if (! batch.isEmpty() && ! sendBatch (*worker, requests, batch))
+                    pendingBatches.push_front (batch);
+            }
+
+            anyBusy = anyBusy || ! worker->batch.isEmpty();
+        }
+
+        // Done, or no worker could be started
+        if (! anyBusy)
+            break;
+
+        eventPosted.wait (pollIntervalMs);
+
+        std::vector<Event> received;
+
+        {
+            const juce::ScopedLock el (eventLock);
+            received.swap (events);
+        }
+
+        auto now = juce::Time::getMillisecondCounterHiRes();
+
+        for (auto& event : received)
+        {
+            auto& worker = *event.worker;
+
+            // From a run that has been stopped since
+            if (event.launch != worker.launch.load())
+                continue;
+
+            if (event.message.isEmpty())
+            {
+                handleLostWorker (worker, false);
+                continue;
+            }
+
+            worker.lastHeardFrom = now;
+
+            juce::MemoryInputStream in (event.message, false);
+            auto numResults = in.readCompressedInt();
+
+            if (numResults < 0)
+                continue;
+
+            if (numResults == 0)
+            {
+                worker.isReady = true;
+                consecutiveLaunchFailures = 0;
+                continue;
+            }
+
+            for (int i = 0; i < numResults && ! in.isExhausted(); ++i)
+            {
+                auto index = in.readCompressedInt();
+                auto result = FileProber::readResult (in);
+
+                if (worker.batch.contains (index))
+                {
+                    worker.batch.removeFirstMatchingValue (index);
+                    result.completed = true;
+                    results[(size_t) index] = std::move (result);
+                }
+            }
+        }
+
+        // A worker that has gone quiet is stuck in a decoder
+        for (auto& worker : workers)
+            if (! worker->batch.isEmpty() && now - worker->lastHeardFrom > hangTimeoutMs)
+                handleLostWorker (*worker, true);
+    }
+
+    // Workers still busy are stopped, so nothing they send later is taken
+    // for the next call's files
+    for (auto& worker : workers)
+        if (! worker->batch.isEmpty())
+            stopWorker (*worker);
+}
+
+bool AnalysisWorkerPool::sendBatch (Worker& worker, const std::vector<FileProber::Request>& requests,
+                                    const juce::Array<int>& batch)
+{
+    if (! worker.isRunning)
+    {
+        // Nothing reads the worker's output, so it isn't captured: a full
+        // pipe would stall the worker
+        if (! worker.launchWorkerProcess (executable, workerProcessId, 0, 0))
+        {
+            stopWorker (worker);
+
+            if (++consecutiveLaunchFailures >= maxLaunchFailures)
+                setUnavailable();
+
+            return false;
+        }
+
+        worker.isRunning = true;
+        ++PerformanceCounters::getInstance().analysisWorkers;
+    }
+
+    juce::MemoryOutputStream message;
+    message.writeCompressedInt (batch.size());
+
+    for (auto index : batch)
+    {
+        message.writeCompressedInt (index);
+        FileProber::writeRequest (message, requests[(size_t) index]);
+    }
+
+    if (! worker.sendMessageToWorker (message.getMemoryBlock()))
+    {
+        stopWorker (worker);
+        return false;
+    }
+
+    worker.batch = batch;
+    worker.lastHeardFrom = juce::Time::getMillisecondCounterHiRes();
+    return true;
+}
+
+void AnalysisWorkerPool::stopWorker (Worker& worker)
+{
+    // Connection callbacks have stopped once killWorkerProcess() returns,
+    // and a new launch number marks anything they posted as stale
+    worker.killWorkerProcess();
+    ++worker.launch;
+
+    if (worker.isRunning)
+        --PerformanceCounters::getInstance().analysisWorkers;
+
+    worker.isRunning = false;
+    worker.isReady = false;
+    worker.batch.clearQuick();
+}
+
+void AnalysisWorkerPool::setUnavailable()
+{
+    available = false;
+    PerformanceCounters::getInstance().analysingInProcess = true;
+}
+
+void AnalysisWorkerPool::post (Event event)
+{
+    {
+        const juce::ScopedLock sl (eventLock);
+        events.push_back (std::move (event));
+    }
+
+    eventPosted.signal();
+}
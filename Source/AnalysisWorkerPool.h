@@ -0,0 +1,84 @@
+#pragma once
+#include <JuceHeader.h>
+#include "FileProber.h"
+
+//==============================================================================
+// Runs FileProber in child processes, so a decoder crashing or hanging on a
+// malformed file takes down a worker rather than the host.
+//
+// The worker is the indexer executable, installed next to the plug-in and
+// started with a command line that runWorkerIfRequested() recognises. Each
+// worker gets a batch of files at a time over a pipe and sends results back
+// in chunks as it goes, and reports every so often while it reads a long
+// file. When a worker dies or stops reporting for hangTimeoutMs it is killed
+// and restarted, and the files of its batch that hadn't come back are retried
+// one per batch; a file that crashes a worker on its own, or hangs one on its
+// own twice, is quarantined. Decoding memory lives in the workers, so
+// the host process only ever holds the results.
+//
+// Workers start on first use and stay up for later batches. If they can't be
+// started, probe() leaves the files it couldn't do for the caller to probe
+// in-process.
+//==============================================================================
+class AnalysisWorkerPool
+{
+public:
+    AnalysisWorkerPool (const juce::File& workerExecutable, int numWorkers);
+    ~AnalysisWorkerPool();
+
+    // The indexer next to the running plug-in or application binary, or
+    // SOUNDXPLORER_WORKER if set. Returns {} if there is none.
+    static juce::File findWorkerExecutable();
+
+    // Call at the start of the worker executable's main(). Returns false
+    // straight away unless the process was launched as a worker; otherwise
+    // analyses files until the coordinator disconnects, then returns true.
+    static bool runWorkerIfRequested (const juce::String& commandLine);
+
+    // Fills results (parallel to requests) from the workers; results for
+    // files no worker completed are left with completed == false.
+    // shouldStop is polled while waiting. Thread-safe, but concurrent calls
+    // take turns.
+    void probe (const std::vector<FileProber::Request>& requests,
+                std::vector<FileProber::Result>& results,
+                const std::function<bool()>& shouldStop);
+
+    // False once workers have repeatedly failed to start
+    bool isAvailable() const { return available.load(); }
+
+private:
+    static constexpr int batchSize = 8;
+    static constexpr int pollIntervalMs = 100;
+    static constexpr double hangTimeoutMs = 30000.0;
+    static constexpr int maxLaunchFailures = 3;
+    static constexpr int maxHangsPerFile = 2;
+
+    struct Worker;
+
+    struct Event
+    {
+        Worker* worker = nullptr;
+        int launch = 0;                 // which run of the worker sent it
+        juce::MemoryBlock message;      // a chunk of results, or empty if the connection was lost
+    };
+
+    void post (Event event);
+
+    void setUnavailable();
+    bool sendBatch (Worker& worker, const std::vector<FileProber::Request>& requests, const juce::Array<int>& batch);
+    void stopWorker (Worker& worker);
+
+    juce::File executable;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::atomic<bool> available { true };
+    int consecutiveLaunchFailures = 0;
+
+    juce::CriticalSection probeLock;
+
+    juce::CriticalSection eventLock;
+    std::vector<Event> events;
+    juce::WaitableEvent eventPosted;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnalysisWorkerPool)
+};
@@ -0,0 +1,123 @@
+#include "AudioFormatRegistry.h"
+#include "PerformanceCounters.h"
+
+//==============================================================================
+AudioFormatRegistry::AudioFormatRegistry()
+{
+    formatManager.registerBasicFormats();
+}
+
+std::unique_ptr<juce::AudioFormatReader> AudioFormatRegistry::createReaderFor (const juce::File& file)
+{
+    return createReaderFor (file, file.createInputStream());
+}
+
+std::unique_ptr<juce::AudioFormatReader> AudioFormatRegistry::createReaderFor (const juce::File& file, std::unique_ptr<juce::InputStream> stream)
+{
+    if (stream == nullptr)
+        return nullptr;
+
+    // The format named by the extension is nearly always right; the manager
+    // only walks every format when it isn't
+    if (auto* format = formatManager.findFormatForFileExtension (file.getFileExtension()))
+    {
+        auto start = stream->getPosition();
+
+        if (auto* reader = format->createReaderFor (stream.get(), false))
+        {
+            stream.release();
+            return std::unique_ptr<juce::AudioFormatReader> (reader);
+        }
+
+        if (! stream->setPosition (start))
+            return nullptr;
+    }
+
+    return std::unique_ptr<juce::AudioFormatReader> (formatManager.createReaderFor (std::move (stream)));
+}
+
+//==============================================================================
+AudioFormatRegistry::FileStamp AudioFormatRegistry::FileStamp::of (const juce::File& file)
+{
+    return { file.getLastModificationTime().toMilliseconds(), file.getSize() };
+}
+
+std::unique_ptr<juce::AudioFormatReader> AudioFormatRegistry::acquireReader (const juce::File& file, FileStamp& stamp)
+{
+    // Taken before any new reader opens the file, so a change while it opens
+    // makes the stamp stale rather than the reader
+    auto path = file.getFullPathName();
+    stamp = FileStamp::of (file);
+
+    // A stale reader is closed after the lock is released
+    PooledReader pooled;
+
+    {
+        const juce::ScopedLock sl (poolLock);
+
+        for (auto it = pool.rbegin(); it != pool.rend(); ++it)
+        {
+            if (it->path == path)
+            {
+                pooled = std::move (*it);
+                pool.erase (std::next (it).base());
+                break;
+            }
+        }
+    }
+
+    auto& counters = PerformanceCounters::getInstance();
+
+    if (pooled.reader != nullptr && pooled.stamp == stamp)
+    {
+        ++counters.pooledReaderHits;
+        return std::move (pooled.reader);
+    }
+
+    ++counters.pooledReaderMisses;
+    return createReaderFor (file);
+}
+
+void AudioFormatRegistry::releaseReader (const juce::File& file, const FileStamp& stamp, std::unique_ptr<juce::AudioFormatReader> reader)
+{
+    if (reader == nullptr)
+        return;
+
+    // Pooled against the file it was opened on, so one that changed while
+    // the reader was out is never matched to it
+    PooledReader entry;
+    entry.path = file.getFullPathName();
+    entry.stamp = stamp;
+    entry.reader = std::move (reader);
+
+    // Readers are closed after the lock is released
+    std::vector<PooledReader> evicted;
+
+    {
+        const juce::ScopedLock sl (poolLock);
+
+        for (auto it = pool.begin(); it != pool.end(); ++it)
+        {
+            if (it->path == entry.path)
+            {
+                evicted.push_back (std::move (*it));
+                pool.erase (it);
+                break;
+            }
+        }
+
+        pool.push_back (std::move (entry));
+
+        while ((int) pool.size() > maxPooledReaders)
+        {
+            evicted.push_back (std::move (pool.front()));
+            pool.erase (pool.begin());
+        }
+    }
+}
+
+int AudioFormatRegistry::getNumPooledReaders() const
+{
+    const juce::ScopedLock sl (poolLock);
+    return (int) pool.size();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// The process's audio formats, registered once and shared by the library,
+// the preview engine and the command-line tools. Hold it through
+// juce::SharedResourcePointer<AudioFormatRegistry>.
+//
+// Readers are opened with the format the file extension names before any
+// other is tried, so an AIFF or FLAC probe doesn't first fail through the
+// WAV parser. Recently released readers are kept open in a small pool: a
+// file that is auditioned again gets its decoder back without re-parsing
+// the header or rebuilding decoder tables. Readers read from any position,
+// so a pooled one needs no reset before reuse. All methods are thread-safe.
+//==============================================================================
+class AudioFormatRegistry
+{
+public:
+    AudioFormatRegistry();
+
+    juce::AudioFormatManager& getFormatManager() { return formatManager; }
+
+    // Returns nullptr if no registered format can read the file
+    std::unique_ptr<juce::AudioFormatReader> createReaderFor (const juce::File& file);
+    std::unique_ptr<juce::AudioFormatReader> createReaderFor (const juce::File& file, std::unique_ptr<juce::InputStream> stream);
+
+    // The state of the file a reader was opened on
+    struct FileStamp
+    {
+        juce::int64 modificationTime = 0;
+        juce::int64 fileSize = 0;
+
+        static FileStamp of (const juce::File& file);
+        bool operator== (const FileStamp& other) const { return modificationTime == other.modificationTime && fileSize == other.fileSize; }
+    };
+
+    // A pooled reader for the file if one is idle and the file is unchanged,
+    // otherwise a new one; stamp is set to the file as the reader saw it.
+    // Hand it back with releaseReader(), passing the same stamp, when done.
+    std::unique_ptr<juce::AudioFormatReader> acquireReader (const juce::File& file, FileStamp& stamp);
+    void releaseReader (const juce::File& file, const FileStamp& stamp, std::unique_ptr<juce::AudioFormatReader> reader);
+
+    int getNumPooledReaders() const;
+
+private:
+    static constexpr int maxPooledReaders = 8;
+
+    struct PooledReader
+    {
+        juce::String path;
+        FileStamp stamp;
+        std::unique_ptr<juce::AudioFormatReader> reader;
+    };
+
+    juce::AudioFormatManager formatManager;
+
+    juce::CriticalSection poolLock;
+    std::vector<PooledReader> pool;     // least recently released first
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioFormatRegistry)
+};
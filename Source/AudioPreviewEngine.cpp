@@ -1,83 +1,187 @@
 #include "AudioPreviewEngine.h"
+#include "MappedPcmSource.h"
+#include "TraceRecorder.h"
+
+namespace
+{
+    // Plays a reader from the registry's pool and hands it back when the
+    // voice is done with it, so auditioning the file again reuses it
+    class PooledReaderSource : public juce::AudioFormatReaderSource
+    {
+    public:
+        PooledReaderSource (const juce::File& f, const AudioFormatRegistry::FileStamp& s, std::unique_ptr<juce::AudioFormatReader> r)
+            : juce::AudioFormatReaderSource (r.get(), false), file (f), stamp (s), reader (std::move (r))
+        {
+        }
+
+        ~PooledReaderSource() override
+        {
+            formats->releaseReader (file, stamp, std::move (reader));
+        }
+
+    private:
+        juce::SharedResourcePointer<AudioFormatRegistry> formats;
+        juce::File file;
+        AudioFormatRegistry::FileStamp stamp;
+        std::unique_ptr<juce::AudioFormatReader> reader;
+    };
+}
 
 AudioPreviewEngine::AudioPreviewEngine()
 {
-    formatManager.registerBasicFormats();
-    transportSource.addChangeListener (this);
+    voices.onVoiceFinished = [this] (int voice, bool reachedEnd)
+    {
+        if (voice != leadVoice)
+            return;
+
+        leadVoice = -1;
+
+        // Playback finished
+        if (reachedEnd && onPlaybackStopped)
+            onPlaybackStopped();
+    };
+
     startTimerHz (30);
 }
 
 AudioPreviewEngine::~AudioPreviewEngine()
 {
     stopTimer();
-    transportSource.removeChangeListener (this);
-    transportSource.setSource (nullptr);
-    readerSource.reset();
+    prefaultPool.removeAllJobs (true, 2000);
 }
 
-void AudioPreviewEngine::loadAndPlay (const juce::File& file)
+//==============================================================================
+void AudioPreviewEngine::prepareToPlay (double sampleRate, int maximumBlockSize)
 {
-    // Stop current playback
-    transportSource.stop();
-    transportSource.setSource (nullptr);
-    readerSource.reset();
+    voices.prepareToPlay (sampleRate, maximumBlockSize);
+}
 
-    auto* reader = formatManager.createReaderFor (file);
-    if (reader != nullptr)
+void AudioPreviewEngine::getNextAudioBlock (juce::AudioBuffer<float>& buffer)
+{
+    voices.renderNextBlock (buffer, 0, buffer.getNumSamples());
+}
+
+//==============================================================================
+std::unique_ptr<juce::PositionableAudioSource> AudioPreviewEngine::createSource (const juce::File& file, double startSeconds,
+                                                                                  double& sampleRate)
+{
+    // Uncompressed WAV and AIFF play straight from a memory mapping; anything
+    // else goes through a format reader
+    if (auto mapped = MappedPcmSource::create (file, startSeconds))
+    {
+        sampleRate = mapped->getSampleRate();
+        mapped->startPrefaulting (prefaultPool);
+        return mapped;
+    }
+
+    AudioFormatRegistry::FileStamp stamp;
+
+    if (auto reader = formats->acquireReader (file, stamp))
     {
-        currentFile = file;
-        readerSource = std::make_unique<juce::AudioFormatReaderSource> (reader, true);
-        transportSource.setSource (readerSource.get(), 0, nullptr, reader->sampleRate);
-        transportSource.setGain (currentGain.load());
-        transportSource.start();
-
-        if (onPlaybackStarted)
-            onPlaybackStarted();
+        sampleRate = reader->sampleRate;
+        auto startSample = juce::jlimit ((juce::int64) 0, juce::jmax ((juce::int64) 0, reader->lengthInSamples - 1),
+                                         (juce::int64) (startSeconds * sampleRate));
+
+        auto source = std::make_unique<PooledReaderSource> (file, stamp, std::move (reader));
+        source->setNextReadPosition (startSample);
+        return source;
     }
+
+    return nullptr;
+}
+
+float AudioPreviewEngine::getNormalisationGain (const LoudnessAnalyzer::Measurement& loudness) const
+{
+    // Files that haven't been measured, or are silent, play as they are
+    if (! loudnessNormalised || ! loudness.isMeasured || loudness.integratedLufs <= LoudnessAnalyzer::silenceDb)
+        return 1.0f;
+
+    auto gainDb = juce::jmin (targetLufs - loudness.integratedLufs, peakCeilingDb - loudness.truePeakDb, maxBoostDb);
+    return juce::Decibels::decibelsToGain (gainDb);
+}
+
+void AudioPreviewEngine::loadAndPlay (const juce::File& file, bool layered, const PreviewAnalysis& analysis)
+{
+    const TraceScope traceScope ("loadAndPlay");
+
+    double sourceSampleRate = 0.0;
+    auto source = createSource (file, skipLeadingSilence ? analysis.onsetSeconds : 0.0, sourceSampleRate);
+
+    if (source == nullptr)
+        return;
+
+    // Earlier previews fade out unless this one is layered on top
+    if (! layered)
+        voices.stopAllVoices();
+
+    auto voice = voices.startVoice (std::move (source), sourceSampleRate, getNormalisationGain (analysis.loudness));
+    if (voice < 0)
+        return;
+
+    leadVoice = voice;
+    currentFile = file;
+    currentAnalysis = analysis;
+
+    if (onPlaybackStarted)
+        onPlaybackStarted();
 }
 
 void AudioPreviewEngine::stop()
 {
-    transportSource.stop();
-    transportSource.setPosition (0.0);
+    voices.stopAllVoices();
+    leadVoice = -1;
 }
 
 void AudioPreviewEngine::pause()
 {
-    if (transportSource.isPlaying())
-        transportSource.stop();
+    voices.setVoicePaused (leadVoice, true);
 }
 
 void AudioPreviewEngine::togglePlayPause()
 {
-    if (transportSource.isPlaying())
-        transportSource.stop();
-    else
-        transportSource.start();
+    if (voices.isVoiceActive (leadVoice))
+        voices.setVoicePaused (leadVoice, ! voices.isVoicePaused (leadVoice));
+    else if (currentFile.existsAsFile())
+        loadAndPlay (currentFile, false, currentAnalysis);
 }
 
 bool AudioPreviewEngine::isPlaying() const
 {
-    return transportSource.isPlaying();
+    return voices.isVoiceActive (leadVoice) && ! voices.isVoicePaused (leadVoice);
 }
 
 double AudioPreviewEngine::getPlaybackPosition() const
 {
-    auto length = transportSource.getLengthInSeconds();
-    if (length <= 0.0)
-        return 0.0;
-    return transportSource.getCurrentPosition() / length;
+    return voices.getVoicePosition (leadVoice);
+}
+
+void AudioPreviewEngine::setPlaybackPosition (double proportion)
+{
+    // Seeking after the preview ended plays it again from there
+    if (! voices.isVoiceActive (leadVoice) && currentFile.existsAsFile())
+        loadAndPlay (currentFile, false, currentAnalysis);
+
+    voices.setVoicePosition (leadVoice, proportion);
 }
 
 double AudioPreviewEngine::getPlaybackLengthSeconds() const
 {
-    return transportSource.getLengthInSeconds();
+    return voices.getVoiceLengthSeconds (leadVoice);
 }
 
 void AudioPreviewEngine::setGain (float gainLinear)
 {
     currentGain = juce::jlimit (0.0f, 2.0f, gainLinear);
-    transportSource.setGain (currentGain.load());
+    voices.setMasterGain (currentGain.load());
+}
+
+void AudioPreviewEngine::setLoudnessNormalised (bool shouldNormalise)
+{
+    loudnessNormalised = shouldNormalise;
+
+    // The preview that's playing follows straight away
+    if (voices.isVoiceActive (leadVoice))
+        voices.setVoiceGain (leadVoice, getNormalisationGain (currentAnalysis.loudness));
 }
 
 void AudioPreviewEngine::setDawBpm (double bpm)
@@ -95,18 +199,10 @@ void AudioPreviewEngine::setDawPositionSamples (int64_t position)
     dawPositionSamples = position;
 }
 
-void AudioPreviewEngine::changeListenerCallback (juce::ChangeBroadcaster*)
-{
-    if (! transportSource.isPlaying() && transportSource.getCurrentPosition() >= transportSource.getLengthInSeconds() - 0.01)
-    {
-        // Playback finished
-        if (onPlaybackStopped)
-            onPlaybackStopped();
-    }
-}
-
 void AudioPreviewEngine::timerCallback()
 {
-    if (onPositionChanged && transportSource.isPlaying())
+    voices.update();
+
+    if (onPositionChanged && isPlaying())
         onPositionChanged (getPlaybackPosition());
 }
@@ -1,30 +1,65 @@
 #pragma once
 #include <JuceHeader.h>
+#include "AudioFormatRegistry.h"
+#include "LoudnessAnalyzer.h"
+#include "PreviewVoicePool.h"
 
 //==============================================================================
-// Audio engine for previewing sound files
+// What the library's analysis found out about a file, for shaping its preview
+struct PreviewAnalysis
+{
+    LoudnessAnalyzer::Measurement loudness;
+    double onsetSeconds = 0.0;
+};
+
 //==============================================================================
-class AudioPreviewEngine : public juce::ChangeListener,
-                           public juce::Timer
+// Audio engine for previewing sound files.
+//
+// Previews play as voices of a PreviewVoicePool, so several can sound at
+// once: a layered preview starts on top of whatever is playing, anything
+// else fades the earlier previews out. The transport controls act on the
+// most recent preview.
+//==============================================================================
+class AudioPreviewEngine : public juce::Timer
 {
 public:
     AudioPreviewEngine();
     ~AudioPreviewEngine() override;
 
-    // Playback control
-    void loadAndPlay (const juce::File& file);
+    // Audio thread
+    void prepareToPlay (double sampleRate, int maximumBlockSize);
+    void getNextAudioBlock (juce::AudioBuffer<float>& buffer);
+
+    // Playback control. The analysis sets the preview's gain when loudness
+    // normalisation is on, and where it starts when skipping leading silence.
+    void loadAndPlay (const juce::File& file, bool layered = false, const PreviewAnalysis& analysis = {});
     void stop();
     void pause();
     void togglePlayPause();
 
     bool isPlaying() const;
     double getPlaybackPosition() const; // 0.0 to 1.0
+    void setPlaybackPosition (double proportion);
     double getPlaybackLengthSeconds() const;
+    int getNumPlayingVoices() const { return voices.getNumSoundingVoices(); }
 
     // Gain
     void setGain (float gainLinear);
     float getGain() const { return currentGain.load(); }
 
+    // Normalised previews play at targetLufs, or quieter if that would push
+    // the true peak above peakCeilingDb. The gain is worked out from the
+    // stored measurement when a preview starts and becomes the voice's own
+    // gain, so playback costs nothing extra.
+    void setLoudnessNormalised (bool shouldNormalise);
+    bool isLoudnessNormalised() const { return loudnessNormalised; }
+
+    // Previews start just before the file's first transient rather than at
+    // its first sample. The source is opened at that point, so the leading
+    // silence is never read or decoded.
+    void setSkipLeadingSilence (bool shouldSkip)   { skipLeadingSilence = shouldSkip; }
+    bool isSkippingLeadingSilence() const           { return skipLeadingSilence; }
+
     // DAW Sync (VST only)
     void setDawBpm (double bpm);
     void setDawPlaying (bool playing);
@@ -32,14 +67,11 @@ public:
     double getDawBpm() const { return dawBpm.load(); }
     bool isDawPlaying() const { return dawPlaying.load(); }
 
-    // Transport source access
-    juce::AudioTransportSource& getTransportSource() { return transportSource; }
-    juce::AudioFormatManager& getFormatManager() { return formatManager; }
+    juce::AudioFormatManager& getFormatManager() { return formats->getFormatManager(); }
 
     // Current file info
     juce::File getCurrentFile() const { return currentFile; }
 
-    void changeListenerCallback (juce::ChangeBroadcaster* source) override;
     void timerCallback() override;
 
     std::function<void()> onPlaybackStopped;
@@ -47,12 +79,25 @@ public:
     std::function<void (double)> onPositionChanged;
 
 private:
-    juce::AudioFormatManager formatManager;
-    juce::AudioTransportSource transportSource;
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
+    static constexpr float targetLufs = -18.0f;
+    static constexpr float peakCeilingDb = -1.0f;
+    static constexpr float maxBoostDb = 24.0f;
+
+    std::unique_ptr<juce::PositionableAudioSource> createSource (const juce::File& file, double startSeconds, double& sampleRate);
+    float getNormalisationGain (const LoudnessAnalyzer::Measurement& loudness) const;
+
+    juce::SharedResourcePointer<AudioFormatRegistry> formats;
+    PreviewVoicePool voices;
+    int leadVoice = -1;     // the most recent preview
+
+    // Faults in the pages of memory-mapped previews ahead of playback
+    juce::ThreadPool prefaultPool { 1 };
 
     juce::File currentFile;
+    PreviewAnalysis currentAnalysis;
     std::atomic<float> currentGain { 1.0f };
+    bool loudnessNormalised = false;
+    bool skipLeadingSilence = true;
 
     // DAW sync state
     std::atomic<double> dawBpm { 120.0 };
@@ -0,0 +1,300 @@
+#include "BatchExporter.h"
+#include "FileReadahead.h"
+#include "TraceRecorder.h"
+
+//==============================================================================
+BatchExporter::BatchExporter (const Settings& s)
+    : settings (s)
+{
+}
+
+juce::StringArray BatchExporter::getFormatNames()
+{
+    return { "WAV", "AIFF", "FLAC" };
+}
+
+juce::String BatchExporter::getExtension() const
+{
+    if (settings.formatName == "AIFF")  return ".aiff";
+    if (settings.formatName == "FLAC")  return ".flac";
+    return ".wav";
+}
+
+juce::AudioFormat* BatchExporter::getFormat() const
+{
+    return formats->getFormatManager().findFormatForFileExtension (getExtension());
+}
+
+juce::String BatchExporter::validate() const
+{
+    auto* format = getFormat();
+
+    if (! getFormatNames().contains (settings.formatName) || format == nullptr)
+        return settings.formatName + " files can't be written";
+
+    if (! format->getPossibleBitDepths().contains (settings.bitsPerSample))
+        return settings.formatName + " files can't be " + juce::String (settings.bitsPerSample) + "-bit";
+
+    if (settings.sampleRate > 0.0 && ! format->getPossibleSampleRates().contains ((int) settings.sampleRate))
+        return settings.formatName + " files can't be " + juce::String (settings.sampleRate, 0) + " Hz";
+
+    if (! settings.destination.isDirectory() && ! settings.destination.createDirectory())
+        return "Can't create " + settings.destination.getFullPathName();
+
+    return {};
+}
+
+//==============================================================================
+juce::Array<juce::File> BatchExporter::planTargets (const juce::Array<juce::File>& files) const
+{
+    juce::Array<juce::File> targets;
+    std::unordered_set<juce::String> taken;
+    auto extension = getExtension();
+
+    for (auto& file : files)
+    {
+        auto name = file.getFileNameWithoutExtension();
+        auto target = settings.destination.getChildFile (name + extension);
+
+        for (int suffix = 2; target.exists() || taken.count (target.getFileName().toLowerCase()) != 0; ++suffix)
+            target = settings.destination.getChildFile (name + " (" + juce::String (suffix) + ")" + extension);
+
+        taken.insert (target.getFileName().toLowerCase());
+        targets.add (target);
+    }
+
+    return targets;
+}
+
+BatchExporter::Result BatchExporter::run (const juce::Array<juce::File>& files, const std::function<bool (float)>& progressCallback)
+{
+    TraceRecorder::getInstance().registerThisThread();
+    const TraceScope traceScope ("exportBatch");
+    jassert (validate().isEmpty());
+
+    Result result;
+    auto targets = planTargets (files);
+
+    juce::CriticalSection resultLock;
+    std::atomic<int> nextFile { 0 };
+    std::atomic<int> numFinished { 0 };
+    std::atomic<bool> cancelled { false };
+
+    auto numWorkers = juce::jlimit (1, juce::jmax (1, files.size()), juce::SystemStats::getNumCpus());
+    juce::ThreadPool pool (numWorkers);
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        pool.addJob ([&, numWorkers]
+        {
+            TraceRecorder::getInstance().registerThisThread();
+
+            for (;;)
+            {
+                auto index = nextFile++;
+                if (index >= files.size() || cancelled)
+                    break;
+
+                // Keep the disk about one file per worker ahead of decoding
+                if (index + numWorkers < files.size())
+                    FileReadahead::prefetch (files.getReference (index + numWorkers), readaheadBytes);
+
+                auto error = exportFile (files.getReference (index), targets.getReference (index), cancelled);
+
+                {
+                    const juce::ScopedLock sl (resultLock);
+
+                    // A file interrupted by cancelling isn't a failure
+                    if (error.isEmpty())
+                        ++result.numExported;
+                    else if (! cancelled)
+                        result.failures.add (files.getReference (index).getFullPathName() + ": " + error);
+                }
+
+                ++numFinished;
+            }
+        });
+    }
+
+    while (pool.getNumJobs() > 0)
+    {
+        if (progressCallback != nullptr && ! progressCallback ((float) numFinished.load() / (float) juce::jmax (1, files.size())))
+            cancelled = true;
+
+        juce::Thread::sleep (50);
+    }
+
+    result.cancelled = cancelled;
+    return result;
+}
+
+//==============================================================================
+juce::String BatchExporter::exportFile (const juce::File& source, const juce::File& target, const std::atomic<bool>& cancelled)
+{
+    const TraceScope traceScope ("exportFile");
+
+    auto reader = formats->createReaderFor (source);
+    if (reader == nullptr || reader->sampleRate <= 0.0)
+        return "unreadable";
+
+    auto numChannels = (int) reader->numChannels;
+    auto sourceRate = reader->sampleRate;
+    auto targetRate = settings.sampleRate > 0.0 ? settings.sampleRate : sourceRate;
+
+    auto ratio = sourceRate / targetRate;
+    auto resampling = std::abs (ratio - 1.0) > 1.0e-9;
+
+    auto outputLength = resampling ? (juce::int64) std::ceil ((double) reader->lengthInSamples / ratio)
+                                   : reader->lengthInSamples;
+
+    // The sinc interpolator's kernel is fixed at the source rate, so when
+    // downsampling it lets through everything up to the source's Nyquist,
+    // which would fold back below the target's. A linear-phase low-pass with
+    // its stopband from the target's Nyquist goes in front of it.
+    juce::dsp::FIR::Coefficients<float>::Ptr antiAlias;
+
+    if (resampling && ratio > 1.0)
+        antiAlias = juce::dsp::FilterDesign<float>::designFIRLowpassKaiserMethod ((float) (0.475 * targetRate), sourceRate,
+                                                                                  (float) (0.05 * targetRate / sourceRate), -90.0f);
+
+    auto filterDelay = antiAlias != nullptr ? (double) antiAlias->getFilterOrder() / 2.0 : 0.0;
+
+    // The filter and the interpolator delay their output; that much is
+    // dropped from the start and read past the end instead, so transients
+    // stay where they were
+    auto latency = resampling ? (juce::int64) juce::roundToInt ((juce::WindowedSincInterpolator::getBaseLatency() + filterDelay) / ratio) : 0;
+
+    // Streams the converted file through fixed-size blocks, handing each to
+    // consume (buffer, startSample, numSamples), which returns false to stop.
+    // When resampling, the input block holds enough source for one output
+    // block plus whatever the interpolator didn't consume last time.
+    auto convert = [&] (auto&& consume) -> juce::String
+    {
+        juce::AudioBuffer<float> output (numChannels, blockSize);
+        juce::AudioBuffer<float> input (numChannels, resampling ? (int) std::ceil (blockSize * ratio) + 16 : 0);
+        std::vector<juce::WindowedSincInterpolator> interpolators ((size_t) (resampling ? numChannels : 0));
+        std::vector<std::unique_ptr<juce::dsp::FIR::Filter<float>>> filters;
+
+        if (antiAlias != nullptr)
+            for (int ch = 0; ch < numChannels; ++ch)
+                filters.push_back (std::make_unique<juce::dsp::FIR::Filter<float>> (antiAlias));
+
+        int inputCount = 0;
+        juce::int64 readPosition = 0;
+
+        for (juce::int64 produced = 0; produced < outputLength + latency;)
+        {
+            if (cancelled)
+                return "cancelled";
+
+            int numOut;
+
+            if (resampling)
+            {
+                // Reads past the end come back as silence, which flushes the tail
+                auto numToRead = input.getNumSamples() - inputCount;
+                reader->read (&input, inputCount, numToRead, readPosition, true, true);
+                readPosition += numToRead;
+
+                for (size_t ch = 0; ch < filters.size(); ++ch)
+                {
+                    auto* data = input.getWritePointer ((int) ch, inputCount);
+
+                    for (int i = 0; i < numToRead; ++i)
+                        data[i] = filters[ch]->processSample (data[i]);
+                }
+
+                inputCount += numToRead;
+
+                numOut = (int) juce::jmin ((juce::int64) blockSize, outputLength + latency - produced,
+                                           (juce::int64) ((inputCount - 4) / ratio));
+                int numUsed = 0;
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                {
+                    numUsed = interpolators[(size_t) ch].process (ratio, input.getReadPointer (ch), output.getWritePointer (ch), numOut);
+                    std::memmove (input.getWritePointer (ch), input.getReadPointer (ch) + numUsed, sizeof (float) * (size_t) (inputCount - numUsed));
+                }
+
+                inputCount -= numUsed;
+            }
+            else
+            {
+                numOut = (int) juce::jmin ((juce::int64) blockSize, outputLength - produced);
+                reader->read (&output, 0, numOut, readPosition, true, true);
+                readPosition += numOut;
+            }
+
+            auto skip = (int) juce::jlimit ((juce::int64) 0, (juce::int64) numOut, latency - produced);
+            produced += numOut;
+
+            if (numOut > skip && ! consume (output, skip, numOut - skip))
+                return "write failed";
+        }
+
+        return {};
+    };
+
+    float gain = 1.0f;
+
+    if (settings.normalise)
+    {
+        float peak = 0.0f;
+
+        if (resampling)
+        {
+            // Interpolation and filtering can overshoot the source's peaks, so
+            // the gain comes from a first pass over the converted audio
+            auto error = convert ([&peak] (const juce::AudioBuffer<float>& buffer, int start, int numSamples)
+            {
+                peak = juce::jmax (peak, buffer.getMagnitude (start, numSamples));
+                return true;
+            });
+
+            if (error.isNotEmpty())
+                return error;
+        }
+        else
+        {
+            std::vector<juce::Range<float>> levels ((size_t) numChannels);
+            reader->readMaxLevels (0, reader->lengthInSamples, levels.data(), numChannels);
+
+            for (auto& range : levels)
+                peak = juce::jmax (peak, -range.getStart(), range.getEnd());
+        }
+
+        if (peak > 0.0f)
+            gain = juce::Decibels::decibelsToGain (settings.normalisePeakDb) / peak;
+    }
+
+    juce::TemporaryFile temp (target);
+    auto stream = std::make_unique<juce::FileOutputStream> (temp.getFile());
+
+    if (! stream->openedOk())
+        return "can't write to " + target.getParentDirectory().getFullPathName();
+
+    std::unique_ptr<juce::AudioFormatWriter> writer (getFormat()->createWriterFor (stream.get(), targetRate, (unsigned int) numChannels,
+                                                                                   settings.bitsPerSample, {}, 0));
+    if (writer == nullptr)
+        return "can't be written as " + juce::String (numChannels) + "-channel " + settings.formatName;
+
+    stream.release();   // owned by the writer now
+
+    auto error = convert ([&] (juce::AudioBuffer<float>& buffer, int start, int numSamples)
+    {
+        if (gain != 1.0f)
+            buffer.applyGain (start, numSamples, gain);
+
+        return writer->writeFromAudioSampleBuffer (buffer, start, numSamples);
+    });
+
+    if (error.isNotEmpty())
+        return error;
+
+    writer.reset();
+
+    if (! temp.overwriteTargetFileWithTemporary())
+        return "couldn't move into " + target.getParentDirectory().getFullPathName();
+
+    return {};
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <JuceHeader.h>
+#include "AudioFormatRegistry.h"
+
+//==============================================================================
+// Converts a batch of samples to one format, sample rate and bit depth,
+// optionally peak-normalised, and writes them into a folder.
+//
+// Files are spread over a thread pool, one file at a time per worker, with
+// the disk reading a few files ahead of the workers. Each file streams
+// through fixed-size blocks (decode, resample, gain, encode), so memory use
+// depends on the number of workers, not on how long the files are; a file
+// that is both resampled and normalised streams through twice, the first
+// time to find the peak of the resampled audio. Outputs
+// are written to a temporary file and moved into place once complete, so a
+// cancelled or failed export never leaves a truncated file behind.
+//==============================================================================
+class BatchExporter
+{
+public:
+    struct Settings
+    {
+        juce::File destination;
+        juce::String formatName = "WAV";    // one of getFormatNames()
+        double sampleRate = 0.0;            // 0 keeps each file's rate
+        int bitsPerSample = 24;
+        bool normalise = false;
+        float normalisePeakDb = -1.0f;
+    };
+
+    struct Result
+    {
+        int numExported = 0;
+        juce::StringArray failures;         // "<path>: <reason>"
+        bool cancelled = false;
+    };
+
+    explicit BatchExporter (const Settings& settings);
+
+    static juce::StringArray getFormatNames();
+
+    // Empty if the settings can be used, otherwise the reason they can't
+    juce::String validate() const;
+
+    // Exports the files and returns once all are done. The callback is given
+    // the fraction finished every so often; returning false cancels.
+    Result run (const juce::Array<juce::File>& files, const std::function<bool (float)>& progressCallback);
+
+private:
+    static constexpr int blockSize = 8192;
+    static constexpr juce::int64 readaheadBytes = 4 << 20;
+
+    juce::AudioFormat* getFormat() const;
+    juce::String getExtension() const;
+
+    // Unique names in the destination, so same-named files from different
+    // folders don't overwrite each other
+    juce::Array<juce::File> planTargets (const juce::Array<juce::File>& files) const;
+
+    // Returns an empty string once the file is in place, otherwise why not
+    juce::String exportFile (const juce::File& source, const juce::File& target, const std::atomic<bool>& cancelled);
+
+    Settings settings;
+    juce::SharedResourcePointer<AudioFormatRegistry> formats;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchExporter)
+};
@@ -0,0 +1,277 @@
+#include <JuceHeader.h>
+#include "SampleLibrary.h"
+#include "SyntheticLibrary.h"
+#include "PerformanceCounters.h"
+#include <iostream>
+
+#if ! JUCE_WINDOWS
+ #include <sys/resource.h>
+#endif
+
+//==============================================================================
+// Sound Xplorer Benchmark
+//
+// Generates synthetic libraries (see SyntheticLibrary) and measures, for each
+// size: cold scan, warm start from the caches, query latency percentiles, rank
+// sorts, tag facets and memory. Results are written as JSON so that runs on
+// different commits can be diffed or plotted.
+//
+//   SoundXplorerBenchmark [--sizes 10000,100000] [--runs <n>] [--work <dir>]
+//                         [--label <text>] [--output <file.json>]
+//==============================================================================
+namespace
+{
+    double getMillisecondsSince (double startTime)
+    {
+        return juce::Time::getMillisecondCounterHiRes() - startTime;
+    }
+
+    template <typename Function>
+    double timeMilliseconds (Function&& function)
+    {
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+        function();
+        return getMillisecondsSince (startTime);
+    }
+
+    juce::int64 getPeakResidentMemoryBytes()
+    {
+       #if JUCE_WINDOWS
+        return 0;
+       #else
+        rusage usage {};
+        getrusage (RUSAGE_SELF, &usage);
+        #if JUCE_MAC
+         return (juce::int64) usage.ru_maxrss;           // bytes
+        #else
+         return (juce::int64) usage.ru_maxrss * 1024;    // kilobytes
+        #endif
+       #endif
+    }
+
+    // Queries covering each path through getFilteredSamples
+    struct BenchmarkQuery
+    {
+        const char* name;
+        const char* text;
+    };
+
+    const BenchmarkQuery benchmarkQueries[] = {
+        { "all",           "" },
+        { "fuzzyShort",    "kick" },
+        { "fuzzyTypo",     "snrae" },
+        { "fuzzyPhrase",   "dusty vocal" },
+        { "bpmRange",      "bpm:120-128" },
+        { "keyAndType",    "key:Am type:loop" },
+        { "tagAndText",    "tag:drums punchy" },
+        { "selectiveMix",  "bpm:90-100 key:F tag:bass -tag:fx" },
+    };
+
+    juce::var getLatencyStats (std::vector<double> timings)
+    {
+        std::sort (timings.begin(), timings.end());
+
+        auto percentile = [&timings] (double fraction)
+        {
+            return timings[(size_t) juce::roundToInt (fraction * (double) (timings.size() - 1))];
+        };
+
+        auto* stats = new juce::DynamicObject();
+        stats->setProperty ("minMs", timings.front());
+        stats->setProperty ("p50Ms", percentile (0.5));
+        stats->setProperty ("p90Ms", percentile (0.9));
+        stats->setProperty ("p99Ms", percentile (0.99));
+        stats->setProperty ("maxMs", timings.back());
+        return stats;
+    }
+
+    //==========================================================================
+    juce::var benchmarkLibrarySize (const juce::File& workFolder, int numFiles, int numRuns)
+    {
+        auto* result = new juce::DynamicObject();
+        juce::var resultVar (result);
+        result->setProperty ("files", numFiles);
+
+        auto log = [numFiles] (const juce::String& message)
+        {
+            std::cerr << "[" << numFiles << "] " << message << std::endl;
+        };
+
+        SyntheticLibrary synthetic (workFolder.getChildFile ("library_" + juce::String (numFiles)), numFiles);
+
+        log ("generating");
+        bool generated = true;
+        result->setProperty ("generateMs", timeMilliseconds ([&] { generated = synthetic.generate(); }));
+
+        if (! generated)
+            juce::ConsoleApplication::fail ("Couldn't generate " + synthetic.getRootFolder().getFullPathName());
+
+        // Each size gets a fresh state folder, so the first scan analyses everything
+        auto stateFolder = workFolder.getChildFile ("state_" + juce::String (numFiles));
+        stateFolder.deleteRecursively();
+
+        auto memoryBefore = PerformanceCounters::getResidentMemoryBytes();
+
+        {
+            log ("cold scan");
+            SampleLibrary library (stateFolder);
+            auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+            // Listed: browsable with name-based guesses; scanned: fully analysed
+            library.addLibraryFolder (synthetic.getRootFolder());
+            result->setProperty ("coldListMs", getMillisecondsSince (startTime));
+
+            library.finishPendingAnalysis();
+            result->setProperty ("coldScanMs", getMillisecondsSince (startTime));
+            result->setProperty ("samples", library.getTotalFileCount());
+            result->setProperty ("duplicateGroups", library.getDuplicateGroups().size());
+        }
+
+        log ("warm start");
+        std::unique_ptr<SampleLibrary> library;
+        result->setProperty ("warmStartMs", timeMilliseconds ([&]
+        {
+            library = std::make_unique<SampleLibrary> (stateFolder);
+            library->finishPendingAnalysis();
+        }));
+        result->setProperty ("libraryResidentBytes", PerformanceCounters::getResidentMemoryBytes() - memoryBefore);
+
+        log ("queries");
+        auto* queries = new juce::DynamicObject();
+        result->setProperty ("queries", queries);
+
+        for (auto& benchmarkQuery : benchmarkQueries)
+        {
+            auto query = SampleQuery::parse (benchmarkQuery.text);
+            std::vector<double> timings;
+            int numResults = 0;
+
+            for (int run = 0; run < numRuns; ++run)
+                timings.push_back (timeMilliseconds ([&] { numResults = library->getFilteredSamples (query).size(); }));
+
+            auto stats = getLatencyStats (std::move (timings));
+            stats.getDynamicObject()->setProperty ("query", benchmarkQuery.text);
+            stats.getDynamicObject()->setProperty ("results", numResults);
+            queries->setProperty (benchmarkQuery.name, stats);
+        }
+
+        log ("facets");
+        {
+            std::vector<double> facetTimings, allTagsTimings;
+
+            for (int run = 0; run < numRuns; ++run)
+            {
+                SampleLibrary::TagCounts facetCounts;
+                facetTimings.push_back (timeMilliseconds ([&] { library->getFilteredSamples ({}, &facetCounts); }));
+                allTagsTimings.push_back (timeMilliseconds ([&] { library->getAllTags(); }));
+            }
+
+            result->setProperty ("tagFacets", getLatencyStats (std::move (facetTimings)));
+            result->setProperty ("getAllTags", getLatencyStats (std::move (allTagsTimings)));
+        }
+
+        log ("sort");
+        {
+            auto everything = library->getFilteredSamples ({});
+            auto someResults = library->getFilteredSamples (SampleQuery::parse ("tag:drums"));
+
+            auto* sorts = new juce::DynamicObject();
+            result->setProperty ("sort", sorts);
+
+            const std::pair<const char*, SampleSortColumn> columns[] = {
+                { "name", sortByName }, { "type", sortByType }, { "bpm", sortByBpm }, { "key", sortByKey }
+            };
+
+            for (auto& column : columns)
+            {
+                std::vector<double> allTimings, someTimings;
+                juce::Array<int> order;
+
+                for (int run = 0; run < numRuns; ++run)
+                {
+                    allTimings.push_back (timeMilliseconds ([&] { SampleLibrary::sortByRank (everything, column.second, order); }));
+                    someTimings.push_back (timeMilliseconds ([&] { SampleLibrary::sortByRank (someResults, column.second, order); }));
+                }
+
+                sorts->setProperty (juce::String (column.first) + "All", getLatencyStats (std::move (allTimings)));
+                sorts->setProperty (juce::String (column.first) + "Drums", getLatencyStats (std::move (someTimings)));
+            }
+        }
+
+        result->setProperty ("residentBytes", PerformanceCounters::getResidentMemoryBytes());
+        result->setProperty ("peakResidentBytes", getPeakResidentMemoryBytes());
+
+        return resultVar;
+    }
+
+    void runBenchmarks (const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+
+        auto sizesOption = args.removeValueForOption ("--sizes");
+        auto runsOption = args.removeValueForOption ("--runs");
+        auto workOption = args.removeValueForOption ("--work");
+        auto label = args.removeValueForOption ("--label");
+        auto outputOption = args.removeValueForOption ("--output");
+
+        juce::StringArray sizes;
+        sizes.addTokens (sizesOption.isNotEmpty() ? sizesOption : "10000,100000", ",", {});
+        sizes.removeEmptyStrings();
+
+        auto numRuns = runsOption.isNotEmpty() ? juce::jmax (1, runsOption.getIntValue()) : 20;
+
+        auto workFolder = workOption.isNotEmpty()
+                              ? juce::File::getCurrentWorkingDirectory().getChildFile (workOption)
+                              : juce::File::getSpecialLocation (juce::File::tempDirectory).getChildFile ("SoundXplorerBenchmark");
+
+        if (! workFolder.createDirectory())
+            juce::ConsoleApplication::fail ("Couldn't create " + workFolder.getFullPathName());
+
+        auto* report = new juce::DynamicObject();
+        juce::var reportVar (report);
+        report->setProperty ("label", label);
+        report->setProperty ("time", juce::Time::getCurrentTime().toISO8601 (true));
+        report->setProperty ("cpus", juce::SystemStats::getNumCpus());
+        report->setProperty ("os", juce::SystemStats::getOperatingSystemName());
+        report->setProperty ("runs", numRuns);
+
+        juce::Array<juce::var> results;
+        for (auto& size : sizes)
+            results.add (benchmarkLibrarySize (workFolder, size.getIntValue(), numRuns));
+
+        report->setProperty ("results", results);
+
+        auto json = juce::JSON::toString (reportVar);
+
+        if (outputOption.isNotEmpty())
+        {
+            auto outputFile = juce::File::getCurrentWorkingDirectory().getChildFile (outputOption);
+            if (! outputFile.replaceWithText (json))
+                juce::ConsoleApplication::fail ("Couldn't write " + outputFile.getFullPathName());
+        }
+        else
+        {
+            std::cout << json << std::endl;
+        }
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    // SampleLibrary broadcasts change messages, which need a message manager
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ConsoleApplication app;
+
+    app.addHelpCommand ("help|--help|-h",
+                        "Sound Xplorer Benchmark\n"
+                        "Usage: SoundXplorerBenchmark [--sizes 10000,100000,1000000] [--runs <n>]\n"
+                        "                             [--work <dir>] [--label <text>] [--output <file.json>]\n"
+                        "Synthetic libraries are kept in the work folder and reused by later runs.",
+                        false);
+
+    app.addDefaultCommand ({ {}, {}, "Runs the benchmarks", {}, runBenchmarks });
+
+    return app.findAndRunCommand (juce::ArgumentList (argc, argv));
+}
@@ -0,0 +1,158 @@
+#include "BrowserViewModel.h"
+
+//==============================================================================
+SampleQuery BrowserViewModel::QueryState::toQuery() const
+{
+    auto parsed = SampleQuery::parse (searchText);
+    parsed.anyOfTags = activeTags;
+    parsed.favoritesOnly = favoritesOnly;
+    parsed.hideDuplicates = hideDuplicates;
+    return parsed;
+}
+
+bool BrowserViewModel::QueryState::operator== (const QueryState& other) const
+{
+    return searchText == other.searchText
+        && activeTags == other.activeTags
+        && favoritesOnly == other.favoritesOnly
+        && hideDuplicates == other.hideDuplicates;
+}
+
+//==============================================================================
+BrowserViewModel::BrowserViewModel (SampleLibrary& lib)
+    : library (lib)
+{
+    library.addChangeListener (this);
+}
+
+BrowserViewModel::~BrowserViewModel()
+{
+    library.removeChangeListener (this);
+    cancelPendingUpdate();
+}
+
+BrowserViewModel::QueryState BrowserViewModel::getQuery() const
+{
+    const juce::ScopedLock sl (stateLock);
+    return query;
+}
+
+void BrowserViewModel::setQuery (const QueryState& newQuery)
+{
+    const juce::ScopedLock sl (stateLock);
+    query = newQuery;
+}
+
+int BrowserViewModel::getSortColumnId() const
+{
+    const juce::ScopedLock sl (stateLock);
+    return sortColumnId;
+}
+
+bool BrowserViewModel::isSortForward() const
+{
+    const juce::ScopedLock sl (stateLock);
+    return sortForward;
+}
+
+void BrowserViewModel::setSortOrder (int columnId, bool forward)
+{
+    const juce::ScopedLock sl (stateLock);
+    sortColumnId = columnId;
+    sortForward = forward;
+}
+
+int BrowserViewModel::getScrollPosition() const
+{
+    const juce::ScopedLock sl (stateLock);
+    return scrollPosition;
+}
+
+void BrowserViewModel::setScrollPosition (int position)
+{
+    const juce::ScopedLock sl (stateLock);
+    scrollPosition = position;
+}
+
+//==============================================================================
+std::shared_ptr<BrowserViewModel::Results> BrowserViewModel::getCurrentResults() const
+{
+    if (results == nullptr || ! resultsAreCurrent || results->query != getQuery())
+        return nullptr;
+
+    return results;
+}
+
+void BrowserViewModel::setResults (std::shared_ptr<Results> newResults)
+{
+    results = std::move (newResults);
+    resultsAreCurrent = true;
+}
+
+void BrowserViewModel::changeListenerCallback (juce::ChangeBroadcaster*)
+{
+    // An open editor re-runs its query and hands the new result over; a
+    // closed one will when it next opens
+    resultsAreCurrent = false;
+}
+
+//==============================================================================
+static constexpr int stateMagic = 0x53565853;   // "SXVS"
+static constexpr int stateVersion = 1;
+
+void BrowserViewModel::getState (juce::MemoryBlock& destData) const
+{
+    const juce::ScopedLock sl (stateLock);
+    juce::MemoryOutputStream out (destData, false);
+
+    out.writeInt (stateMagic);
+    out.writeInt (stateVersion);
+    out.writeString (query.searchText);
+    out.writeCompressedInt (query.activeTags.size());
+
+    for (auto& tag : query.activeTags)
+        out.writeString (tag);
+
+    out.writeBool (query.favoritesOnly);
+    out.writeBool (query.hideDuplicates);
+    out.writeCompressedInt (sortColumnId);
+    out.writeBool (sortForward);
+    out.writeCompressedInt (scrollPosition);
+}
+
+void BrowserViewModel::setState (const void* data, int sizeInBytes)
+{
+    juce::MemoryInputStream in (data, (size_t) juce::jmax (0, sizeInBytes), false);
+
+    if (in.readInt() != stateMagic || in.readInt() != stateVersion)
+        return;
+
+    QueryState restored;
+    restored.searchText = in.readString();
+
+    auto numTags = in.readCompressedInt();
+    for (int i = 0; i < numTags && ! in.isExhausted(); ++i)
+        restored.activeTags.add (in.readString());
+
+    restored.favoritesOnly = in.readBool();
+    restored.hideDuplicates = in.readBool();
+    auto restoredSortColumnId = in.readCompressedInt();
+    auto restoredSortForward = in.readBool();
+    auto restoredScrollPosition = in.readCompressedInt();
+
+    {
+        const juce::ScopedLock sl (stateLock);
+        query = restored;
+        sortColumnId = restoredSortColumnId;
+        sortForward = restoredSortForward;
+        scrollPosition = juce::jmax (0, restoredScrollPosition);
+    }
+
+    triggerAsyncUpdate();
+}
+
+void BrowserViewModel::handleAsyncUpdate()
+{
+    if (onStateRestored)
+        onStateRestored();
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <JuceHeader.h>
+#include "SampleLibrary.h"
+
+//==============================================================================
+// What the browser shows, owned by the processor so it outlives the editor.
+//
+// Hosts destroy the editor whenever the plugin window closes. With the query
+// and its last result kept here, a reopened editor shows the same rows in the
+// same order straight away: the file list adopts the stored result instead
+// of filtering, copying and sorting the library again, so reopening only
+// costs the visible rows. A result is dropped once the library changes.
+//
+// The query, sort order and scroll position are saved with the plugin state;
+// after a project loads, the result is rebuilt by running the query.
+//==============================================================================
+class BrowserViewModel : private juce::ChangeListener,
+                         private juce::AsyncUpdater
+{
+public:
+    struct QueryState
+    {
+        juce::String searchText;
+        juce::StringArray activeTags;
+        bool favoritesOnly = false;
+        bool hideDuplicates = false;
+
+        SampleQuery toQuery() const;
+
+        bool operator== (const QueryState& other) const;
+        bool operator!= (const QueryState& other) const  { return ! operator== (other); }
+    };
+
+    // A query's rows, in the file list's current display order
+    struct Results
+    {
+        QueryState query;                   // what produced them
+        juce::Array<SampleItem> items;
+        juce::Array<int> displayOrder;      // row -> index into items
+        SampleLibrary::TagCounts facetCounts;
+    };
+
+    explicit BrowserViewModel (SampleLibrary& library);
+    ~BrowserViewModel() override;
+
+    QueryState getQuery() const;
+    void setQuery (const QueryState& newQuery);
+
+    // A file list column id, 0 for relevance, or -1 until one is chosen
+    int getSortColumnId() const;
+    bool isSortForward() const;
+    void setSortOrder (int columnId, bool forward);
+
+    // Pixels from the top of the list
+    int getScrollPosition() const;
+    void setScrollPosition (int position);
+
+    // The last result, if it still matches the query and the library
+    std::shared_ptr<Results> getCurrentResults() const;
+    void setResults (std::shared_ptr<Results> newResults);
+
+    // Plugin state, callable from any thread. A restored state is announced
+    // on the message thread through onStateRestored.
+    void getState (juce::MemoryBlock& destData) const;
+    void setState (const void* data, int sizeInBytes);
+
+    std::function<void()> onStateRestored;
+
+private:
+    void changeListenerCallback (juce::ChangeBroadcaster*) override;
+    void handleAsyncUpdate() override;
+
+    SampleLibrary& library;
+
+    // Hosts may save or restore state from another thread
+    juce::CriticalSection stateLock;
+    QueryState query;
+    int sortColumnId = -1;
+    bool sortForward = true;
+    int scrollPosition = 0;
+
+    std::shared_ptr<Results> results;
+    bool resultsAreCurrent = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BrowserViewModel)
+};
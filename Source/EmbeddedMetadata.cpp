@@ -0,0 +1,460 @@
+#include "EmbeddedMetadata.h"
+#include "SampleQuery.h"
+
+//==============================================================================
+namespace
+{
+    // Chunks, tags and comment blocks larger than this are skipped rather
+    // than read (they're album art, not tempo)
+    constexpr int maxBlockSize = 256 * 1024;
+
+    bool isTempo (double bpm)  { return bpm >= 40.0 && bpm <= 300.0; }
+
+    bool hasId (const char* id, const char* expected)
+    {
+        return std::memcmp (id, expected, 4) == 0;
+    }
+
+    // What a container says, before deciding which source wins
+    struct Declared
+    {
+        EmbeddedMetadata acidOrApple;   // 'acid' or 'basc'
+        EmbeddedMetadata tags;          // ID3 or Vorbis comments
+        bool hasSampleLoops = false;    // 'smpl' with at least one loop
+    };
+
+    //==========================================================================
+    void setKeyFromText (EmbeddedMetadata& metadata, const juce::String& text)
+    {
+        int pitchClass = -1;
+        SampleQuery::KeyMode mode = SampleQuery::anyMode;
+
+        if (metadata.keyPitchClass >= 0 || ! SampleQuery::parseKey (text.trim(), pitchClass, mode))
+            return;
+
+        metadata.keyPitchClass = pitchClass;
+        metadata.keyScale = mode == SampleQuery::minorMode ? EmbeddedMetadata::minorScale
+                          : mode == SampleQuery::majorMode ? EmbeddedMetadata::majorScale
+                                                           : EmbeddedMetadata::unknownScale;
+    }
+
+    void setTempoFromText (EmbeddedMetadata& metadata, const juce::String& text)
+    {
+        auto bpm = text.trim().getDoubleValue();
+        if (metadata.bpm == 0.0 && isTempo (bpm))
+            metadata.bpm = bpm;
+    }
+
+    //==========================================================================
+    // Vorbis comment block, as found in FLAC and in Ogg Vorbis/Opus headers
+    void parseVorbisComments (const uint8_t* data, size_t size, EmbeddedMetadata& metadata)
+    {
+        size_t position = 0;
+
+        auto readLength = [&] () -> juce::int64
+        {
+            if (position + 4 > size)
+                return -1;
+
+            auto value = juce::ByteOrder::littleEndianInt (data + position);
+            position += 4;
+            return (juce::int64) value;
+        };
+
+        auto vendorLength = readLength();
+        if (vendorLength < 0 || position + (size_t) vendorLength > size)
+            return;
+
+        position += (size_t) vendorLength;
+
+        auto numComments = readLength();
+
+        for (juce::int64 i = 0; i < numComments; ++i)
+        {
+            auto length = readLength();
+            if (length < 0 || position + (size_t) length > size)
+                return;
+
+            auto comment = juce::String::fromUTF8 ((const char*) data + position, (int) length);
+            position += (size_t) length;
+
+            auto field = comment.upToFirstOccurrenceOf ("=", false, false).toUpperCase();
+            auto value = comment.fromFirstOccurrenceOf ("=", false, false);
+
+            if (field == "BPM" || field == "TEMPO" || field == "TBPM")
+                setTempoFromText (metadata, value);
+            else if (field == "KEY" || field == "INITIALKEY" || field == "TKEY")
+                setKeyFromText (metadata, value);
+        }
+    }
+
+    //==========================================================================
+    juce::String decodeId3Text (const uint8_t* data, int size)
+    {
+        if (size < 1)
+            return {};
+
+        auto encoding = data[0];
+        auto* text = data + 1;
+        auto length = size - 1;
+
+        if (encoding == 1)  // UTF-16 with byte order mark
+            return juce::String::createStringFromData (text, length);
+
+        if (encoding == 2)  // UTF-16BE without one
+        {
+            juce::MemoryBlock withMark ("\xfe\xff", 2);
+            withMark.append (text, (size_t) length);
+            return juce::String::createStringFromData (withMark.getData(), (int) withMark.getSize());
+        }
+
+        // ISO-8859-1 or UTF-8; the values we read are ASCII either way
+        return juce::String::fromUTF8 ((const char*) text, length);
+    }
+
+    // ID3v2 tag starting at the stream's current position
+    void readId3Tag (juce::InputStream& in, EmbeddedMetadata& metadata)
+    {
+        uint8_t header[10];
+        if (in.read (header, 10) != 10 || std::memcmp (header, "ID3", 3) != 0)
+            return;
+
+        auto version = header[3];
+        auto flags = header[5];
+        auto readSyncSafe = [] (const uint8_t* b) { return (b[0] << 21) | (b[1] << 14) | (b[2] << 7) | b[3]; };
+
+        auto tagSize = readSyncSafe (header + 6);
+        auto tagEnd = in.getPosition() + tagSize;
+
+        if (version < 2 || version > 4)
+            return;
+
+        // Extended header
+        if ((flags & 0x40) != 0 && version >= 3)
+        {
+            uint8_t sizeBytes[4];
+            if (in.read (sizeBytes, 4) != 4)
+                return;
+
+            auto extendedSize = version == 4 ? readSyncSafe (sizeBytes) - 4
+                                             : (int) juce::ByteOrder::bigEndianInt (sizeBytes);
+            in.skipNextBytes (extendedSize);
+        }
+
+        auto idLength = version == 2 ? 3 : 4;
+        auto headerLength = version == 2 ? 6 : 10;
+
+        while (in.getPosition() + headerLength <= tagEnd)
+        {
+            uint8_t frameHeader[10];
+            if (in.read (frameHeader, headerLength) != headerLength || frameHeader[0] == 0)
+                return;  // padding
+
+            int frameSize = version == 2 ? (frameHeader[3] << 16) | (frameHeader[4] << 8) | frameHeader[5]
+                          : version == 4 ? readSyncSafe (frameHeader + 4)
+                                         : (int) juce::ByteOrder::bigEndianInt (frameHeader + 4);
+
+            if (frameSize < 0 || in.getPosition() + frameSize > tagEnd)
+                return;
+
+            juce::String id ((const char*) frameHeader, (size_t) idLength);
+            bool isTempoFrame = id == "TBPM" || id == "TBP";
+            bool isKeyFrame = id == "TKEY" || id == "TKE";
+
+            if ((isTempoFrame || isKeyFrame) && frameSize <= 256)
+            {
+                uint8_t frame[256];
+                if (in.read (frame, frameSize) != frameSize)
+                    return;
+
+                auto text = decodeId3Text (frame, frameSize);
+
+                if (isTempoFrame)
+                    setTempoFromText (metadata, text);
+                else
+                    setKeyFromText (metadata, text);
+            }
+            else
+            {
+                in.setPosition (in.getPosition() + frameSize);
+            }
+        }
+    }
+
+    //==========================================================================
+    void readRiffChunks (juce::InputStream& in, Declared& declared)
+    {
+        char form[4];
+        in.readInt();  // RIFF size
+        if (in.read (form, 4) != 4 || ! hasId (form, "WAVE"))
+            return;
+
+        auto totalLength = in.getTotalLength();
+
+        while (in.getPosition() + 8 <= totalLength)
+        {
+            char id[4];
+            in.read (id, 4);
+            auto size = (juce::int64) (uint32_t) in.readInt();
+            auto chunkStart = in.getPosition();
+
+            if (hasId (id, "acid") && size >= 24)
+            {
+                auto flags = in.readInt();
+                auto rootNote = in.readShort();
+                in.readShort();
+                in.readFloat();
+                auto numBeats = in.readInt();
+                in.readShort();  // meter denominator
+                in.readShort();  // meter numerator
+                auto tempo = (double) in.readFloat();
+
+                auto& acid = declared.acidOrApple;
+                bool isOneShot = (flags & 0x01) != 0;
+                acid.typeHint = isOneShot ? FilenameHints::oneShotHint : FilenameHints::loopHint;
+
+                if ((flags & 0x02) != 0 && rootNote >= 0)
+                    acid.keyPitchClass = rootNote % 12;
+
+                if (! isOneShot)
+                {
+                    acid.numBeats = juce::jmax (0, numBeats);
+                    if (isTempo (tempo))
+                        acid.bpm = tempo;
+                }
+            }
+            else if (hasId (id, "smpl") && size >= 36)
+            {
+                in.skipNextBytes (28);
+                declared.hasSampleLoops = in.readInt() > 0;
+            }
+            else if ((hasId (id, "id3 ") || hasId (id, "ID3 ")) && size <= maxBlockSize)
+            {
+                readId3Tag (in, declared.tags);
+            }
+            else if (hasId (id, "data") && size == 0xffffffff)
+            {
+                break;  // RF64 keeps the real size elsewhere; nothing we need follows
+            }
+
+            in.setPosition (chunkStart + size + (size & 1));
+        }
+    }
+
+    void readAiffChunks (juce::InputStream& in, Declared& declared)
+    {
+        char form[4];
+        in.readIntBigEndian();  // FORM size
+        if (in.read (form, 4) != 4 || ! (hasId (form, "AIFF") || hasId (form, "AIFC")))
+            return;
+
+        auto totalLength = in.getTotalLength();
+
+        while (in.getPosition() + 8 <= totalLength)
+        {
+            char id[4];
+            in.read (id, 4);
+            auto size = (juce::int64) (uint32_t) in.readIntBigEndian();
+            auto chunkStart = in.getPosition();
+
+            if (hasId (id, "basc") && size >= 18)
+            {
+                // Apple Loops: scale 1 = minor, 2 = major; loop type 2 = one-shot
+                in.readIntBigEndian();  // version
+                auto numBeats = in.readIntBigEndian();
+                auto rootNote = (int) (uint16_t) in.readShortBigEndian();
+                auto scale = in.readShortBigEndian();
+                in.readShortBigEndian();  // time signature numerator
+                in.readShortBigEndian();  // time signature denominator
+                auto loopType = in.readShortBigEndian();
+
+                auto& apple = declared.acidOrApple;
+                bool isOneShot = loopType == 2;
+                apple.typeHint = isOneShot ? FilenameHints::oneShotHint : FilenameHints::loopHint;
+
+                if (! isOneShot)
+                    apple.numBeats = juce::jmax (0, numBeats);
+
+                if (rootNote != 0)
+                {
+                    apple.keyPitchClass = rootNote % 12;
+                    apple.keyScale = scale == 1 ? EmbeddedMetadata::minorScale
+                                   : scale == 2 ? EmbeddedMetadata::majorScale
+                                                : EmbeddedMetadata::unknownScale;
+                }
+            }
+            else if (hasId (id, "ID3 ") && size <= maxBlockSize)
+            {
+                readId3Tag (in, declared.tags);
+            }
+
+            in.setPosition (chunkStart + size + (size & 1));
+        }
+    }
+
+    void readFlacBlocks (juce::InputStream& in, Declared& declared)
+    {
+        for (;;)
+        {
+            uint8_t header[4];
+            if (in.read (header, 4) != 4)
+                return;
+
+            bool isLast = (header[0] & 0x80) != 0;
+            auto type = header[0] & 0x7f;
+            auto size = (header[1] << 16) | (header[2] << 8) | header[3];
+            auto blockStart = in.getPosition();
+
+            if (type == 4 && size <= maxBlockSize)  // VORBIS_COMMENT
+            {
+                juce::MemoryBlock block;
+                if (in.readIntoMemoryBlock (block, size) != (size_t) size)
+                    return;
+
+                parseVorbisComments ((const uint8_t*) block.getData(), block.getSize(), declared.tags);
+                return;
+            }
+
+            if (isLast || type == 127)
+                return;
+
+            in.setPosition (blockStart + size);
+        }
+    }
+
+    void readOggComments (juce::InputStream& in, juce::int64 start, Declared& declared)
+    {
+        // The comment header is the second packet of the stream. Pages are
+        // reassembled until it's complete.
+        in.setPosition (start);
+
+        juce::MemoryBlock packet;
+        int packetIndex = 0;
+
+        while (packetIndex < 2)
+        {
+            uint8_t pageHeader[27];
+            if (in.read (pageHeader, 27) != 27 || std::memcmp (pageHeader, "OggS", 4) != 0)
+                return;
+
+            uint8_t lacing[255];
+            auto numSegments = (int) pageHeader[26];
+            if (in.read (lacing, numSegments) != numSegments)
+                return;
+
+            for (int i = 0; i < numSegments && packetIndex < 2; ++i)
+            {
+                auto segmentSize = (int) lacing[i];
+
+                if (packetIndex == 1)
+                {
+                    if (packet.getSize() + (size_t) segmentSize > (size_t) maxBlockSize
+                         || in.readIntoMemoryBlock (packet, segmentSize) != (size_t) segmentSize)
+                        return;
+                }
+                else
+                {
+                    in.skipNextBytes (segmentSize);
+                }
+
+                if (segmentSize < 255)
+                    ++packetIndex;
+            }
+        }
+
+        auto* data = (const uint8_t*) packet.getData();
+        auto size = packet.getSize();
+
+        if (size > 7 && std::memcmp (data, "\x03vorbis", 7) == 0)
+            parseVorbisComments (data + 7, size - 7, declared.tags);
+        else if (size > 8 && std::memcmp (data, "OpusTags", 8) == 0)
+            parseVorbisComments (data + 8, size - 8, declared.tags);
+    }
+}
+
+//==============================================================================
+EmbeddedMetadata EmbeddedMetadata::read (juce::InputStream& in)
+{
+    auto start = in.getPosition();
+
+    Declared declared;
+    char magic[4] = {};
+
+    if (in.read (magic, 4) == 4)
+    {
+        if (hasId (magic, "RIFF") || hasId (magic, "RF64"))
+            readRiffChunks (in, declared);
+        else if (hasId (magic, "FORM"))
+            readAiffChunks (in, declared);
+        else if (hasId (magic, "fLaC"))
+            readFlacBlocks (in, declared);
+        else if (hasId (magic, "OggS"))
+            readOggComments (in, start, declared);
+        else if (std::memcmp (magic, "ID3", 3) == 0)
+        {
+            in.setPosition (start);
+            readId3Tag (in, declared.tags);
+        }
+    }
+
+    in.setPosition (start);
+
+    // ACID and Apple Loops data is written by the tools that build loop
+    // libraries, so it beats free-form tags where both exist
+    auto result = declared.acidOrApple;
+    auto& tags = declared.tags;
+
+    if (result.bpm == 0.0)
+        result.bpm = tags.bpm;
+
+    if (result.keyPitchClass < 0)
+    {
+        result.keyPitchClass = tags.keyPitchClass;
+        result.keyScale = tags.keyScale;
+    }
+    else if (result.keyScale == unknownScale && tags.keyPitchClass == result.keyPitchClass)
+    {
+        result.keyScale = tags.keyScale;
+    }
+
+    if (result.typeHint == FilenameHints::noTypeHint && declared.hasSampleLoops)
+        result.typeHint = FilenameHints::loopHint;
+
+    return result;
+}
+
+void EmbeddedMetadata::applyTo (FilenameHints& hints, double lengthSeconds) const
+{
+    if (typeHint != FilenameHints::noTypeHint)
+        hints.typeHint = typeHint;
+
+    if (bpm > 0.0)
+    {
+        hints.bpm = bpm;
+    }
+    else if (numBeats > 0 && lengthSeconds > 0.0)
+    {
+        auto derived = std::round (numBeats * 60.0 / lengthSeconds * 100.0) / 100.0;
+        if (isTempo (derived))
+            hints.bpm = derived;
+    }
+
+    if (keyPitchClass >= 0)
+    {
+        // A bare root note keeps the name's mode if the name agrees on the root
+        auto nameAgrees = hints.keyPitchClass == keyPitchClass;
+
+        hints.keyPitchClass = keyPitchClass;
+        hints.keyIsFlat = nameAgrees && hints.keyIsFlat;
+
+        if (keyScale != unknownScale)
+        {
+            hints.isMinor = keyScale == minorScale;
+            hints.isModeKnown = true;
+        }
+        else if (! nameAgrees)
+        {
+            hints.isModeKnown = false;
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <JuceHeader.h>
+#include "FilenameHints.h"
+
+//==============================================================================
+// Tempo, key and loop information declared inside an audio file.
+//
+// read() understands:
+//   WAV    'acid' (tempo, beats, root note, one-shot flag) and 'smpl' loops,
+//          plus an embedded 'id3 ' chunk
+//   AIFF   Apple Loops 'basc' (beats, root note, scale, one-shot flag) and
+//          an embedded 'ID3 ' chunk
+//   MP3    ID3v2 TBPM and TKEY frames
+//   FLAC   Vorbis comments (BPM/TEMPO, KEY/INITIALKEY)
+//   Ogg    Vorbis and Opus comments
+//
+// It only reads the small chunks it cares about and seeks past audio, so it
+// can run on the same stream that the format reader is created from.
+//==============================================================================
+struct EmbeddedMetadata
+{
+    enum KeyScale { unknownScale, majorScale, minorScale };
+
+    double bpm = 0.0;               // 0 if not declared
+    int numBeats = 0;               // loop length in beats, 0 if not declared
+    int keyPitchClass = -1;         // 0 = C ... 11 = B, -1 if not declared
+    KeyScale keyScale = unknownScale;
+    FilenameHints::TypeHint typeHint = FilenameHints::noTypeHint;
+
+    // Parses whatever the stream holds, then puts it back where it started
+    static EmbeddedMetadata read (juce::InputStream& stream);
+
+    // Overrides the guesses from a file name with anything declared here.
+    // lengthSeconds is used to derive a tempo from a beat count.
+    void applyTo (FilenameHints& hints, double lengthSeconds) const;
+};
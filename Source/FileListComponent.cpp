@@ -1,5 +1,7 @@
 #include "FileListComponent.h"
 #include "LookAndFeel.h"
+#include "PerformanceCounters.h"
+#include "TraceRecorder.h"
 
 //==============================================================================
 SampleFileListComponent::SampleFileListComponent (SampleLibrary& lib)
@@ -36,20 +38,35 @@ void SampleFileListComponent::paint (juce::Graphics& g)
     g.fillAll (juce::Colour (SoundXplorerLookAndFeel::bgDark));
 }
 
+void SampleFileListComponent::paintOverChildren (juce::Graphics&)
+{
+    // Runs after the table's rows in the same paint pass, so whatever
+    // paintCell accumulated belongs to this frame
+    if (paintCellTicks > 0)
+    {
+        PerformanceCounters::getInstance().paintCellFrameTime.record (juce::Time::highResolutionTicksToSeconds (paintCellTicks) * 1000.0);
+        paintCellTicks = 0;
+    }
+}
+
 void SampleFileListComponent::resized()
 {
     auto bounds = getLocalBounds();
     fileCountLabel.setBounds (bounds.removeFromTop (20).reduced (8, 0));
     table.setBounds (bounds);
+    applyPendingScroll();
 }
 
-void SampleFileListComponent::updateContent (const juce::Array<SampleItem>& items)
+void SampleFileListComponent::showResults (std::shared_ptr<BrowserViewModel::Results> newResults)
 {
-    displayedItems = items;
-    sortData();
+    results = std::move (newResults);
+
+    auto isNew = results->displayOrder.size() != results->items.size();
+    if (isNew)
+        sortData();
     
     // Update file count
-    auto count = displayedItems.size();
+    auto count = results->items.size();
     juce::String countText;
     if (count >= 1000)
         countText = juce::String (count / 1000.0, 1) + "k files shown";
@@ -60,12 +77,75 @@ void SampleFileListComponent::updateContent (const juce::Array<SampleItem>& item
     
     table.updateContent();
     table.repaint();
+
+    if (isNew)
+        prioritiseResults();
+
+    prioritiseVisibleRows();
+    applyPendingScroll();
+}
+
+void SampleFileListComponent::setScrollPosition (int position)
+{
+    pendingScrollPosition = juce::jmax (0, position);
+    applyPendingScroll();
+}
+
+void SampleFileListComponent::applyPendingScroll()
+{
+    auto* viewport = table.getViewport();
+    if (pendingScrollPosition < 0 || viewport == nullptr || table.getHeight() == 0 || results->items.isEmpty())
+        return;
+
+    auto position = pendingScrollPosition;
+    pendingScrollPosition = -1;
+    viewport->setViewPosition (viewport->getViewPositionX(), position);
+}
+
+void SampleFileListComponent::listWasScrolled()
+{
+    prioritiseVisibleRows();
+
+    // Until a restored position is applied, scrolling is only the layout settling
+    if (auto* viewport = table.getViewport(); viewport != nullptr && onScrolled && pendingScrollPosition < 0)
+        onScrolled (viewport->getViewPositionY());
+}
+
+void SampleFileListComponent::prioritiseVisibleRows()
+{
+    auto* viewport = table.getViewport();
+    if (viewport == nullptr)
+        return;
+
+    auto rowHeight = juce::jmax (1, table.getRowHeight());
+    auto firstRow = viewport->getViewPositionY() / rowHeight;
+    auto lastRow = juce::jmin (results->items.size(), firstRow + viewport->getViewHeight() / rowHeight + 2);
+
+    juce::Array<juce::File> files;
+    for (int row = firstRow; row < lastRow; ++row)
+        if (! getDisplayedItem (row).isAnalysed)
+            files.add (getDisplayedItem (row).file);
+
+    library.prioritiseAnalysis (files, AnalysisQueue::visibleRows);
+}
+
+void SampleFileListComponent::prioritiseResults()
+{
+    // Enough to scroll through for a while; the backlog covers the rest
+    constexpr int maxPrioritisedRows = 2000;
+
+    juce::Array<juce::File> files;
+    for (int row = 0; row < results->items.size() && files.size() < maxPrioritisedRows; ++row)
+        if (! getDisplayedItem (row).isAnalysed)
+            files.add (getDisplayedItem (row).file);
+
+    library.prioritiseAnalysis (files, AnalysisQueue::queryResults);
 }
 
 //==============================================================================
 int SampleFileListComponent::getNumRows()
 {
-    return displayedItems.size();
+    return results->items.size();
 }
 
 void SampleFileListComponent::paintRowBackground (juce::Graphics& g, int rowNumber, int width, int height, bool rowIsSelected)
@@ -84,10 +164,12 @@ void SampleFileListComponent::paintRowBackground (juce::Graphics& g, int rowNumb
 
 void SampleFileListComponent::paintCell (juce::Graphics& g, int rowNumber, int columnId, int width, int height, bool /*rowIsSelected*/)
 {
-    if (rowNumber >= displayedItems.size())
+    if (rowNumber >= results->items.size())
         return;
     
-    auto& item = displayedItems.getReference (rowNumber);
+    const TraceScope traceScope ("paintCell");
+    auto startTicks = juce::Time::getHighResolutionTicks();
+    auto& item = getDisplayedItem (rowNumber);
     g.setFont (SoundXplorerLookAndFeel::getDefaultFont (13.0f));
     
     switch (columnId)
@@ -119,7 +201,9 @@ void SampleFileListComponent::paintCell (juce::Graphics& g, int rowNumber, int c
         }
         case BpmColumn:
         {
-            g.setColour (juce::Colour (SoundXplorerLookAndFeel::textPrimary));
+            // Dimmed while it's only a guess from the name
+            g.setColour (juce::Colour (item.isAnalysed ? SoundXplorerLookAndFeel::textPrimary
+                                                       : SoundXplorerLookAndFeel::textTertiary));
             g.setFont (SoundXplorerLookAndFeel::getBookFont (12.0f));
             if (item.bpm > 0.0)
                 g.drawText (juce::String ((int) item.bpm), 0, 0, width, height, juce::Justification::centred);
@@ -129,7 +213,8 @@ void SampleFileListComponent::paintCell (juce::Graphics& g, int rowNumber, int c
         }
         case KeyColumn:
         {
-            g.setColour (juce::Colour (SoundXplorerLookAndFeel::textPrimary));
+            g.setColour (juce::Colour (item.isAnalysed ? SoundXplorerLookAndFeel::textPrimary
+                                                       : SoundXplorerLookAndFeel::textTertiary));
             g.setFont (SoundXplorerLookAndFeel::getBookFont (12.0f));
             if (item.key.isNotEmpty())
                 g.drawText (item.key, 0, 0, width, height, juce::Justification::centred);
@@ -150,6 +235,9 @@ void SampleFileListComponent::paintCell (juce::Graphics& g, int rowNumber, int c
             break;
         }
     }
+
+    paintCellTicks += juce::Time::getHighResolutionTicks() - startTicks;
+    ++PerformanceCounters::getInstance().paintCellCalls;
 }
 
 void SampleFileListComponent::drawTag (juce::Graphics& g, const juce::String& tag, juce::Rectangle<int>& area, juce::Colour colour)
@@ -175,58 +263,160 @@ void SampleFileListComponent::drawTag (juce::Graphics& g, const juce::String& ta
     g.drawText (tag, tagBounds, juce::Justification::centred);
 }
 
-void SampleFileListComponent::cellClicked (int rowNumber, int columnId, const juce::MouseEvent&)
+void SampleFileListComponent::cellClicked (int rowNumber, int columnId, const juce::MouseEvent& e)
 {
-    if (rowNumber >= displayedItems.size())
+    if (rowNumber >= results->items.size())
         return;
     
+    if (e.mods.isPopupMenu())
+    {
+        showRowMenu (getDisplayedItem (rowNumber));
+        return;
+    }
+
     if (columnId == FavoriteColumn)
     {
-        auto& item = displayedItems.getReference (rowNumber);
+        auto& item = getDisplayedItem (rowNumber);
         if (onFavoriteToggled)
             onFavoriteToggled (item.file);
     }
     else
     {
         if (onSampleSelected)
-            onSampleSelected (displayedItems[rowNumber]);
+            onSampleSelected (getDisplayedItem (rowNumber));
     }
 }
 
+void SampleFileListComponent::showRowMenu (const SampleItem& item)
+{
+    juce::PopupMenu menu;
+    menu.addItem ("Find Similar Sounds", [this, item]
+    {
+        if (onFindSimilar)
+            onFindSimilar (item);
+    });
+
+    menu.addItem ("Show Duplicates", item.duplicateGroup >= 0, false, [this, item]
+    {
+        if (onShowDuplicates)
+            onShowDuplicates (item);
+    });
+
+    menu.addSeparator();
+    menu.addItem ("Hide Duplicates", true, hideDuplicates, [this]
+    {
+        if (onHideDuplicatesChanged)
+            onHideDuplicatesChanged (! hideDuplicates);
+    });
+
+    menu.addSeparator();
+    menu.addItem ("Export Sample...", [this, item]
+    {
+        if (onExport)
+            onExport ({ item.file });
+    });
+
+    menu.addItem ("Export All " + juce::String (results->items.size()) + " Results...", [this]
+    {
+        // In the order they are shown
+        juce::Array<juce::File> files;
+        for (int row = 0; row < results->items.size(); ++row)
+            files.add (getDisplayedItem (row).file);
+
+        if (onExport)
+            onExport (files);
+    });
+
+    menu.showMenuAsync (juce::PopupMenu::Options());
+}
+
 void SampleFileListComponent::cellDoubleClicked (int rowNumber, int /*columnId*/, const juce::MouseEvent&)
 {
-    if (rowNumber < displayedItems.size() && onSampleDoubleClicked)
-        onSampleDoubleClicked (displayedItems[rowNumber]);
+    if (rowNumber < results->items.size() && onSampleDoubleClicked)
+        onSampleDoubleClicked (getDisplayedItem (rowNumber));
 }
 
 void SampleFileListComponent::sortOrderChanged (int newSortColumnId, bool isForwards)
 {
+    // The header reports orders set by setSortOrder() too, which the rows
+    // are already in
+    if (newSortColumnId == currentSortColumn && isForwards == sortForward)
+        return;
+
+    // Flipping direction on the same column only needs the order reversed
+    bool directionOnly = (newSortColumnId == currentSortColumn && isForwards != sortForward);
+
     currentSortColumn = newSortColumnId;
     sortForward = isForwards;
-    sortData();
+
+    if (directionOnly)
+        std::reverse (results->displayOrder.begin(), results->displayOrder.end());
+    else
+        sortData();
+
     table.updateContent();
     table.repaint();
+
+    prioritiseResults();
+    prioritiseVisibleRows();
+
+    if (onSortOrderChanged)
+        onSortOrderChanged (currentSortColumn, sortForward);
+}
+
+void SampleFileListComponent::setSortOrder (int columnId, bool forward)
+{
+    currentSortColumn = columnId;
+    sortForward = forward;
+    table.getHeader().setSortColumnId (columnId, forward);
+}
+
+void SampleFileListComponent::setSortByRelevance (bool shouldSortByRelevance)
+{
+    auto& header = table.getHeader();
+
+    if (shouldSortByRelevance)
+        header.setSortColumnId (0, true);
+    else if (header.getSortColumnId() == 0)
+        header.setSortColumnId (NameColumn, true);
 }
 
 void SampleFileListComponent::sortData()
 {
-    auto col = currentSortColumn;
-    auto forward = sortForward;
-    
-    std::sort (displayedItems.begin(), displayedItems.end(),
-               [col, forward] (const SampleItem& a, const SampleItem& b)
+    const TraceScope traceScope ("sortData");
+
+    auto numItems = results->items.size();
+
+    // No sort column: keep the (relevance) order the items came in
+    if (currentSortColumn == 0)
     {
-        int result = 0;
-        switch (col)
-        {
-            case NameColumn: result = a.name.compareIgnoreCase (b.name); break;
-            case TypeColumn: result = a.type.compareIgnoreCase (b.type); break;
-            case BpmColumn:  result = (a.bpm < b.bpm) ? -1 : (a.bpm > b.bpm) ? 1 : 0; break;
-            case KeyColumn:  result = a.key.compareIgnoreCase (b.key); break;
-            default: result = a.name.compareIgnoreCase (b.name); break;
-        }
-        return forward ? result < 0 : result > 0;
-    });
+        results->displayOrder.clearQuick();
+        for (int i = 0; i < numItems; ++i)
+            results->displayOrder.add (i);
+
+        return;
+    }
+
+    // The library keeps a precomputed rank per sort column, so sorting
+    // compares small integers rather than strings
+    SampleSortColumn rankColumn = sortByName;
+    switch (currentSortColumn)
+    {
+        case TypeColumn: rankColumn = sortByType; break;
+        case BpmColumn:  rankColumn = sortByBpm;  break;
+        case KeyColumn:  rankColumn = sortByKey;  break;
+        default:         rankColumn = sortByName; break;
+    }
+
+    SampleLibrary::sortByRank (results->items, rankColumn, results->displayOrder);
+
+    if (! sortForward)
+        std::reverse (results->displayOrder.begin(), results->displayOrder.end());
+}
+
+const SampleItem& SampleFileListComponent::getDisplayedItem (int rowNumber) const
+{
+    return results->items.getReference (results->displayOrder[rowNumber]);
 }
 
 juce::Component* SampleFileListComponent::refreshComponentForCell (int /*rowNumber*/, int /*columnId*/, bool /*isRowSelected*/, juce::Component* existingComponentToUpdate)
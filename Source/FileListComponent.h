@@ -1,6 +1,7 @@
 #pragma once
 #include <JuceHeader.h>
 #include "SampleLibrary.h"
+#include "BrowserViewModel.h"
 
 //==============================================================================
 // Main file list table showing sample files with columns
@@ -13,10 +14,27 @@ public:
     ~SampleFileListComponent() override = default;
 
     void paint (juce::Graphics& g) override;
+    void paintOverChildren (juce::Graphics& g) override;
     void resized() override;
 
-    // Update displayed content
-    void updateContent (const juce::Array<SampleItem>& items);
+    // Shows a query result. A new one is sorted into the current order; one
+    // that has been shown before is already in it, so adopting it again only
+    // costs the visible rows.
+    void showResults (std::shared_ptr<BrowserViewModel::Results> newResults);
+    std::shared_ptr<BrowserViewModel::Results> getResults() const { return results; }
+
+    // Restores a sort order without sorting the current rows again
+    void setSortOrder (int columnId, bool forward);
+
+    // Restores a scroll position once there are rows to scroll through
+    void setScrollPosition (int position);
+
+    // Relevance shows rows in the order they were given (ranked search
+    // results) and clears the header's sort column
+    void setSortByRelevance (bool shouldSortByRelevance);
+
+    // Reflected as a ticked item in the row menu
+    void setHideDuplicates (bool shouldHide) { hideDuplicates = shouldHide; }
 
     // TableListBoxModel
     int getNumRows() override;
@@ -25,12 +43,19 @@ public:
     void cellClicked (int rowNumber, int columnId, const juce::MouseEvent& e) override;
     void cellDoubleClicked (int rowNumber, int columnId, const juce::MouseEvent& e) override;
     void sortOrderChanged (int newSortColumnId, bool isForwards) override;
+    void listWasScrolled() override;
     juce::Component* refreshComponentForCell (int rowNumber, int columnId, bool isRowSelected, juce::Component* existingComponentToUpdate) override;
 
     // Callbacks
     std::function<void (const SampleItem&)> onSampleSelected;
     std::function<void (const SampleItem&)> onSampleDoubleClicked;
     std::function<void (const juce::File&)> onFavoriteToggled;
+    std::function<void (const SampleItem&)> onFindSimilar;
+    std::function<void (const SampleItem&)> onShowDuplicates;
+    std::function<void (bool)> onHideDuplicatesChanged;
+    std::function<void (const juce::Array<juce::File>&)> onExport;
+    std::function<void (int columnId, bool forward)> onSortOrderChanged;
+    std::function<void (int position)> onScrolled;
 
     // Column IDs
     enum ColumnIds
@@ -45,15 +70,28 @@ public:
 
 private:
     void drawTag (juce::Graphics& g, const juce::String& tag, juce::Rectangle<int>& area, juce::Colour colour);
+    void showRowMenu (const SampleItem& item);
     void sortData();
 
+    // Moves unanalysed rows ahead in the library's analysis queue: those on
+    // screen, and the first part of the whole result
+    void prioritiseVisibleRows();
+    void prioritiseResults();
+    void applyPendingScroll();
+    const SampleItem& getDisplayedItem (int rowNumber) const;
+
     SampleLibrary& library;
     juce::TableListBox table;
-    juce::Array<SampleItem> displayedItems;
+    std::shared_ptr<BrowserViewModel::Results> results { std::make_shared<BrowserViewModel::Results>() };
     juce::Label fileCountLabel;
 
     int currentSortColumn = NameColumn;
     bool sortForward = true;
+    bool hideDuplicates = false;
+    int pendingScrollPosition = -1;
+
+    // Time spent in paintCell since the last paintOverChildren, for the HUD
+    juce::int64 paintCellTicks = 0;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleFileListComponent)
 };
@@ -0,0 +1,185 @@
+#include "FileProber.h"
+#include "TraceRecorder.h"
+
+//==============================================================================
+// Takes over a reader and calls back before each read it passes on to it
+class ProgressReportingReader : public juce::AudioSubsectionReader
+{
+public:
+    ProgressReportingReader (juce::AudioFormatReader* sourceToOwn, const std::function<void()>& callback)
+        : juce::AudioSubsectionReader (sourceToOwn, 0, sourceToOwn->lengthInSamples, true),
+          onProgress (callback)
+    {
+    }
+
+    bool readSamples (int* const* destSamples, int numDestChannels, int startOffsetInDestBuffer,
+                      juce::int64 startSampleInFile, int numSamples) override
+    {
+        onProgress();
+        return juce::AudioSubsectionReader::readSamples (destSamples, numDestChannels, startOffsetInDestBuffer,
+                                                         startSampleInFile, numSamples);
+    }
+
+private:
+    const std::function<void()>& onProgress;
+};
+
+//==============================================================================
+void FileProber::probe (const Request& request, Result& result)
+{
+    const TraceScope traceScope ("probeFile");
+
+    auto& file = request.file;
+
+    // One open serves the tag probe, the format reader and the analyzers
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    EmbeddedMetadata embedded;
+
+    if (auto stream = file.createInputStream())
+    {
+        if (request.needsMetadata)
+            embedded = EmbeddedMetadata::read (*stream);
+
+        reader = formats->createReaderFor (file, std::move (stream));
+    }
+
+    if (reader != nullptr && onProgress != nullptr)
+        reader = std::make_unique<ProgressReportingReader> (reader.release(), onProgress);
+
+    if (request.needsMetadata)
+    {
+        auto& metadata = result.metadata;
+        metadata = {};
+        metadata.modificationTime = request.modificationTime;
+        metadata.fileSize = file.getSize();
+        metadata.embedded = embedded;
+
+        if (reader != nullptr)
+        {
+            metadata.lengthInSamples = reader->lengthInSamples;
+            metadata.sampleRate = reader->sampleRate;
+            metadata.numChannels = (int) reader->numChannels;
+
+            // The onset threshold is relative to the peak the loudness pass found
+            if (loudness.analyze (*reader, metadata.loudness))
+                metadata.onsetSample = onsets.findFirstOnset (*reader, metadata.loudness.truePeakDb);
+        }
+    }
+
+    if (reader != nullptr && request.needsEmbedding)
+    {
+        TimbreAnalyzer::Embedding embedding;
+
+        if (timbre.analyze (*reader, embedding))
+            result.embedding = embedding;
+    }
+
+    // Last, as the only pass that decodes the whole file; a decoder that
+    // fails on its later frames does so in here, in the worker
+    if (request.needsHash)
+        result.metadata.pcmHash = reader != nullptr ? hashAudio (*reader) : CachedMetadata::pcmHashFailed;
+
+    result.completed = true;
+}
+
+uint64_t FileProber::hashAudio (juce::AudioFormatReader& reader)
+{
+    constexpr int blockSize = 32768;
+    auto numChannels = (int) reader.numChannels;
+
+    if (numChannels <= 0)
+        return CachedMetadata::pcmHashFailed;
+
+    hashBuffer.resize ((size_t) (blockSize * numChannels));
+
+    juce::HeapBlock<int*> channels ((size_t) numChannels);
+    for (int ch = 0; ch < numChannels; ++ch)
+        channels[ch] = hashBuffer.data() + ch * blockSize;
+
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ (uint64_t) reader.lengthInSamples;
+
+    for (juce::int64 position = 0; position < reader.lengthInSamples; position += blockSize)
+    {
+        auto numSamples = (int) juce::jmin ((juce::int64) blockSize, reader.lengthInSamples - position);
+
+        if (! reader.read (channels.get(), numChannels, position, numSamples, false))
+            return CachedMetadata::pcmHashFailed;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* data = channels[ch];
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                hash = (hash ^ (uint32_t) data[i]) * 0x100000001b3ull;
+                hash ^= hash >> 29;
+            }
+        }
+    }
+
+    // 0 and pcmHashFailed are reserved
+    return hash != 0 && hash != CachedMetadata::pcmHashFailed ? hash : 1;
+}
+
+FileProber::Result FileProber::makeQuarantined (const Request& request)
+{
+    // A sample rate of 0 is how the cache marks files no format could read
+    Result result;
+    result.metadata.modificationTime = request.modificationTime;
+    result.metadata.fileSize = request.file.getSize();
+    result.metadata.pcmHash = CachedMetadata::pcmHashFailed;
+    result.completed = true;
+    result.quarantined = true;
+    return result;
+}
+
+//==============================================================================
+void FileProber::writeRequest (juce::OutputStream& out, const Request& request)
+{
+    out.writeString (request.file.getFullPathName());
+    out.writeInt64 (request.modificationTime);
+    out.writeBool (request.needsMetadata);
+    out.writeBool (request.needsEmbedding);
+    out.writeBool (request.needsHash);
+}
+
+FileProber::Request FileProber::readRequest (juce::InputStream& in)
+{
+    Request request;
+    auto path = in.readString();
+
+    if (juce::File::isAbsolutePath (path))
+        request.file = juce::File (path);
+
+    request.modificationTime = in.readInt64();
+    request.needsMetadata = in.readBool();
+    request.needsEmbedding = in.readBool();
+    request.needsHash = in.readBool();
+    return request;
+}
+
+void FileProber::writeResult (juce::OutputStream& out, const Result& result)
+{
+    MetadataCache::writeMetadata (out, result.metadata);
+    out.writeBool (result.embedding.has_value());
+
+    if (result.embedding.has_value())
+        out.write (result.embedding->data(), sizeof (float) * TimbreAnalyzer::numDimensions);
+}
+
+FileProber::Result FileProber::readResult (juce::InputStream& in)
+{
+    Result result;
+    result.metadata = MetadataCache::readMetadata (in);
+
+    if (in.readBool())
+    {
+        TimbreAnalyzer::Embedding embedding;
+        auto numBytes = (int) (sizeof (float) * TimbreAnalyzer::numDimensions);
+
+        if (in.read (embedding.data(), numBytes) == numBytes)
+            result.embedding = embedding;
+    }
+
+    return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <JuceHeader.h>
+#include "MetadataCache.h"
+#include "TimbreAnalyzer.h"
+#include "LoudnessAnalyzer.h"
+#include "OnsetDetector.h"
+#include "AudioFormatRegistry.h"
+
+//==============================================================================
+// Opens an audio file and analyses it: header, embedded tags, loudness, onset
+// and, if asked for, a timbre embedding and a hash of the decoded audio.
+//
+// This is the only part of a scan that runs format decoders on the file's
+// contents, so it's what the library hands to its worker processes (see
+// AnalysisWorkerPool). Requests and results therefore have a binary form.
+//
+// A prober keeps its analyzers between calls: building them sets up FFT and
+// filter-bank tables, which costs more than analysing a short one-shot.
+//==============================================================================
+class FileProber
+{
+public:
+    struct Request
+    {
+        juce::File file;
+        juce::int64 modificationTime = 0;
+        bool needsMetadata = true;      // false if only the embedding or hash is missing
+        bool needsEmbedding = true;
+        bool needsHash = true;
+    };
+
+    struct Result
+    {
+        CachedMetadata metadata;        // filled if the request needed metadata; pcmHash if it needed a hash
+        std::optional<TimbreAnalyzer::Embedding> embedding;
+
+        // Set by whoever produced the result, not serialised
+        bool completed = false;
+        bool quarantined = false;       // crashed or hung a worker; metadata marks it unreadable
+    };
+
+    void probe (const Request& request, Result& result);
+
+    // If set, called from probe() before each read from the file
+    std::function<void()> onProgress;
+
+    // What a file that must not be opened again until it changes is stored as
+    static Result makeQuarantined (const Request& request);
+
+    static void writeRequest (juce::OutputStream& out, const Request& request);
+    static Request readRequest (juce::InputStream& in);
+
+    static void writeResult (juce::OutputStream& out, const Result& result);
+    static Result readResult (juce::InputStream& in);
+
+private:
+    // 64-bit multiply/xor-shift hash over the decoded 32-bit PCM of every
+    // channel, so the same audio hashes equal whatever the container.
+    // Returns CachedMetadata::pcmHashFailed if the file can't be decoded.
+    uint64_t hashAudio (juce::AudioFormatReader& reader);
+
+    juce::SharedResourcePointer<AudioFormatRegistry> formats;
+    std::vector<int> hashBuffer;
+
+    TimbreAnalyzer timbre;
+    LoudnessAnalyzer loudness;
+    OnsetDetector onsets;
+};
@@ -0,0 +1,59 @@
+#include "FileReadahead.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#else
+ #include <fcntl.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+juce::uint64 FileReadahead::getLayoutKey (const juce::File& file)
+{
+   #if JUCE_WINDOWS
+    auto handle = CreateFileW (file.getFullPathName().toWideCharPointer(), 0,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (handle == INVALID_HANDLE_VALUE)
+        return 0;
+
+    BY_HANDLE_FILE_INFORMATION info {};
+    auto ok = GetFileInformationByHandle (handle, &info);
+    CloseHandle (handle);
+
+    return ok ? ((juce::uint64) info.nFileIndexHigh << 32) | (juce::uint64) info.nFileIndexLow : 0;
+   #else
+    struct stat info;
+    if (stat (file.getFullPathName().toRawUTF8(), &info) != 0)
+        return 0;
+
+    return (juce::uint64) info.st_ino;
+   #endif
+}
+
+void FileReadahead::prefetch (const juce::File& file, juce::int64 numBytes)
+{
+   #if JUCE_LINUX || JUCE_BSD || JUCE_ANDROID
+    auto fd = open (file.getFullPathName().toRawUTF8(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    // Starts readahead and returns; the pages stay cached after the close
+    posix_fadvise (fd, 0, (off_t) numBytes, POSIX_FADV_WILLNEED);
+    close (fd);
+   #elif JUCE_MAC || JUCE_IOS
+    auto fd = open (file.getFullPathName().toRawUTF8(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    radvisory advice {};
+    advice.ra_offset = 0;
+    advice.ra_count = (int) juce::jmin (numBytes, (juce::int64) std::numeric_limits<int>::max());
+    fcntl (fd, F_RDADVISE, &advice);
+    close (fd);
+   #else
+    juce::ignoreUnused (file, numBytes);
+   #endif
+}
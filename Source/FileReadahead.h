@@ -0,0 +1,23 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Helpers that let a scan keep the storage device busy.
+//
+// Probing thousands of small files one blocking read at a time leaves most of
+// a drive's queue empty, and visiting them in directory order makes spinning
+// disks seek back and forth. A scan instead visits files in on-disk order and
+// asks the OS to start reading the next files' headers in the background
+// while the current ones are being parsed.
+//==============================================================================
+struct FileReadahead
+{
+    // A key that sorts files roughly by where their data lives: the inode
+    // number on POSIX systems (allocated close to the data on ext4, XFS and
+    // APFS), the file index on Windows. 0 if unavailable.
+    static juce::uint64 getLayoutKey (const juce::File& file);
+
+    // Queues an asynchronous read of the first numBytes of the file into the
+    // page cache and returns without waiting. Does nothing where unsupported.
+    static void prefetch (const juce::File& file, juce::int64 numBytes);
+};
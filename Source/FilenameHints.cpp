@@ -0,0 +1,297 @@
+#include "FilenameHints.h"
+
+//==============================================================================
+namespace
+{
+    struct Word
+    {
+        const char* text;
+        int length;
+
+        char lower (int i) const
+        {
+            auto c = text[i];
+            return (c >= 'A' && c <= 'Z') ? (char) (c + ('a' - 'A')) : c;
+        }
+
+        bool equals (const char* lowercaseWord, int start = 0) const
+        {
+            int i = start;
+            for (; i < length && *lowercaseWord != 0; ++i, ++lowercaseWord)
+                if (lower (i) != *lowercaseWord)
+                    return false;
+
+            return i == length && *lowercaseWord == 0;
+        }
+
+        bool isDigit (int i) const  { return text[i] >= '0' && text[i] <= '9'; }
+
+        // Length of the run of digits starting at i
+        int countDigits (int i) const
+        {
+            int end = i;
+            while (end < length && isDigit (end))
+                ++end;
+
+            return end - i;
+        }
+
+        bool endsWith (const char* lowercaseSuffix) const
+        {
+            auto suffixLength = (int) std::strlen (lowercaseSuffix);
+            return suffixLength <= length && equals (lowercaseSuffix, length - suffixLength);
+        }
+
+        int getNumber (int start, int numDigits) const
+        {
+            int value = 0;
+            for (int i = start; i < start + numDigits; ++i)
+                value = value * 10 + (text[i] - '0');
+
+            return value;
+        }
+    };
+
+    bool isWordByte (char c)
+    {
+        auto byte = (uint8_t) c;
+        return (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z')
+            || (byte >= '0' && byte <= '9') || byte == '#' || byte >= 0x80;
+    }
+
+    bool isExplicitTempo (int value)  { return value >= 40 && value <= 300; }
+    bool isBareTempo (int value)      { return value >= 60 && value <= 200; }
+
+    // A note name at the start of the word: letter, then optional '#' or 'b'.
+    // Returns the number of bytes used, or 0.
+    int parseNote (const Word& word, int& pitchClass, bool& isFlat)
+    {
+        static constexpr int naturals[] = { 9, 11, 0, 2, 4, 5, 7 };  // A B C D E F G
+
+        auto letter = word.lower (0);
+        if (letter < 'a' || letter > 'g')
+            return 0;
+
+        pitchClass = naturals[letter - 'a'];
+        isFlat = false;
+
+        if (word.length > 1 && word.text[1] == '#')
+        {
+            pitchClass = (pitchClass + 1) % 12;
+            return 2;
+        }
+
+        // 'b' is a flat unless it starts something else ("Bbm" yes, "Ebeat" no)
+        if (word.length > 1 && word.text[1] == 'b'
+             && (word.length == 2 || word.equals ("m", 2) || word.equals ("min", 2) || word.equals ("minor", 2)
+                  || word.equals ("maj", 2) || word.equals ("major", 2)))
+        {
+            pitchClass = (pitchClass + 11) % 12;
+            isFlat = true;
+            return 2;
+        }
+
+        return 1;
+    }
+
+    // Mode word at position start: 1 = minor, 0 = major, -1 = not a mode.
+    // A lone "m" only counts after an upper-case note ("Am", not "am").
+    int parseMode (const Word& word, int start, bool allowShortMinor)
+    {
+        if (word.equals ("min", start) || word.equals ("minor", start))
+            return 1;
+
+        if (word.equals ("maj", start) || word.equals ("major", start))
+            return 0;
+
+        if (allowShortMinor && start == word.length - 1 && word.text[start] == 'm')
+            return 1;
+
+        return -1;
+    }
+}
+
+//==============================================================================
+FilenameHints FilenameHints::parse (const juce::String& fileName)
+{
+    FilenameHints hints;
+
+    int explicitBpm = 0;
+    int bareBpm = 0;
+    int bareBpmWordIndex = -1;
+    int wordIndex = -1;
+
+    // What the previous word was, for tokens split across two words
+    int previousNumber = 0;
+    bool previousWasBpm = false;
+    int previousNote = -1;
+    bool previousNoteIsFlat = false;
+
+    auto setKey = [&hints] (int pitchClass, bool isFlat, bool isMinor)
+    {
+        if (hints.hasKey())
+            return;
+
+        hints.keyPitchClass = pitchClass;
+        hints.keyIsFlat = isFlat;
+        hints.isMinor = isMinor;
+    };
+
+    auto setTypeHint = [&hints] (TypeHint hint)
+    {
+        if (hints.typeHint == noTypeHint)
+            hints.typeHint = hint;
+    };
+
+    auto* text = fileName.toRawUTF8();
+
+    for (int position = 0; text[position] != 0;)
+    {
+        if (! isWordByte (text[position]))
+        {
+            ++position;
+            continue;
+        }
+
+        Word word { text + position, 0 };
+        while (isWordByte (text[position + word.length]))
+            ++word.length;
+
+        position += word.length;
+        ++wordIndex;
+
+        int number = 0;
+        bool isBpm = false;
+        int note = -1;
+        bool noteIsFlat = false;
+
+        auto numLeadingDigits = word.countDigits (0);
+
+        if (numLeadingDigits == word.length)
+        {
+            // "128", or "90" after a "BPM" word
+            if (numLeadingDigits <= 3)
+            {
+                number = word.getNumber (0, numLeadingDigits);
+
+                if (previousWasBpm && isExplicitTempo (number) && explicitBpm == 0)
+                    explicitBpm = number;
+                else if (bareBpm == 0 && word.text[0] != '0' && isBareTempo (number))
+                {
+                    bareBpm = number;
+                    bareBpmWordIndex = wordIndex;
+                }
+            }
+        }
+        else if (word.length > 3 && word.equals ("bpm", word.length - 3))
+        {
+            // "128bpm", "Groove128bpm"
+            auto start = word.length - 3;
+            while (start > 0 && word.isDigit (start - 1))
+                --start;
+
+            auto numDigits = word.length - 3 - start;
+            if (numDigits > 0 && numDigits <= 3)
+            {
+                auto value = word.getNumber (start, numDigits);
+                if (isExplicitTempo (value) && explicitBpm == 0)
+                    explicitBpm = value;
+            }
+        }
+        else if (numLeadingDigits > 0)
+        {
+            // Anything else starting with a number ("808s", "2bar") says nothing
+        }
+        else if (word.equals ("bpm"))
+        {
+            // "128 BPM"
+            isBpm = true;
+            if (isExplicitTempo (previousNumber) && explicitBpm == 0)
+                explicitBpm = previousNumber;
+        }
+        else if (word.length > 3 && word.lower (0) == 'b' && word.lower (1) == 'p' && word.lower (2) == 'm')
+        {
+            // "BPM128"
+            auto numDigits = word.countDigits (3);
+            if (numDigits == word.length - 3 && numDigits <= 3)
+            {
+                auto value = word.getNumber (3, numDigits);
+                if (isExplicitTempo (value) && explicitBpm == 0)
+                    explicitBpm = value;
+            }
+        }
+        else if (word.endsWith ("loop") || word.endsWith ("loops") || word.equals ("looped"))
+        {
+            // Also "DrumLoop", "TopLoops"
+            setTypeHint (loopHint);
+        }
+        else if (word.endsWith ("oneshot") || word.endsWith ("oneshots") || word.equals ("shot")
+                  || word.equals ("shots") || word.equals ("hit") || word.equals ("hits"))
+        {
+            setTypeHint (oneShotHint);
+        }
+        else
+        {
+            auto mode = parseMode (word, 0, false);
+
+            if (mode >= 0)
+            {
+                // "A min", with the note in the previous word
+                if (previousNote >= 0)
+                    setKey (previousNote, previousNoteIsFlat, mode == 1);
+            }
+            else
+            {
+                int pitchClass = -1;
+                bool isFlat = false;
+                auto noteLength = parseNote (word, pitchClass, isFlat);
+
+                if (noteLength > 0)
+                {
+                    if (noteLength == word.length)
+                    {
+                        // A bare note only becomes a key if a mode word follows
+                        note = pitchClass;
+                        noteIsFlat = isFlat;
+                    }
+                    else
+                    {
+                        auto isUpperCase = word.text[0] >= 'A' && word.text[0] <= 'G';
+                        auto wordMode = parseMode (word, noteLength, isUpperCase);
+
+                        if (wordMode >= 0)
+                            setKey (pitchClass, isFlat, wordMode == 1);
+                    }
+                }
+            }
+        }
+
+        previousNumber = number;
+        previousWasBpm = isBpm;
+        previousNote = note;
+        previousNoteIsFlat = noteIsFlat;
+    }
+
+    // A bare number is trusted in a loop's name, or anywhere but at the end
+    if (explicitBpm > 0)
+        hints.bpm = explicitBpm;
+    else if (bareBpm > 0 && (bareBpmWordIndex < wordIndex || hints.typeHint == loopHint))
+        hints.bpm = bareBpm;
+
+    return hints;
+}
+
+juce::String FilenameHints::getKeyName() const
+{
+    if (! hasKey())
+        return {};
+
+    static const char* const sharpNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+    static const char* const flatNames[]  = { "C", "Db", "D", "Eb", "E", "F", "Gb", "G", "Ab", "A", "Bb", "B" };
+
+    juce::String name ((keyIsFlat ? flatNames : sharpNames)[keyPitchClass]);
+    if (! isModeKnown)
+        return name;
+
+    return name + (isMinor ? " min" : " maj");
+}
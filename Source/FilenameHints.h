@@ -0,0 +1,35 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Tempo, key and loop/one-shot hints read from a sample's file name.
+//
+// The name is split into words at anything other than letters, digits and
+// '#', and the words are matched against common sample-pack conventions:
+//
+//   tempo     128bpm  128_BPM  BPM128  bpm_90   or a bare 60-200 that isn't
+//             the last word (trailing numbers are usually take indices)
+//   key       Am  F#min  Ebmaj  Bbminor  C_major  "A min"
+//   type      loop/loops/looped/DrumLoop, oneshot/one_shot/hit/shot
+//
+// parse() makes a single pass over the UTF-8 bytes and doesn't allocate.
+//==============================================================================
+struct FilenameHints
+{
+    enum TypeHint { noTypeHint, loopHint, oneShotHint };
+
+    double bpm = 0.0;           // 0 if none
+    int keyPitchClass = -1;     // 0 = C ... 11 = B, -1 if none
+    bool isMinor = false;
+    bool isModeKnown = true;    // false for a bare root note (from file tags)
+    bool keyIsFlat = false;     // spelled with a flat, kept for display
+    TypeHint typeHint = noTypeHint;
+
+    static FilenameHints parse (const juce::String& fileName);
+
+    bool hasKey() const { return keyPitchClass >= 0; }
+
+    // e.g. "F# maj", "Bb min", or just "F#" if the mode isn't known; empty
+    // without a key
+    juce::String getKeyName() const;
+};
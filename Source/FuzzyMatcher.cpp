@@ -0,0 +1,198 @@
+#include "FuzzyMatcher.h"
+
+//==============================================================================
+FuzzyMatcher::FuzzyMatcher (const juce::String& query)
+{
+    auto words = juce::StringArray::fromTokens (query.toLowerCase(), true);
+    words.removeEmptyStrings();
+
+    for (auto& word : words)
+    {
+        Term term;
+        term.length = juce::jmin (word.length(), maxTermLength);
+
+        // Allow more typos the longer the term gets; very short terms must be exact
+        term.maxErrors = term.length <= 3 ? 0 : (term.length <= 5 ? 1 : 2);
+
+        auto text = word.getCharPointer();
+        for (int i = 0; i < term.length; ++i)
+        {
+            auto c = text.getAndAdvance();
+            auto bit = (uint64_t) 1 << i;
+
+            if (c < 128)
+            {
+                term.asciiMasks[c] |= bit;
+            }
+            else
+            {
+                auto it = std::find_if (term.otherMasks.begin(), term.otherMasks.end(),
+                                        [c] (const auto& entry) { return entry.first == c; });
+
+                if (it != term.otherMasks.end())
+                    it->second |= bit;
+                else
+                    term.otherMasks.emplace_back (c, bit);
+            }
+        }
+
+        terms.push_back (std::move (term));
+    }
+}
+
+uint64_t FuzzyMatcher::Term::getMask (juce::juce_wchar c) const
+{
+    c = juce::CharacterFunctions::toLowerCase (c);
+
+    if (c < 128)
+        return asciiMasks[c];
+
+    for (auto& entry : otherMasks)
+        if (entry.first == c)
+            return entry.second;
+
+    return 0;
+}
+
+//==============================================================================
+FuzzyMatcher::Match FuzzyMatcher::findBestMatch (const Term& term, const juce::String& text)
+{
+    // Myers' bit-vector algorithm, search variant: the pattern may start
+    // anywhere in the text, so no carry is shifted into the horizontal delta
+    const auto highBit = (uint64_t) 1 << (term.length - 1);
+
+    uint64_t pv = ~(uint64_t) 0;
+    uint64_t mv = 0;
+    int distance = term.length;
+
+    Match best;
+    int position = 0;
+
+    for (auto p = text.getCharPointer(); ! p.isEmpty(); ++position)
+    {
+        auto eq = term.getMask (p.getAndAdvance());
+        auto xv = eq | mv;
+        auto xh = (((eq & pv) + pv) ^ pv) | eq;
+        auto ph = mv | ~(xh | pv);
+        auto mh = pv & xh;
+
+        if (ph & highBit)
+            ++distance;
+        else if (mh & highBit)
+            --distance;
+
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        if (distance <= term.maxErrors && (best.errors < 0 || distance < best.errors))
+        {
+            best.errors = distance;
+            best.start = juce::jmax (0, position - term.length + 1);
+
+            if (distance == 0 && best.start == 0)
+                break;  // can't do better than an exact prefix
+        }
+    }
+
+    return best;
+}
+
+bool FuzzyMatcher::isWordStart (const juce::String& text, int index)
+{
+    if (index <= 0)
+        return true;
+
+    auto previous = text[index - 1];
+    auto current = text[index];
+
+    if (! juce::CharacterFunctions::isLetterOrDigit (previous))
+        return true;
+
+    // "BigKick" and "808Kick" both start a word at K
+    return (juce::CharacterFunctions::isLowerCase (previous) && juce::CharacterFunctions::isUpperCase (current))
+        || (juce::CharacterFunctions::isDigit (previous) != juce::CharacterFunctions::isDigit (current));
+}
+
+int FuzzyMatcher::scoreNameMatch (Match match, const juce::String& name)
+{
+    int result = 1000 - 250 * match.errors;
+
+    if (match.start == 0)
+        result += match.errors == 0 ? 400 : 150;
+    else if (isWordStart (name, match.start))
+        result += match.errors == 0 ? 200 : 100;
+
+    return result;
+}
+
+int FuzzyMatcher::getLengthPenalty (int nameLength)
+{
+    return 2 * juce::jmin (nameLength, 100);
+}
+
+//==============================================================================
+int FuzzyMatcher::score (const juce::String& name, const juce::StringArray& tags) const
+{
+    int total = 0;
+
+    for (auto& term : terms)
+    {
+        int termScore = 0;
+
+        auto nameMatch = findBestMatch (term, name);
+        if (nameMatch.errors >= 0)
+            termScore = scoreNameMatch (nameMatch, name);
+
+        // A tag hit counts for less than a name hit, so only look at tags
+        // when the name didn't already match exactly
+        if (nameMatch.errors != 0)
+        {
+            for (auto& tag : tags)
+            {
+                auto tagMatch = findBestMatch (term, tag);
+                if (tagMatch.errors >= 0)
+                    termScore = juce::jmax (termScore, 600 - 250 * tagMatch.errors);
+            }
+        }
+
+        if (termScore <= 0)
+            return 0;
+
+        total += termScore;
+    }
+
+    return juce::jmax (1, total - getLengthPenalty (name.length()));
+}
+
+bool FuzzyMatcher::matches (const juce::String& name, const juce::StringArray& tags) const
+{
+    // Any hit within maxErrors scores above zero, on the name or a tag
+    for (auto& term : terms)
+    {
+        if (findBestMatch (term, name).errors >= 0)
+            continue;
+
+        bool hitTag = false;
+
+        for (auto& tag : tags)
+        {
+            if (findBestMatch (term, tag).errors >= 0)
+            {
+                hitTag = true;
+                break;
+            }
+        }
+
+        if (! hitTag)
+            return false;
+    }
+
+    return true;
+}
+
+int FuzzyMatcher::getMaxScore (int nameLength) const
+{
+    return juce::jmax (1, (int) terms.size() * maxTermScore - getLengthPenalty (nameLength));
+}
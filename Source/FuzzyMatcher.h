@@ -0,0 +1,59 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Typo-tolerant, case-insensitive matcher for search-as-you-type.
+//
+// The query is split into whitespace-separated terms and every term must
+// match the sample name or one of its tags. Each term is matched with Myers'
+// bit-parallel approximate string matching, so "snre" still finds "snare".
+// Matches score higher with fewer edits, at the start of the name and at word
+// boundaries, and shorter names win ties.
+//==============================================================================
+class FuzzyMatcher
+{
+public:
+    explicit FuzzyMatcher (const juce::String& query);
+
+    bool isEmpty() const { return terms.empty(); }
+
+    // Returns 0 if the sample doesn't match, otherwise a positive score
+    int score (const juce::String& name, const juce::StringArray& tags) const;
+
+    // Same as score() > 0, but stops at each term's first hit
+    bool matches (const juce::String& name, const juce::StringArray& tags) const;
+
+    // Upper bound of score() for any name with this many characters. Shorter
+    // names have higher bounds, so scanning names by ascending length lets a
+    // top-K search stop once the bound drops below its K-th best score.
+    int getMaxScore (int nameLength) const;
+
+    // Patterns longer than this are truncated to fit one machine word
+    static constexpr int maxTermLength = 64;
+
+private:
+    struct Term
+    {
+        int length = 0;
+        int maxErrors = 0;
+        uint64_t asciiMasks[128] = {};
+        std::vector<std::pair<juce::juce_wchar, uint64_t>> otherMasks;
+
+        uint64_t getMask (juce::juce_wchar c) const;
+    };
+
+    struct Match
+    {
+        int errors = -1;  // -1 if no match
+        int start = 0;    // approximate for non-exact matches
+    };
+
+    static Match findBestMatch (const Term& term, const juce::String& text);
+    static int scoreNameMatch (Match match, const juce::String& name);
+    static bool isWordStart (const juce::String& text, int index);
+    static int getLengthPenalty (int nameLength);
+
+    std::vector<Term> terms;
+
+    static constexpr int maxTermScore = 1400;
+};
@@ -0,0 +1,348 @@
+#include <JuceHeader.h>
+#include "SampleLibrary.h"
+#include "BatchExporter.h"
+#include "TraceRecorder.h"
+#include <iostream>
+
+//==============================================================================
+// Sound Xplorer Indexer
+//
+// Headless front end to SampleLibrary: builds and refreshes the persistent
+// library state (settings, metadata cache, similarity index) and runs queries
+// against it, so indices can be prepared on a machine without a display and
+// performance can be scripted.
+//
+//   SoundXplorerIndexer [--state <dir>] <command> [arguments]
+//
+// The plug-in also runs it as its analysis worker (see AnalysisWorkerPool).
+//==============================================================================
+namespace
+{
+    juce::File stateDirectory;
+
+    double getMillisecondsSince (double startTime)
+    {
+        return juce::Time::getMillisecondCounterHiRes() - startTime;
+    }
+
+    // Constructing the library loads its state and rescans the saved folders
+    std::unique_ptr<SampleLibrary> openLibrary()
+    {
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+        auto library = std::make_unique<SampleLibrary> (stateDirectory);
+        library->finishPendingAnalysis();
+
+        std::cout << "Loaded " << library->getTotalFileCount() << " samples from "
+                  << library->getLibraryFolders().size() << " folders in "
+                  << juce::String (getMillisecondsSince (startTime), 1) << " ms" << std::endl;
+
+        return library;
+    }
+
+    // Everything after the command name, rejoined into query text
+    juce::String getQueryText (const juce::ArgumentList& args)
+    {
+        juce::StringArray words;
+        for (int i = 1; i < args.size(); ++i)
+            words.add (args[i].text);
+
+        return words.joinIntoString (" ");
+    }
+
+    void printSample (const SampleItem& item)
+    {
+        std::cout << item.file.getFullPathName() << '\t'
+                  << item.type << '\t'
+                  << (item.bpm > 0.0 ? juce::String (item.bpm, 1) : juce::String ("-")) << '\t'
+                  << (item.key.isNotEmpty() ? item.key : juce::String ("-")) << '\t'
+                  << juce::String (item.lengthSeconds, 2) << '\t'
+                  << item.tags.joinIntoString (",") << std::endl;
+    }
+
+    //==========================================================================
+    void scanFolders (const juce::ArgumentList& args)
+    {
+        if (args.size() < 2)
+            juce::ConsoleApplication::fail ("Expected at least one folder to scan");
+
+        auto library = openLibrary();
+
+        for (int i = 1; i < args.size(); ++i)
+        {
+            auto folder = args[i].resolveAsFile();
+
+            if (! folder.isDirectory())
+                juce::ConsoleApplication::fail ("Not a folder: " + folder.getFullPathName());
+
+            // Folders already in the library were rescanned by openLibrary()
+            if (library->getLibraryFolders().contains (folder))
+                continue;
+
+            auto startTime = juce::Time::getMillisecondCounterHiRes();
+            auto numBefore = library->getTotalFileCount();
+
+            library->addLibraryFolder (folder);
+            library->finishPendingAnalysis();
+
+            std::cout << "Scanned " << folder.getFullPathName() << ": "
+                      << library->getTotalFileCount() - numBefore << " samples in "
+                      << juce::String (getMillisecondsSince (startTime), 1) << " ms" << std::endl;
+        }
+
+        library->saveState();
+    }
+
+    void removeFolders (const juce::ArgumentList& args)
+    {
+        if (args.size() < 2)
+            juce::ConsoleApplication::fail ("Expected at least one folder to remove");
+
+        auto library = openLibrary();
+
+        for (int i = 1; i < args.size(); ++i)
+            library->removeLibraryFolder (args[i].resolveAsFile());
+
+        std::cout << library->getTotalFileCount() << " samples remain" << std::endl;
+    }
+
+    void refreshLibrary (const juce::ArgumentList&)
+    {
+        // Loading already rescans against the caches, so only changed files
+        // were re-analysed; saving persists whatever they added
+        auto library = openLibrary();
+        library->saveState();
+    }
+
+    void runQuery (const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        auto limit = args.removeValueForOption ("--limit").getIntValue();
+        auto favoritesOnly = args.removeOptionIfFound ("--favorites");
+
+        auto library = openLibrary();
+
+        auto query = SampleQuery::parse (getQueryText (args));
+        query.favoritesOnly = favoritesOnly;
+
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+        auto results = library->getFilteredSamples (query);
+        auto elapsed = getMillisecondsSince (startTime);
+
+        auto numToPrint = limit > 0 ? juce::jmin (limit, results.size()) : results.size();
+        for (int i = 0; i < numToPrint; ++i)
+            printSample (results.getReference (i));
+
+        std::cout << results.size() << " results in " << juce::String (elapsed, 2) << " ms" << std::endl;
+    }
+
+    void benchmarkQuery (const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        auto runsOption = args.removeValueForOption ("--runs");
+        auto numRuns = runsOption.isNotEmpty() ? juce::jmax (1, runsOption.getIntValue()) : 100;
+
+        auto library = openLibrary();
+        auto query = SampleQuery::parse (getQueryText (args));
+
+        std::vector<double> timings;
+        timings.reserve ((size_t) numRuns);
+        int numResults = 0;
+
+        for (int run = 0; run < numRuns; ++run)
+        {
+            SampleLibrary::TagCounts facetCounts;
+
+            auto startTime = juce::Time::getMillisecondCounterHiRes();
+            numResults = library->getFilteredSamples (query, &facetCounts).size();
+            timings.push_back (getMillisecondsSince (startTime));
+        }
+
+        std::sort (timings.begin(), timings.end());
+
+        auto percentile = [&timings] (double fraction)
+        {
+            auto index = (size_t) juce::roundToInt (fraction * (double) (timings.size() - 1));
+            return juce::String (timings[index], 3);
+        };
+
+        std::cout << numResults << " results, " << numRuns << " runs (ms):"
+                  << " min " << percentile (0.0)
+                  << " p50 " << percentile (0.5)
+                  << " p99 " << percentile (0.99)
+                  << " max " << percentile (1.0) << std::endl;
+    }
+
+    void publishIndex (const juce::ArgumentList& args)
+    {
+        auto library = openLibrary();
+
+        juce::Array<juce::File> folders;
+        for (int i = 1; i < args.size(); ++i)
+            folders.add (args[i].resolveAsFile());
+
+        if (folders.isEmpty())
+            folders = library->getLibraryFolders();
+
+        for (auto& folder : folders)
+        {
+            if (! library->getLibraryFolders().contains (folder))
+                juce::ConsoleApplication::fail ("Not a library folder: " + folder.getFullPathName());
+
+            if (! library->writeLibraryIndex (folder))
+                juce::ConsoleApplication::fail ("Couldn't write " + LibraryIndexFile::getFileFor (folder).getFullPathName());
+
+            std::cout << "Wrote " << LibraryIndexFile::getFileFor (folder).getFullPathName() << std::endl;
+        }
+    }
+
+    void exportSamples (const juce::ArgumentList& arguments)
+    {
+        auto args = arguments;
+        BatchExporter::Settings settings;
+
+        auto destination = args.removeValueForOption ("--to");
+        if (destination.isEmpty())
+            juce::ConsoleApplication::fail ("Expected --to <folder>");
+
+        settings.destination = juce::File::getCurrentWorkingDirectory().getChildFile (destination);
+
+        if (auto format = args.removeValueForOption ("--format"); format.isNotEmpty())
+            settings.formatName = format.toUpperCase();
+
+        if (auto rate = args.removeValueForOption ("--rate"); rate.isNotEmpty())
+            settings.sampleRate = rate.getDoubleValue();
+
+        if (auto bits = args.removeValueForOption ("--bits"); bits.isNotEmpty())
+            settings.bitsPerSample = bits.getIntValue();
+
+        if (auto peak = args.removeValueForOption ("--normalise"); peak.isNotEmpty())
+        {
+            settings.normalise = true;
+            settings.normalisePeakDb = peak.getFloatValue();
+        }
+
+        auto favoritesOnly = args.removeOptionIfFound ("--favorites");
+
+        BatchExporter exporter (settings);
+        if (auto error = exporter.validate(); error.isNotEmpty())
+            juce::ConsoleApplication::fail (error);
+
+        auto library = openLibrary();
+
+        auto query = SampleQuery::parse (getQueryText (args));
+        query.favoritesOnly = favoritesOnly;
+
+        juce::Array<juce::File> files;
+        for (auto& item : library->getFilteredSamples (query))
+            files.add (item.file);
+
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+        int lastReported = -1;
+
+        auto result = exporter.run (files, [&lastReported] (float progress)
+        {
+            auto percent = (int) (progress * 100.0f);
+
+            if (percent / 10 != lastReported / 10)
+            {
+                std::cout << percent << "%" << std::endl;
+                lastReported = percent;
+            }
+
+            return true;
+        });
+
+        for (auto& failure : result.failures)
+            std::cerr << failure << std::endl;
+
+        std::cout << "Exported " << result.numExported << " of " << files.size() << " samples to "
+                  << settings.destination.getFullPathName() << " in "
+                  << juce::String (getMillisecondsSince (startTime) / 1000.0, 1) << " s" << std::endl;
+
+        if (! result.failures.isEmpty())
+            juce::ConsoleApplication::fail (juce::String (result.failures.size()) + " samples failed");
+    }
+
+    void printStats (const juce::ArgumentList&)
+    {
+        auto library = openLibrary();
+
+        std::cout << "State:       " << stateDirectory.getFullPathName() << std::endl
+                  << "Folders:     " << library->getLibraryFolders().size() << std::endl;
+
+        for (auto& folder : library->getLibraryFolders())
+            std::cout << "  " << folder.getFullPathName() << std::endl;
+
+        std::cout << "Samples:     " << library->getTotalFileCount() << std::endl
+                  << "Tags:        " << (int) library->getTagHistogram().size() << std::endl
+                  << "Duplicates:  " << library->getDuplicateGroups().size() << " groups" << std::endl;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    // SampleLibrary broadcasts change messages, which need a message manager
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    // The plug-in starts this executable as its analysis worker
+    if (AnalysisWorkerPool::runWorkerIfRequested (juce::StringArray (argv + 1, argc - 1).joinIntoString (" ")))
+        return 0;
+
+    juce::ArgumentList args (argc, argv);
+
+    auto stateOption = args.removeValueForOption ("--state");
+    stateDirectory = stateOption.isNotEmpty()
+                         ? juce::File::getCurrentWorkingDirectory().getChildFile (stateOption)
+                         : juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+                               .getChildFile ("SoundXplorer");
+
+    juce::ConsoleApplication app;
+
+    app.addHelpCommand ("help|--help|-h",
+                        "Sound Xplorer Indexer\n"
+                        "Usage: SoundXplorerIndexer [--state <dir>] <command> [arguments]\n"
+                        "The state directory defaults to the one the plug-in uses.",
+                        true);
+
+    app.addCommand ({ "scan", "scan <folder>...",
+                      "Adds folders to the library, analyses them and saves the index",
+                      {}, scanFolders });
+
+    app.addCommand ({ "remove", "remove <folder>...",
+                      "Removes folders from the library",
+                      {}, removeFolders });
+
+    app.addCommand ({ "refresh", "refresh",
+                      "Rescans every library folder, re-analysing changed files, and saves the index",
+                      {}, refreshLibrary });
+
+    app.addCommand ({ "query", "query [--limit <n>] [--favorites] <search text>",
+                      "Prints matching samples as tab-separated path, type, BPM, key, length and tags",
+                      {}, runQuery });
+
+    app.addCommand ({ "bench", "bench [--runs <n>] <search text>",
+                      "Times a query (with tag facets) over repeated runs and prints latency percentiles",
+                      {}, benchmarkQuery });
+
+    app.addCommand ({ "publish", "publish [<folder>...]",
+                      "Writes the analysis of library folders (default: all) into an index at each folder's root, "
+                      "which other machines sharing the folders adopt instead of re-analysing",
+                      {}, publishIndex });
+
+    app.addCommand ({ "export", "export --to <folder> [--format wav|aiff|flac] [--rate <hz>] [--bits <n>] [--normalise=<peak dBFS>] [--favorites] <search text>",
+                      "Converts the samples matching a query and writes them into a folder, using every core",
+                      {}, exportSamples });
+
+    app.addCommand ({ "stats", "stats",
+                      "Prints library folders and sizes",
+                      {}, printStats });
+
+    // SOUNDXPLORER_TRACE=<file.json> writes a timeline of the command
+    TraceRecorder::getInstance().enableFromEnvironment();
+
+    auto result = app.findAndRunCommand (args, true);
+
+    TraceRecorder::getInstance().writeEnvironmentTrace();
+    return result;
+}
@@ -110,10 +110,51 @@ void LibraryBrowserComponent::addLibraryClicked()
 
 void LibraryBrowserComponent::refreshClicked()
 {
-    library.refreshLibraries();
-    updateFolderList();
-    if (onLibraryChanged)
-        onLibraryChanged();
+    juce::PopupMenu menu;
+
+    menu.addItem ("Rescan All Libraries", [this]
+    {
+        library.refreshLibraries();
+        updateFolderList();
+        if (onLibraryChanged)
+            onLibraryChanged();
+    });
+
+    // Retagging works from the paths in memory, so it doesn't rescan
+    menu.addItem ("Reload Tag Taxonomy", [this]
+    {
+        if (library.reloadTagTaxonomy() && onLibraryChanged)
+            onLibraryChanged();
+    });
+
+    menu.addItem ("Edit Tag Taxonomy...", [this]
+    {
+        library.getTagTaxonomyFile().startAsProcess();
+    });
+
+    menu.addSeparator();
+
+    // For libraries on a shared volume: other machines adopt the sidecar
+    // instead of analysing the files again
+    menu.addItem ("Share Analysis in Library Folders", ! library.getLibraryFolders().isEmpty(), false, [this]
+    {
+        juce::StringArray failed;
+        for (auto& folder : library.getLibraryFolders())
+            if (! library.writeLibraryIndex (folder))
+                failed.add (folder.getFullPathName());
+
+        if (failed.isEmpty())
+            return;
+
+        juce::AlertWindow::showAsync (juce::MessageBoxOptions()
+                                          .withIconType (juce::MessageBoxIconType::WarningIcon)
+                                          .withTitle ("Share Analysis")
+                                          .withMessage ("Couldn't write the index into:\n" + failed.joinIntoString ("\n"))
+                                          .withButton ("OK"),
+                                      nullptr);
+    });
+
+    menu.showMenuAsync (juce::PopupMenu::Options().withTargetComponent (&refreshButton));
 }
 
 void LibraryBrowserComponent::updateFolderList()
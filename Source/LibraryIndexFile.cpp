@@ -0,0 +1,104 @@
+#include "LibraryIndexFile.h"
+
+//==============================================================================
+// File layout: magic, version, embedding dimensions, entry count, then per
+// entry the relative path, the metadata as MetadataCache writes it, a flag
+// and (if set) the embedding.
+static constexpr int indexFileMagic = 0x494c5853;  // "SXLI"
+static constexpr int indexFileVersion = 3;
+
+juce::File LibraryIndexFile::getFileFor (const juce::File& libraryRoot)
+{
+    return libraryRoot.getChildFile (".soundxplorer-index");
+}
+
+bool LibraryIndexFile::write (const juce::File& libraryRoot, const std::vector<Entry>& entries)
+{
+    auto file = getFileFor (libraryRoot);
+
+    // Written beside the target and swapped in, so readers on other machines
+    // never see half a file
+    juce::TemporaryFile temp (file);
+    {
+        juce::FileOutputStream out (temp.getFile());
+        if (! out.openedOk())
+            return false;
+
+        out.writeInt (indexFileMagic);
+        out.writeInt (indexFileVersion);
+        out.writeInt (TimbreAnalyzer::numDimensions);
+        out.writeInt ((int) entries.size());
+
+        for (auto& entry : entries)
+        {
+            out.writeString (entry.relativePath.replaceCharacter ('\\', '/'));
+            MetadataCache::writeMetadata (out, entry.metadata);
+            out.writeBool (entry.embedding.has_value());
+
+            if (entry.embedding.has_value())
+                out.write (entry.embedding->data(), sizeof (float) * TimbreAnalyzer::numDimensions);
+        }
+
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+
+    return temp.overwriteTargetFileWithTemporary();
+}
+
+bool LibraryIndexFile::read (const juce::File& libraryRoot, std::vector<Entry>& entries)
+{
+    entries.clear();
+
+    juce::FileInputStream in (getFileFor (libraryRoot));
+    if (! in.openedOk())
+        return false;
+
+    if (in.readInt() != indexFileMagic
+         || in.readInt() != indexFileVersion
+         || in.readInt() != TimbreAnalyzer::numDimensions)
+        return false;
+
+    auto numEntries = in.readInt();
+    if (numEntries < 0)
+        return false;
+
+    // Not reserved up front: the count comes from a shared folder, and a
+    // corrupt one mustn't be able to ask for gigabytes. Reading stops at the
+    // end of the file anyway.
+    std::vector<Entry> loaded;
+
+    int numRead = 0;
+
+    for (; numRead < numEntries && ! in.isExhausted(); ++numRead)
+    {
+        Entry entry;
+        entry.relativePath = in.readString();
+        entry.metadata = MetadataCache::readMetadata (in);
+
+        if (in.readBool())
+        {
+            SimilarityIndex::Embedding embedding;
+            auto numBytes = (int) (sizeof (float) * TimbreAnalyzer::numDimensions);
+
+            if (in.read (embedding.data(), numBytes) != numBytes)
+                return false;
+
+            entry.embedding = embedding;
+        }
+
+        // Absolute or escaping paths can't come from write(); ignore them
+        if (juce::File::isAbsolutePath (entry.relativePath)
+             || juce::StringArray::fromTokens (entry.relativePath, "/", {}).contains (".."))
+            continue;
+
+        loaded.push_back (std::move (entry));
+    }
+
+    if (numRead != numEntries || in.getPosition() != in.getTotalLength())
+        return false;
+
+    entries = std::move (loaded);
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <JuceHeader.h>
+#include "MetadataCache.h"
+#include "SimilarityIndex.h"
+
+//==============================================================================
+// A library's analysis results, stored in a sidecar file at the root of the
+// library folder so that every machine sharing the folder can adopt them.
+//
+// Paths are relative to the library root and use '/' separators, so the file
+// stays valid wherever the volume is mounted. Each entry keeps the size and
+// modification time it was analysed at; readers trust it only while the file
+// on disk still matches, exactly like the per-user MetadataCache.
+//==============================================================================
+struct LibraryIndexFile
+{
+    struct Entry
+    {
+        juce::String relativePath;
+        CachedMetadata metadata;
+        std::optional<SimilarityIndex::Embedding> embedding;
+    };
+
+    // <libraryRoot>/.soundxplorer-index
+    static juce::File getFileFor (const juce::File& libraryRoot);
+
+    static bool write (const juce::File& libraryRoot, const std::vector<Entry>& entries);
+
+    // Returns false, leaving entries empty, if there is no readable index
+    static bool read (const juce::File& libraryRoot, std::vector<Entry>& entries);
+};
@@ -0,0 +1,221 @@
+#include "LoudnessAnalyzer.h"
+#include "TimbreAnalyzer.h"
+
+namespace
+{
+    // BS.1770-4 Annex 2: 48-tap interpolating filter for 4x oversampling,
+    // split into its four phases
+    constexpr float peakCoefficients[4][12] =
+    {
+        {  0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f, -0.0594482421875f,  0.1373291015625f,
+           0.9721679687500f, -0.1022949218750f,  0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f },
+        { -0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f, -0.1665039062500f,  0.4650878906250f,
+           0.7797851562500f, -0.2003173828125f,  0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f },
+        { -0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f, -0.2003173828125f,  0.7797851562500f,
+           0.4650878906250f, -0.1665039062500f,  0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f },
+        { -0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f, -0.1022949218750f,  0.9721679687500f,
+           0.1373291015625f, -0.0594482421875f,  0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f }
+    };
+
+    constexpr double absoluteGateLufs = -70.0;
+    constexpr double relativeGate = 0.1;        // -10 LU
+
+    double energyToLufs (double energy)
+    {
+        return -0.691 + 10.0 * std::log10 (energy);
+    }
+}
+
+//==============================================================================
+void LoudnessAnalyzer::prepare (double sampleRate, int numChannels, int stepLength)
+{
+    if (sampleRate != preparedSampleRate)
+    {
+        preparedSampleRate = sampleRate;
+        auto pi = juce::MathConstants<double>::pi;
+
+        // The K-weighting filters are specified at 48 kHz; these are their
+        // analogue prototypes, so any rate gets the same response
+        {
+            // High shelf, +4 dB above about 1.5 kHz
+            const double f0 = 1681.974450955533, gainDb = 3.999843853973347, q = 0.7071752369554196;
+            auto k = std::tan (pi * f0 / sampleRate);
+            auto vh = std::pow (10.0, gainDb / 20.0);
+            auto vb = std::pow (vh, 0.4996667741545416);
+            auto a0 = 1.0 + k / q + k * k;
+
+            shelf = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                      2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+        }
+
+        {
+            // High-pass at about 38 Hz
+            const double f0 = 38.13547087602444, q = 0.5003270373238773;
+            auto k = std::tan (pi * f0 / sampleRate);
+            auto a0 = 1.0 + k / q + k * k;
+
+            highPass = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+        }
+    }
+
+    filterStates.assign ((size_t) numChannels, {});
+
+    // 5.1 follows the standard weighting: no LFE, surrounds +1.5 dB
+    channelWeights.assign ((size_t) numChannels, 1.0f);
+    if (numChannels == 6)
+        channelWeights = { 1.0f, 1.0f, 1.0f, 0.0f, 1.41f, 1.41f };
+
+    readBuffer.setSize (numChannels, stepLength, false, false, true);
+    peakInput.setSize (numChannels, numPeakTaps - 1 + stepLength, false, false, true);
+    peakInput.clear();
+    peakPhase.resize ((size_t) stepLength);
+    stepEnergies.clear();
+}
+
+double LoudnessAnalyzer::kWeightedEnergy (int channel, const float* samples, int numSamples)
+{
+    // Both stages are recursive, so this runs sample by sample; transposed
+    // direct form II in double precision keeps the 38 Hz pole stable
+    auto& state = filterStates[(size_t) channel];
+    auto s1 = state[0], s2 = state[1], t1 = state[2], t2 = state[3];
+    double energy = 0.0;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        auto x = (double) samples[i];
+
+        auto y = shelf.b0 * x + s1;
+        s1 = shelf.b1 * x - shelf.a1 * y + s2;
+        s2 = shelf.b2 * x - shelf.a2 * y;
+
+        auto z = highPass.b0 * y + t1;
+        t1 = highPass.b1 * y - highPass.a1 * z + t2;
+        t2 = highPass.b2 * y - highPass.a2 * z;
+
+        energy += z * z;
+    }
+
+    state = { s1, s2, t1, t2 };
+    return energy;
+}
+
+float LoudnessAnalyzer::interpolatedPeak (int channel, const float* samples, int numSamples)
+{
+    constexpr int history = numPeakTaps - 1;
+
+    // The channel's last few samples sit in front of this step's, so each
+    // tap is one multiply-add across the whole step
+    auto* input = peakInput.getWritePointer (channel);
+    std::memcpy (input + history, samples, sizeof (float) * (size_t) numSamples);
+
+    auto range = juce::FloatVectorOperations::findMinAndMax (samples, numSamples);
+    auto peak = juce::jmax (-range.getStart(), range.getEnd());
+    auto* output = peakPhase.data();
+
+    for (auto& coefficients : peakCoefficients)
+    {
+        juce::FloatVectorOperations::multiply (output, input + history, coefficients[0], numSamples);
+
+        for (int tap = 1; tap < numPeakTaps; ++tap)
+            juce::FloatVectorOperations::addWithMultiply (output, input + history - tap, coefficients[tap], numSamples);
+
+        range = juce::FloatVectorOperations::findMinAndMax (output, numSamples);
+        peak = juce::jmax (peak, -range.getStart(), range.getEnd());
+    }
+
+    std::memmove (input, input + numSamples, sizeof (float) * (size_t) history);
+    return peak;
+}
+
+//==============================================================================
+bool LoudnessAnalyzer::analyze (juce::AudioFormatReader& reader, Measurement& measurement)
+{
+    auto sampleRate = reader.sampleRate;
+    auto numChannels = (int) reader.numChannels;
+
+    if (sampleRate <= 0.0 || numChannels <= 0 || reader.lengthInSamples <= 0)
+        return false;
+
+    const juce::ScopedNoDenormals noDenormals;
+
+    auto stepLength = juce::jmax (1, juce::roundToInt (sampleRate * stepSeconds));
+    auto numFrames = juce::jmin (reader.lengthInSamples, (juce::int64) (sampleRate * maxSecondsToAnalyze));
+    prepare (sampleRate, numChannels, stepLength);
+
+    double totalEnergy = 0.0;       // K-weighted, for samples shorter than a block
+    double totalSquares = 0.0;      // unweighted, for RMS
+    float peak = 0.0f;
+
+    for (juce::int64 position = 0; position < numFrames; position += stepLength)
+    {
+        auto numSamples = (int) juce::jmin ((juce::int64) stepLength, numFrames - position);
+
+        if (! reader.read (&readBuffer, 0, numSamples, position, true, true))
+            return false;
+
+        double stepEnergy = 0.0;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* samples = readBuffer.getReadPointer (ch);
+
+            stepEnergy += channelWeights[(size_t) ch] * kWeightedEnergy (ch, samples, numSamples);
+            totalSquares += TimbreAnalyzer::dotProduct (samples, samples, numSamples);
+            peak = juce::jmax (peak, interpolatedPeak (ch, samples, numSamples));
+        }
+
+        totalEnergy += stepEnergy;
+
+        if (numSamples == stepLength)
+            stepEnergies.push_back (stepEnergy / stepLength);
+    }
+
+    // Each block is the mean of four steps; working forwards, a step is only
+    // overwritten once no later block needs it
+    auto numBlocks = (int) stepEnergies.size() - stepsPerBlock + 1;
+
+    if (numBlocks > 0)
+    {
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            double sum = 0.0;
+            for (int step = 0; step < stepsPerBlock; ++step)
+                sum += stepEnergies[(size_t) (block + step)];
+
+            stepEnergies[(size_t) block] = sum / stepsPerBlock;
+        }
+
+        stepEnergies.resize ((size_t) numBlocks);
+    }
+    else
+    {
+        stepEnergies.assign (1, totalEnergy / (double) numFrames);
+    }
+
+    auto gatedMean = [this] (double threshold)
+    {
+        double sum = 0.0;
+        int count = 0;
+
+        for (auto energy : stepEnergies)
+        {
+            if (energy > threshold)
+            {
+                sum += energy;
+                ++count;
+            }
+        }
+
+        return count > 0 ? sum / count : 0.0;
+    };
+
+    auto absoluteGate = std::pow (10.0, (absoluteGateLufs + 0.691) / 10.0);
+    auto ungated = gatedMean (absoluteGate);
+    auto integrated = gatedMean (juce::jmax (absoluteGate, ungated * relativeGate));
+
+    measurement.integratedLufs = integrated > 0.0 ? juce::jmax (silenceDb, (float) energyToLufs (integrated)) : silenceDb;
+    measurement.truePeakDb = juce::Decibels::gainToDecibels (peak, silenceDb);
+    measurement.rmsDb = juce::Decibels::gainToDecibels ((float) std::sqrt (totalSquares / ((double) numFrames * numChannels)), silenceDb);
+    measurement.isMeasured = true;
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Measures integrated loudness, true peak and RMS level of a sample.
+//
+// Loudness follows ITU-R BS.1770-4: each channel goes through the K-weighting
+// filters (a high shelf and a high-pass), the mean square is taken over 400 ms
+// blocks overlapping by 75%, and blocks are gated at -70 LUFS and then 10 LU
+// below the ungated mean. Samples shorter than one block are measured as a
+// single block. True peak comes from the standard 4x polyphase interpolator,
+// run with FloatVectorOperations one filter tap at a time across a whole
+// block rather than one output sample at a time.
+//
+// Like TimbreAnalyzer, an analyzer keeps its buffers between calls, so reuse
+// one for many files.
+//==============================================================================
+class LoudnessAnalyzer
+{
+public:
+    static constexpr float silenceDb = -100.0f;
+
+    struct Measurement
+    {
+        float integratedLufs = silenceDb;
+        float truePeakDb = silenceDb;       // dBTP
+        float rmsDb = silenceDb;            // dBFS, all channels together
+        bool isMeasured = false;
+    };
+
+    // Returns false for unreadable audio
+    bool analyze (juce::AudioFormatReader& reader, Measurement& measurement);
+
+private:
+    static constexpr double maxSecondsToAnalyze = 600.0;
+    static constexpr double stepSeconds = 0.1;          // gating blocks start every 100 ms
+    static constexpr int stepsPerBlock = 4;             // and last 400 ms
+    static constexpr int numPeakTaps = 12;              // per phase of the true-peak filter
+
+    struct Biquad
+    {
+        double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    };
+
+    void prepare (double sampleRate, int numChannels, int stepLength);
+
+    // Runs one channel through the K-weighting filters and returns the sum of
+    // the squared output; the filter state carries over to the next call
+    double kWeightedEnergy (int channel, const float* samples, int numSamples);
+
+    // Largest magnitude of the channel's samples interpolated 4x
+    float interpolatedPeak (int channel, const float* samples, int numSamples);
+
+    double preparedSampleRate = 0.0;
+    Biquad shelf, highPass;
+
+    std::vector<std::array<double, 4>> filterStates;    // per channel
+    std::vector<float> channelWeights;
+
+    juce::AudioBuffer<float> readBuffer;
+    juce::AudioBuffer<float> peakInput;                 // per channel: the last taps, then this step
+    std::vector<float> peakPhase;
+    std::vector<double> stepEnergies;                   // weighted mean square of each step
+};
@@ -0,0 +1,484 @@
+#include "MappedPcmSource.h"
+
+#if ! JUCE_WINDOWS
+ #include <sys/mman.h>
+#endif
+
+#if JUCE_USE_SSE_INTRINSICS
+ #include <emmintrin.h>
+#elif JUCE_USE_ARM_NEON
+ #include <arm_neon.h>
+#endif
+
+//==============================================================================
+namespace
+{
+    struct PcmLayout
+    {
+        MappedPcmSource::Encoding encoding = MappedPcmSource::Encoding::int16;
+        bool isBigEndian = false;
+        int numChannels = 0;
+        int bitsPerSample = 0;
+        double sampleRate = 0.0;
+        juce::int64 dataOffset = -1;
+        juce::int64 dataSize = 0;
+    };
+
+    bool setIntegerEncoding (PcmLayout& layout)
+    {
+        switch (layout.bitsPerSample)
+        {
+            case 16:  layout.encoding = MappedPcmSource::Encoding::int16; return true;
+            case 24:  layout.encoding = MappedPcmSource::Encoding::int24; return true;
+            case 32:  layout.encoding = MappedPcmSource::Encoding::int32; return true;
+            default:  return false;
+        }
+    }
+
+    bool parseWav (juce::InputStream& in, PcmLayout& layout)
+    {
+        if (in.readInt() != (int) juce::ByteOrder::littleEndianInt ("RIFF"))
+            return false;
+
+        in.readInt();
+
+        if (in.readInt() != (int) juce::ByteOrder::littleEndianInt ("WAVE"))
+            return false;
+
+        bool hasFormat = false;
+
+        while (! in.isExhausted())
+        {
+            auto chunkType = (juce::uint32) in.readInt();
+            auto chunkSize = (juce::int64) (juce::uint32) in.readInt();
+            auto chunkStart = in.getPosition();
+
+            if (chunkType == juce::ByteOrder::littleEndianInt ("fmt "))
+            {
+                auto formatTag = (juce::uint16) in.readShort();
+                layout.numChannels = in.readShort();
+                layout.sampleRate = (double) (juce::uint32) in.readInt();
+                in.readInt();   // byte rate
+                in.readShort(); // block align
+                layout.bitsPerSample = in.readShort();
+
+                if (formatTag == 0xfffe && chunkSize >= 40)
+                {
+                    in.readShort(); // extension size
+                    in.readShort(); // valid bits
+                    in.readInt();   // channel mask
+                    formatTag = (juce::uint16) in.readShort();  // first field of the sub-format GUID
+                }
+
+                if (formatTag == 1)
+                {
+                    hasFormat = setIntegerEncoding (layout);
+                }
+                else if (formatTag == 3 && layout.bitsPerSample == 32)
+                {
+                    layout.encoding = MappedPcmSource::Encoding::float32;
+                    hasFormat = true;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            else if (chunkType == juce::ByteOrder::littleEndianInt ("data"))
+            {
+                layout.dataOffset = chunkStart;
+                layout.dataSize = chunkSize;
+                return hasFormat;
+            }
+
+            if (! in.setPosition (chunkStart + chunkSize + (chunkSize & 1)))
+                return false;
+        }
+
+        return false;
+    }
+
+    // AIFF stores the sample rate as an 80-bit IEEE extended float
+    double readExtended (juce::InputStream& in)
+    {
+        uint8_t bytes[10] {};
+        in.read (bytes, 10);
+
+        auto exponent = (int) (((bytes[0] & 0x7f) << 8) | bytes[1]);
+        auto mantissa = juce::ByteOrder::bigEndianInt64 (bytes + 2);
+
+        if (exponent == 0 && mantissa == 0)
+            return 0.0;
+
+        return std::ldexp ((double) mantissa, exponent - 16383 - 63);
+    }
+
+    bool parseAiff (juce::InputStream& in, PcmLayout& layout)
+    {
+        if (in.readIntBigEndian() != (int) juce::ByteOrder::bigEndianInt ("FORM"))
+            return false;
+
+        in.readIntBigEndian();
+
+        auto formType = (juce::uint32) in.readIntBigEndian();
+        auto isAifc = formType == juce::ByteOrder::bigEndianInt ("AIFC");
+
+        if (! isAifc && formType != juce::ByteOrder::bigEndianInt ("AIFF"))
+            return false;
+
+        bool hasFormat = false;
+        layout.isBigEndian = true;
+
+        while (! in.isExhausted())
+        {
+            auto chunkType = (juce::uint32) in.readIntBigEndian();
+            auto chunkSize = (juce::int64) (juce::uint32) in.readIntBigEndian();
+            auto chunkStart = in.getPosition();
+
+            if (chunkType == juce::ByteOrder::bigEndianInt ("COMM"))
+            {
+                layout.numChannels = in.readShortBigEndian();
+                in.readIntBigEndian();  // frame count; the SSND size is what's on disk
+                layout.bitsPerSample = in.readShortBigEndian();
+                layout.sampleRate = readExtended (in);
+                hasFormat = setIntegerEncoding (layout);
+
+                if (isAifc)
+                {
+                    auto compression = (juce::uint32) in.readIntBigEndian();
+
+                    if (compression == juce::ByteOrder::bigEndianInt ("sowt"))
+                        layout.isBigEndian = false;
+                    else if (compression == juce::ByteOrder::bigEndianInt ("fl32")
+                              || compression == juce::ByteOrder::bigEndianInt ("FL32"))
+                    {
+                        layout.encoding = MappedPcmSource::Encoding::float32;
+                        hasFormat = layout.bitsPerSample == 32;
+                    }
+                    else if (compression != juce::ByteOrder::bigEndianInt ("NONE")
+                              && compression != juce::ByteOrder::bigEndianInt ("twos")
+                              && compression != juce::ByteOrder::bigEndianInt ("in24")
+                              && compression != juce::ByteOrder::bigEndianInt ("in32"))
+                        return false;
+                }
+            }
+            else if (chunkType == juce::ByteOrder::bigEndianInt ("SSND"))
+            {
+                auto offset = (juce::int64) (juce::uint32) in.readIntBigEndian();
+                in.readIntBigEndian();  // block size
+
+                layout.dataOffset = chunkStart + 8 + offset;
+                layout.dataSize = chunkSize - 8 - offset;
+                return hasFormat;
+            }
+
+            if (! in.setPosition (chunkStart + chunkSize + (chunkSize & 1)))
+                return false;
+        }
+
+        return false;
+    }
+
+    //==============================================================================
+    template <typename Decode>
+    void deinterleave (const uint8_t* src, int stride, float* dest, int numFrames, Decode decode)
+    {
+        for (int i = 0; i < numFrames; ++i, src += stride)
+            dest[i] = decode (src);
+    }
+
+    inline float int16ToFloat (juce::int16 sample)   { return (float) sample * (1.0f / 32768.0f); }
+
+    // 16-bit mono and stereo are most of what gets previewed, so those get
+    // vector kernels; both fall back to scalar code for the tail
+    void convertInt16Mono (const uint8_t* src, bool bigEndian, float* dest, int numFrames)
+    {
+        int i = 0;
+
+       #if JUCE_USE_SSE_INTRINSICS
+        const auto scale = _mm_set1_ps (1.0f / 32768.0f);
+
+        for (; i + 8 <= numFrames; i += 8)
+        {
+            auto x = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (src + i * 2));
+
+            if (bigEndian)
+                x = _mm_or_si128 (_mm_slli_epi16 (x, 8), _mm_srli_epi16 (x, 8));
+
+            auto lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (x, x), 16);
+            auto hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (x, x), 16);
+
+            _mm_storeu_ps (dest + i,     _mm_mul_ps (_mm_cvtepi32_ps (lo), scale));
+            _mm_storeu_ps (dest + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (hi), scale));
+        }
+       #elif JUCE_USE_ARM_NEON
+        for (; i + 8 <= numFrames; i += 8)
+        {
+            auto x = vld1q_s16 (reinterpret_cast<const int16_t*> (src + i * 2));
+
+            if (bigEndian)
+                x = vreinterpretq_s16_u8 (vrev16q_u8 (vreinterpretq_u8_s16 (x)));
+
+            vst1q_f32 (dest + i,     vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (x))),  1.0f / 32768.0f));
+            vst1q_f32 (dest + i + 4, vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (x))), 1.0f / 32768.0f));
+        }
+       #endif
+
+        for (; i < numFrames; ++i)
+        {
+            auto* p = src + i * 2;
+            dest[i] = int16ToFloat ((juce::int16) (bigEndian ? juce::ByteOrder::bigEndianShort (p)
+                                                             : juce::ByteOrder::littleEndianShort (p)));
+        }
+    }
+
+    void convertInt16Stereo (const uint8_t* src, bool bigEndian, float* left, float* right, int numFrames)
+    {
+        int i = 0;
+
+       #if JUCE_USE_SSE_INTRINSICS
+        const auto scale = _mm_set1_ps (1.0f / 32768.0f);
+
+        // Each 32-bit lane holds one frame: left in the low half, right in the high
+        for (; i + 4 <= numFrames; i += 4)
+        {
+            auto x = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (src + i * 4));
+
+            if (bigEndian)
+                x = _mm_or_si128 (_mm_slli_epi16 (x, 8), _mm_srli_epi16 (x, 8));
+
+            auto l = _mm_srai_epi32 (_mm_slli_epi32 (x, 16), 16);
+            auto r = _mm_srai_epi32 (x, 16);
+
+            _mm_storeu_ps (left + i,  _mm_mul_ps (_mm_cvtepi32_ps (l), scale));
+            _mm_storeu_ps (right + i, _mm_mul_ps (_mm_cvtepi32_ps (r), scale));
+        }
+       #elif JUCE_USE_ARM_NEON
+        for (; i + 8 <= numFrames; i += 8)
+        {
+            auto x = vld2q_s16 (reinterpret_cast<const int16_t*> (src + i * 4));
+
+            if (bigEndian)
+            {
+                x.val[0] = vreinterpretq_s16_u8 (vrev16q_u8 (vreinterpretq_u8_s16 (x.val[0])));
+                x.val[1] = vreinterpretq_s16_u8 (vrev16q_u8 (vreinterpretq_u8_s16 (x.val[1])));
+            }
+
+            vst1q_f32 (left + i,      vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (x.val[0]))),  1.0f / 32768.0f));
+            vst1q_f32 (left + i + 4,  vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (x.val[0]))), 1.0f / 32768.0f));
+            vst1q_f32 (right + i,     vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_low_s16 (x.val[1]))),  1.0f / 32768.0f));
+            vst1q_f32 (right + i + 4, vmulq_n_f32 (vcvtq_f32_s32 (vmovl_s16 (vget_high_s16 (x.val[1]))), 1.0f / 32768.0f));
+        }
+       #endif
+
+        for (; i < numFrames; ++i)
+        {
+            auto* p = src + i * 4;
+            left[i]  = int16ToFloat ((juce::int16) (bigEndian ? juce::ByteOrder::bigEndianShort (p)     : juce::ByteOrder::littleEndianShort (p)));
+            right[i] = int16ToFloat ((juce::int16) (bigEndian ? juce::ByteOrder::bigEndianShort (p + 2) : juce::ByteOrder::littleEndianShort (p + 2)));
+        }
+    }
+}
+
+//==============================================================================
+std::unique_ptr<MappedPcmSource> MappedPcmSource::create (const juce::File& file, double startSeconds)
+{
+    PcmLayout layout;
+
+    {
+        juce::FileInputStream in (file);
+        if (! in.openedOk())
+            return nullptr;
+
+        auto extension = file.getFileExtension().toLowerCase();
+        auto parsed = extension == ".wav" ? parseWav (in, layout)
+                    : (extension == ".aif" || extension == ".aiff") ? parseAiff (in, layout)
+                    : false;
+
+        if (! parsed)
+            return nullptr;
+    }
+
+    if (layout.numChannels <= 0 || layout.sampleRate <= 0.0 || layout.dataOffset < 0)
+        return nullptr;
+
+    auto bytesPerSample = layout.bitsPerSample / 8;
+    auto bytesPerFrame = bytesPerSample * layout.numChannels;
+
+    // Streamed WAVs can leave the data size at 0 or 0xffffffff: trust the file
+    auto available = file.getSize() - layout.dataOffset;
+    auto dataSize = layout.dataSize > 0 ? juce::jmin (layout.dataSize, available) : available;
+    auto frameCount = dataSize / bytesPerFrame;
+
+    if (frameCount <= 0)
+        return nullptr;
+
+    auto shared = std::make_shared<Mapping>();
+    shared->numBytes = (size_t) (frameCount * bytesPerFrame);
+    shared->file = std::make_unique<juce::MemoryMappedFile> (file, juce::Range<juce::int64> (layout.dataOffset, layout.dataOffset + (juce::int64) shared->numBytes),
+                                                             juce::MemoryMappedFile::readOnly, false);
+
+    // The mapped range starts on a page boundary at or before the data
+    auto* mapped = static_cast<const uint8_t*> (shared->file->getData());
+    auto mappedRange = shared->file->getRange();
+
+    if (mapped == nullptr || mappedRange.getEnd() < layout.dataOffset + (juce::int64) shared->numBytes)
+        return nullptr;
+
+    shared->data = mapped + (layout.dataOffset - mappedRange.getStart());
+
+   #if ! JUCE_WINDOWS
+    madvise (const_cast<uint8_t*> (mapped), shared->file->getSize(), MADV_WILLNEED);
+   #endif
+
+    std::unique_ptr<MappedPcmSource> source (new MappedPcmSource());
+    source->mapping = shared;
+    source->encoding = layout.encoding;
+    source->isBigEndian = layout.isBigEndian;
+    source->numChannels = layout.numChannels;
+    source->bytesPerSample = bytesPerSample;
+    source->bytesPerFrame = bytesPerFrame;
+    source->sampleRate = layout.sampleRate;
+    source->numFrames = frameCount;
+
+    auto startFrame = juce::jlimit ((juce::int64) 0, frameCount - 1, (juce::int64) (startSeconds * layout.sampleRate));
+    source->nextReadPosition = startFrame;
+
+    // Half a second from the start is faulted in here so the audio thread
+    // never waits on the disk when playback starts
+    auto startByte = (size_t) startFrame * (size_t) bytesPerFrame;
+    touchPages (*shared, startByte, juce::jmin (shared->numBytes, startByte + (size_t) (layout.sampleRate * 0.5) * (size_t) bytesPerFrame));
+
+    return source;
+}
+
+MappedPcmSource::~MappedPcmSource()
+{
+    mapping->cancelled = true;
+}
+
+void MappedPcmSource::touchPages (const Mapping& mapping, size_t startByte, size_t endByte)
+{
+    static constexpr size_t pageSize = 4096;
+
+    uint8_t sum = 0;
+
+    for (auto offset = startByte; offset < endByte; offset += pageSize)
+        sum ^= mapping.data[offset];
+
+    // Keeps the reads from being optimised away
+    static std::atomic<uint8_t> sink;
+    sink.store (sum, std::memory_order_relaxed);
+}
+
+void MappedPcmSource::startPrefaulting (juce::ThreadPool& pool)
+{
+    auto startByte = juce::jmin (mapping->numBytes, (size_t) nextReadPosition.load() * (size_t) bytesPerFrame);
+
+    // The job keeps the mapping alive and stops early once the source is gone.
+    // It works forwards from the play position, then fills in the part before.
+    pool.addJob ([mapping = mapping, startByte]
+    {
+        static constexpr size_t chunkSize = 1 << 20;
+
+        auto touchRange = [&mapping] (size_t from, size_t to)
+        {
+            for (auto start = from; start < to && ! mapping->cancelled; start += chunkSize)
+                touchPages (*mapping, start, juce::jmin (to, start + chunkSize));
+        };
+
+        touchRange (startByte, mapping->numBytes);
+        touchRange (0, startByte);
+    });
+}
+
+//==============================================================================
+void MappedPcmSource::getNextAudioBlock (const juce::AudioSourceChannelInfo& info)
+{
+    auto& buffer = *info.buffer;
+    auto position = nextReadPosition.load();
+    auto destStart = info.startSample;
+    auto remaining = info.numSamples;
+
+    while (remaining > 0)
+    {
+        if (looping && position >= numFrames)
+            position %= numFrames;
+
+        int numToCopy;
+
+        if (position < 0 || position >= numFrames)
+        {
+            // Silence before the start and past the end; the position keeps
+            // moving so the transport can see playback has finished
+            numToCopy = position < 0 ? (int) juce::jmin ((juce::int64) remaining, -position) : remaining;
+            buffer.clear (destStart, numToCopy);
+        }
+        else
+        {
+            numToCopy = (int) juce::jmin ((juce::int64) remaining, numFrames - position);
+            convert (position, numToCopy, buffer, destStart);
+        }
+
+        position += numToCopy;
+        destStart += numToCopy;
+        remaining -= numToCopy;
+    }
+
+    nextReadPosition = looping && position >= numFrames ? position % numFrames : position;
+}
+
+void MappedPcmSource::convert (juce::int64 startFrame, int numFramesToConvert, juce::AudioBuffer<float>& buffer, int startSample) const
+{
+    auto* src = mapping->data + startFrame * bytesPerFrame;
+    auto numOutputs = buffer.getNumChannels();
+    auto numDecoded = juce::jmin (numOutputs, numChannels);
+
+    if (numOutputs == 0)
+        return;
+
+    if (encoding == Encoding::int16 && numChannels == 2 && numOutputs >= 2)
+    {
+        convertInt16Stereo (src, isBigEndian, buffer.getWritePointer (0, startSample),
+                            buffer.getWritePointer (1, startSample), numFramesToConvert);
+    }
+    else if (encoding == Encoding::int16 && numChannels == 1)
+    {
+        convertInt16Mono (src, isBigEndian, buffer.getWritePointer (0, startSample), numFramesToConvert);
+    }
+    else
+    {
+        for (int ch = 0; ch < numDecoded; ++ch)
+        {
+            auto* channelSrc = src + ch * bytesPerSample;
+            auto* dest = buffer.getWritePointer (ch, startSample);
+
+            switch (encoding)
+            {
+                case Encoding::int16:
+                    if (isBigEndian) deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { return int16ToFloat ((juce::int16) juce::ByteOrder::bigEndianShort (p)); });
+                    else             deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { return int16ToFloat ((juce::int16) juce::ByteOrder::littleEndianShort (p)); });
+                    break;
+
+                case Encoding::int24:
+                    if (isBigEndian) deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { return (float) juce::ByteOrder::bigEndian24Bit (p) * (1.0f / 8388608.0f); });
+                    else             deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { return (float) juce::ByteOrder::littleEndian24Bit (p) * (1.0f / 8388608.0f); });
+                    break;
+
+                case Encoding::int32:
+                    if (isBigEndian) deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { return (float) (juce::int32) juce::ByteOrder::bigEndianInt (p) * (1.0f / 2147483648.0f); });
+                    else             deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { return (float) (juce::int32) juce::ByteOrder::littleEndianInt (p) * (1.0f / 2147483648.0f); });
+                    break;
+
+                case Encoding::float32:
+                    if (isBigEndian) deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { auto bits = juce::ByteOrder::bigEndianInt (p);    float f; std::memcpy (&f, &bits, sizeof (f)); return f; });
+                    else             deinterleave (channelSrc, bytesPerFrame, dest, numFramesToConvert, [] (const uint8_t* p) { auto bits = juce::ByteOrder::littleEndianInt (p); float f; std::memcpy (&f, &bits, sizeof (f)); return f; });
+                    break;
+            }
+        }
+    }
+
+    // Outputs beyond the file's channels repeat its last channel
+    for (int ch = numChannels; ch < numOutputs; ++ch)
+        buffer.copyFrom (ch, startSample, buffer, numChannels - 1, startSample, numFramesToConvert);
+}
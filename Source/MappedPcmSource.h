@@ -0,0 +1,74 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Plays an uncompressed WAV or AIFF file straight from a memory mapping.
+//
+// getNextAudioBlock() converts from the mapped pages directly into the output
+// buffer, with SSE2/NEON kernels for 16-bit mono and stereo (the usual sample
+// format), so there are no read calls and no intermediate buffers on the
+// audio thread. Pages are faulted in ahead of playback: half a second from the
+// start position when the source is created, the rest by a job on the pool
+// passed to startPrefaulting().
+//
+// create() returns nullptr for anything else (compressed formats, 8-bit,
+// RF64, unreadable headers), which callers play through a format reader.
+//==============================================================================
+class MappedPcmSource : public juce::PositionableAudioSource
+{
+public:
+    // Playback begins startSeconds into the file
+    static std::unique_ptr<MappedPcmSource> create (const juce::File& file, double startSeconds = 0.0);
+    ~MappedPcmSource() override;
+
+    double getSampleRate() const { return sampleRate; }
+    int getNumChannels() const { return numChannels; }
+
+    void startPrefaulting (juce::ThreadPool& pool);
+
+    // PositionableAudioSource
+    void prepareToPlay (int, double) override {}
+    void releaseResources() override {}
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& info) override;
+
+    void setNextReadPosition (juce::int64 newPosition) override { nextReadPosition = newPosition; }
+    juce::int64 getNextReadPosition() const override           { return nextReadPosition.load(); }
+    juce::int64 getTotalLength() const override                { return numFrames; }
+    bool isLooping() const override                            { return looping.load(); }
+    void setLooping (bool shouldLoop) override                 { looping = shouldLoop; }
+
+    enum class Encoding
+    {
+        int16, int24, int32, float32
+    };
+
+private:
+    // Shared with the prefault job, which may outlive the source
+    struct Mapping
+    {
+        std::unique_ptr<juce::MemoryMappedFile> file;
+        const uint8_t* data = nullptr;      // first sample frame
+        size_t numBytes = 0;
+        std::atomic<bool> cancelled { false };
+    };
+
+    MappedPcmSource() = default;
+
+    static void touchPages (const Mapping& mapping, size_t startByte, size_t endByte);
+    void convert (juce::int64 startFrame, int numFramesToConvert, juce::AudioBuffer<float>& buffer, int startSample) const;
+
+    std::shared_ptr<Mapping> mapping;
+
+    Encoding encoding = Encoding::int16;
+    bool isBigEndian = false;
+    int numChannels = 0;
+    int bytesPerSample = 0;
+    int bytesPerFrame = 0;
+    double sampleRate = 0.0;
+    juce::int64 numFrames = 0;
+
+    std::atomic<juce::int64> nextReadPosition { 0 };
+    std::atomic<bool> looping { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MappedPcmSource)
+};
@@ -0,0 +1,164 @@
+#include "MetadataCache.h"
+
+//==============================================================================
+bool MetadataCache::lookup (const juce::File& file, CachedMetadata& metadata) const
+{
+    if (! lookup (file.getFullPathName(), metadata))
+        return false;
+
+    return metadata.fileSize == file.getSize()
+        && metadata.modificationTime == file.getLastModificationTime().toMilliseconds();
+}
+
+bool MetadataCache::lookup (const juce::String& path, CachedMetadata& metadata) const
+{
+    const juce::ScopedLock sl (lock);
+
+    auto it = entries.find (path);
+    if (it == entries.end())
+        return false;
+
+    metadata = it->second;
+    return true;
+}
+
+void MetadataCache::store (const juce::String& path, const CachedMetadata& metadata)
+{
+    const juce::ScopedLock sl (lock);
+    entries[path] = metadata;
+    changed = true;
+}
+
+void MetadataCache::setPcmHash (const juce::String& path, uint64_t hash)
+{
+    const juce::ScopedLock sl (lock);
+
+    auto it = entries.find (path);
+    if (it != entries.end())
+    {
+        it->second.pcmHash = hash;
+        changed = true;
+    }
+}
+
+juce::int64 MetadataCache::getMemoryUsage() const
+{
+    const juce::ScopedLock sl (lock);
+
+    juce::int64 bytes = 0;
+    for (auto& entry : entries)
+        bytes += entry.first.getNumBytesAsUTF8() + (juce::int64) (sizeof (entry) + 2 * sizeof (void*));
+
+    return bytes;
+}
+
+//==============================================================================
+void MetadataCache::writeMetadata (juce::OutputStream& out, const CachedMetadata& metadata)
+{
+    out.writeInt64 (metadata.modificationTime);
+    out.writeInt64 (metadata.fileSize);
+    out.writeInt64 (metadata.lengthInSamples);
+    out.writeDouble (metadata.sampleRate);
+    out.writeInt (metadata.numChannels);
+    out.writeInt64 ((juce::int64) metadata.pcmHash);
+    out.writeDouble (metadata.embedded.bpm);
+    out.writeInt (metadata.embedded.numBeats);
+    out.writeInt (metadata.embedded.keyPitchClass);
+    out.writeInt ((int) metadata.embedded.keyScale);
+    out.writeInt ((int) metadata.embedded.typeHint);
+    out.writeBool (metadata.loudness.isMeasured);
+    out.writeFloat (metadata.loudness.integratedLufs);
+    out.writeFloat (metadata.loudness.truePeakDb);
+    out.writeFloat (metadata.loudness.rmsDb);
+    out.writeInt64 (metadata.onsetSample);
+}
+
+CachedMetadata MetadataCache::readMetadata (juce::InputStream& in)
+{
+    CachedMetadata metadata;
+    metadata.modificationTime = in.readInt64();
+    metadata.fileSize = in.readInt64();
+    metadata.lengthInSamples = in.readInt64();
+    metadata.sampleRate = in.readDouble();
+    metadata.numChannels = in.readInt();
+    metadata.pcmHash = (uint64_t) in.readInt64();
+    metadata.embedded.bpm = in.readDouble();
+    metadata.embedded.numBeats = in.readInt();
+    metadata.embedded.keyPitchClass = in.readInt();
+    metadata.embedded.keyScale = (EmbeddedMetadata::KeyScale) juce::jlimit (0, 2, in.readInt());
+    metadata.embedded.typeHint = (FilenameHints::TypeHint) juce::jlimit (0, 2, in.readInt());
+    metadata.loudness.isMeasured = in.readBool();
+    metadata.loudness.integratedLufs = in.readFloat();
+    metadata.loudness.truePeakDb = in.readFloat();
+    metadata.loudness.rmsDb = in.readFloat();
+    metadata.onsetSample = in.readInt64();
+    return metadata;
+}
+
+//==============================================================================
+static constexpr int cacheFileMagic = 0x43535853;  // "SXSC"
+static constexpr int cacheFileVersion = 4;
+
+bool MetadataCache::save (const juce::File& file)
+{
+    const juce::ScopedLock sl (lock);
+
+    juce::TemporaryFile temp (file);
+    {
+        juce::FileOutputStream out (temp.getFile());
+        if (! out.openedOk())
+            return false;
+
+        out.writeInt (cacheFileMagic);
+        out.writeInt (cacheFileVersion);
+        out.writeInt ((int) entries.size());
+
+        for (auto& entry : entries)
+        {
+            out.writeString (entry.first);
+            writeMetadata (out, entry.second);
+        }
+
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+
+    if (! temp.overwriteTargetFileWithTemporary())
+        return false;
+
+    changed = false;
+    return true;
+}
+
+bool MetadataCache::load (const juce::File& file)
+{
+    juce::FileInputStream in (file);
+    if (! in.openedOk())
+        return false;
+
+    if (in.readInt() != cacheFileMagic || in.readInt() != cacheFileVersion)
+        return false;
+
+    auto numEntries = in.readInt();
+    if (numEntries < 0)
+        return false;
+
+    // Not reserved from numEntries: a corrupt count would allocate before
+    // the short read shows it up
+    std::unordered_map<juce::String, CachedMetadata> loaded;
+
+    for (int i = 0; i < numEntries && ! in.isExhausted(); ++i)
+    {
+        auto path = in.readString();
+        loaded[path] = readMetadata (in);
+    }
+
+    if ((int) loaded.size() != numEntries)
+        return false;
+
+    const juce::ScopedLock sl (lock);
+    entries = std::move (loaded);
+    changed = false;
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <JuceHeader.h>
+#include "EmbeddedMetadata.h"
+#include "LoudnessAnalyzer.h"
+
+//==============================================================================
+// Per-file audio properties remembered between sessions.
+//
+// Entries are keyed by full path and only trusted while the file's size and
+// modification time still match, so a rescan can skip opening unchanged files.
+// All methods are thread-safe.
+//==============================================================================
+struct CachedMetadata
+{
+    juce::int64 modificationTime = 0;
+    juce::int64 fileSize = 0;
+
+    juce::int64 lengthInSamples = 0;
+    double sampleRate = 0.0;          // 0 if no format could read the file
+    int numChannels = 0;
+
+    // Hash of the decoded audio: 0 until computed, pcmHashFailed if the file
+    // couldn't be decoded to the end (so it isn't tried again)
+    uint64_t pcmHash = 0;
+    static constexpr uint64_t pcmHashFailed = ~(uint64_t) 0;
+
+    EmbeddedMetadata embedded;        // tempo, key and loop info from the file's own tags
+
+    LoudnessAnalyzer::Measurement loudness;
+    juce::int64 onsetSample = 0;      // where the audio starts, past any leading silence
+
+    double getLengthSeconds() const   { return sampleRate > 0.0 ? (double) lengthInSamples / sampleRate : 0.0; }
+    bool hasPcmHash() const           { return pcmHash != 0 && pcmHash != pcmHashFailed; }
+};
+
+class MetadataCache
+{
+public:
+    MetadataCache() = default;
+
+    // Fills metadata and returns true if there is an entry that is still current
+    bool lookup (const juce::File& file, CachedMetadata& metadata) const;
+
+    // Lookup by path alone, for files known to be current
+    bool lookup (const juce::String& path, CachedMetadata& metadata) const;
+
+    void store (const juce::String& path, const CachedMetadata& metadata);
+    void setPcmHash (const juce::String& path, uint64_t hash);
+
+    bool hasChanged() const { return changed.load(); }
+
+    // Approximate heap use in bytes
+    juce::int64 getMemoryUsage() const;
+
+    bool save (const juce::File& file);
+    bool load (const juce::File& file);
+
+    // The binary form of one entry, shared with LibraryIndexFile
+    static void writeMetadata (juce::OutputStream& out, const CachedMetadata& metadata);
+    static CachedMetadata readMetadata (juce::InputStream& in);
+
+private:
+    juce::CriticalSection lock;
+    std::unordered_map<juce::String, CachedMetadata> entries;
+    std::atomic<bool> changed { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MetadataCache)
+};
@@ -0,0 +1,63 @@
+#include "OnsetDetector.h"
+#include "TimbreAnalyzer.h"
+
+//==============================================================================
+juce::int64 OnsetDetector::findFirstOnset (juce::AudioFormatReader& reader, float peakDb)
+{
+    auto sampleRate = reader.sampleRate;
+    auto numChannels = (int) reader.numChannels;
+
+    if (sampleRate <= 0.0 || numChannels <= 0 || peakDb <= minThresholdDb)
+        return 0;
+
+    auto threshold = juce::Decibels::decibelsToGain (juce::jmax (minThresholdDb, peakDb - thresholdBelowPeakDb));
+
+    auto numFrames = juce::jmin (reader.lengthInSamples, (juce::int64) (sampleRate * maxSecondsToSearch));
+    readBuffer.setSize (numChannels, blockSize, false, false, true);
+
+    for (juce::int64 position = 0; position < numFrames; position += blockSize)
+    {
+        auto numSamples = (int) juce::jmin ((juce::int64) blockSize, numFrames - position);
+
+        if (! reader.read (&readBuffer, 0, numSamples, position, true, true))
+            return 0;
+
+        for (int window = 0; window < numSamples; window += windowSize)
+        {
+            auto length = juce::jmin (windowSize, numSamples - window);
+            float energy = 0.0f;
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                auto* samples = readBuffer.getReadPointer (ch, window);
+                energy += TimbreAnalyzer::dotProduct (samples, samples, length);
+            }
+
+            if (energy <= threshold * threshold * (float) (length * numChannels))
+                continue;
+
+            // A window's RMS never exceeds its largest sample, so one of them
+            // is over the threshold
+            auto first = length;
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                auto* samples = readBuffer.getReadPointer (ch, window);
+
+                for (int i = 0; i < first; ++i)
+                {
+                    if (std::abs (samples[i]) > threshold)
+                    {
+                        first = i;
+                        break;
+                    }
+                }
+            }
+
+            auto onset = position + window + juce::jmin (first, length - 1);
+            return juce::jmax ((juce::int64) 0, onset - (juce::int64) (sampleRate * preRollSeconds));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Finds where a sample's audio actually starts, so previews can skip leading
+// silence and pre-roll.
+//
+// The opening seconds are cut into short windows and the first window whose
+// mean-square energy (all channels) comes within thresholdBelowPeakDb of the
+// file's peak marks the onset; it's then narrowed to the first sample over
+// the threshold and moved back by a few milliseconds so the attack survives
+// the voice's fade-in. Window energies are dot products the compiler
+// vectorises, so the search costs little next to decoding.
+//==============================================================================
+class OnsetDetector
+{
+public:
+    // Returns the sample the first onset starts at, or 0 if the audio starts
+    // straight away, is silent, or stays quiet for longer than the search
+    juce::int64 findFirstOnset (juce::AudioFormatReader& reader, float peakDb);
+
+private:
+    static constexpr int windowSize = 64;
+    static constexpr int blockSize = windowSize * 64;
+    static constexpr double maxSecondsToSearch = 5.0;
+    static constexpr double preRollSeconds = 0.005;
+    static constexpr float thresholdBelowPeakDb = 36.0f;
+    static constexpr float minThresholdDb = -60.0f;
+
+    juce::AudioBuffer<float> readBuffer;
+};
@@ -0,0 +1,99 @@
+#include "PerformanceCounters.h"
+
+#if JUCE_MAC
+ #include <mach/mach.h>
+#elif JUCE_LINUX
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+void LatencyHistogram::record (double milliseconds) noexcept
+{
+    auto microseconds = juce::jmax (1.0, milliseconds * 1000.0);
+    auto bucket = juce::jlimit (0, numBuckets - 1, (int) (std::log2 (microseconds) * 4.0));
+
+    buckets[(size_t) bucket].fetch_add (1, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const noexcept
+{
+    Snapshot snapshot;
+
+    for (size_t i = 0; i < snapshot.size(); ++i)
+        snapshot[i] = buckets[i].load (std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+juce::int64 LatencyHistogram::getCount (const Snapshot& current, const Snapshot& previous)
+{
+    juce::int64 count = 0;
+
+    for (size_t i = 0; i < current.size(); ++i)
+        count += current[i] - previous[i];
+
+    return count;
+}
+
+double LatencyHistogram::getPercentile (const Snapshot& current, const Snapshot& previous, double fraction)
+{
+    auto count = getCount (current, previous);
+    if (count == 0)
+        return 0.0;
+
+    auto target = juce::jmax ((juce::int64) 1, (juce::int64) std::ceil (fraction * (double) count));
+    juce::int64 seen = 0;
+
+    for (size_t i = 0; i < current.size(); ++i)
+    {
+        seen += current[i] - previous[i];
+
+        if (seen >= target)
+            return std::exp2 ((double) (i + 1) / 4.0) / 1000.0;
+    }
+
+    return std::exp2 ((double) numBuckets / 4.0) / 1000.0;
+}
+
+//==============================================================================
+PerformanceCounters& PerformanceCounters::getInstance()
+{
+    static PerformanceCounters instance;
+    return instance;
+}
+
+void PerformanceCounters::recordAudioCallback (juce::int64 elapsedTicks, int numSamples, double sampleRate) noexcept
+{
+    if (sampleRate <= 0.0 || numSamples <= 0)
+        return;
+
+    auto blockTicks = (juce::int64) ((double) numSamples / sampleRate
+                                       * (double) juce::Time::getHighResolutionTicksPerSecond());
+
+    audioCallbackTicks.fetch_add (elapsedTicks, std::memory_order_relaxed);
+    audioBlockTicks.fetch_add (blockTicks, std::memory_order_relaxed);
+
+    auto load = (float) elapsedTicks / (float) juce::jmax ((juce::int64) 1, blockTicks);
+    auto peak = peakAudioLoad.load (std::memory_order_relaxed);
+
+    while (load > peak && ! peakAudioLoad.compare_exchange_weak (peak, load, std::memory_order_relaxed))
+    {
+    }
+}
+
+juce::int64 PerformanceCounters::getResidentMemoryBytes()
+{
+   #if JUCE_LINUX
+    juce::StringArray fields;
+    fields.addTokens (juce::File ("/proc/self/statm").loadFileAsString(), " ", {});
+    return fields[1].getLargeIntValue() * (juce::int64) sysconf (_SC_PAGESIZE);
+   #elif JUCE_MAC
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info (mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS)
+        return (juce::int64) info.resident_size;
+    return 0;
+   #else
+    return 0;
+   #endif
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Latency distribution in quarter-octave buckets from 1 us to ~17 s.
+//
+// record() is a single relaxed atomic increment, so any thread may call it.
+// Readers take snapshots and subtract an earlier one to look at a window.
+//==============================================================================
+class LatencyHistogram
+{
+public:
+    static constexpr int numBuckets = 96;
+    using Snapshot = std::array<juce::int64, numBuckets>;
+
+    void record (double milliseconds) noexcept;
+
+    Snapshot getSnapshot() const noexcept;
+
+    // Upper bound of the bucket holding the given fraction of the recordings
+    // in (current - previous), or 0 if there were none
+    static double getPercentile (const Snapshot& current, const Snapshot& previous, double fraction);
+    static juce::int64 getCount (const Snapshot& current, const Snapshot& previous);
+
+private:
+    std::array<std::atomic<juce::int64>, numBuckets> buckets {};
+};
+
+//==============================================================================
+// Process-wide performance counters, sampled by the performance HUD.
+//
+// Subsystems update these with relaxed atomics and never lock, so the audio
+// callback may write its counters too. Counters only ever grow; readers work
+// with the difference between two samples.
+//==============================================================================
+struct PerformanceCounters
+{
+    static PerformanceCounters& getInstance();
+
+    // Scanning
+    std::atomic<juce::int64> filesAnalysed { 0 };
+    std::atomic<juce::int64> metadataCacheHits { 0 };
+    std::atomic<juce::int64> metadataCacheMisses { 0 };
+    std::atomic<int> analysisQueueDepth { 0 };         // files waiting in the current scan
+    std::atomic<int> analysisWorkers { 0 };            // worker processes running
+    std::atomic<juce::int64> analysisWorkerRestarts { 0 };
+    std::atomic<juce::int64> filesQuarantined { 0 };
+    std::atomic<bool> analysingInProcess { false };    // no worker executable, or it wouldn't start
+
+    // Queries, timed on the query thread (cancelled queries excluded)
+    LatencyHistogram queryLatency;
+
+    // File list: time spent in paintCell per painted frame
+    LatencyHistogram paintCellFrameTime;
+    std::atomic<juce::int64> paintCellCalls { 0 };
+
+    // Audio callback: time spent vs. the real time the block covers
+    std::atomic<juce::int64> audioCallbackTicks { 0 };
+    std::atomic<juce::int64> audioBlockTicks { 0 };
+    std::atomic<float> peakAudioLoad { 0.0f };          // reset by whoever reads it
+
+    void recordAudioCallback (juce::int64 elapsedTicks, int numSamples, double sampleRate) noexcept;
+
+    // Preview
+    std::atomic<int> previewVoices { 0 };              // sounding now
+    std::atomic<juce::int64> pooledReaderHits { 0 };
+    std::atomic<juce::int64> pooledReaderMisses { 0 };
+
+    // Estimated heap use, refreshed by each subsystem when it changes
+    std::atomic<juce::int64> libraryBytes { 0 };
+    std::atomic<juce::int64> similarityIndexBytes { 0 };
+    std::atomic<juce::int64> metadataCacheBytes { 0 };
+
+    // Whole process, from the OS (0 where unsupported)
+    static juce::int64 getResidentMemoryBytes();
+};
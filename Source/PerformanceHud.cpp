@@ -0,0 +1,163 @@
+#include "PerformanceHud.h"
+#include "LookAndFeel.h"
+#include "PreviewVoicePool.h"
+
+//==============================================================================
+PerformanceHud::PerformanceHud()
+{
+    // Purely informational: clicks go to whatever is underneath
+    setInterceptsMouseClicks (false, false);
+    setVisible (false);
+}
+
+void PerformanceHud::visibilityChanged()
+{
+    if (isVisible())
+    {
+        previous = takeSample();
+        lines.clear();
+        lastMemoryRefreshTime = 0.0;
+        startTimerHz (4);
+    }
+    else
+    {
+        stopTimer();
+    }
+}
+
+PerformanceHud::Sample PerformanceHud::takeSample()
+{
+    auto& counters = PerformanceCounters::getInstance();
+
+    Sample sample;
+    sample.time = juce::Time::getMillisecondCounterHiRes();
+    sample.filesAnalysed = counters.filesAnalysed.load();
+    sample.metadataCacheHits = counters.metadataCacheHits.load();
+    sample.metadataCacheMisses = counters.metadataCacheMisses.load();
+    sample.paintCellCalls = counters.paintCellCalls.load();
+    sample.audioCallbackTicks = counters.audioCallbackTicks.load();
+    sample.audioBlockTicks = counters.audioBlockTicks.load();
+    sample.queryLatency = counters.queryLatency.getSnapshot();
+    sample.paintCellFrameTime = counters.paintCellFrameTime.getSnapshot();
+    return sample;
+}
+
+void PerformanceHud::timerCallback()
+{
+    auto current = takeSample();
+    auto seconds = (current.time - previous.time) / 1000.0;
+
+    // Average over about a second so the numbers are readable
+    if (seconds < 1.0)
+        return;
+
+    auto& counters = PerformanceCounters::getInstance();
+
+    auto formatMs = [] (double ms) { return juce::String (ms, ms < 10.0 ? 2 : 1) + " ms"; };
+
+    auto formatPercentiles = [&formatMs] (const LatencyHistogram::Snapshot& now, const LatencyHistogram::Snapshot& before)
+    {
+        if (LatencyHistogram::getCount (now, before) == 0)
+            return juce::String ("-");
+
+        return formatMs (LatencyHistogram::getPercentile (now, before, 0.5)) + " / "
+                 + formatMs (LatencyHistogram::getPercentile (now, before, 0.99));
+    };
+
+    lines.clearQuick();
+
+    // Scanning
+    auto filesPerSecond = (double) (current.filesAnalysed - previous.filesAnalysed) / seconds;
+    lines.add ("Scan: " + juce::String (filesPerSecond, 0) + " files/s, queue "
+                 + juce::String (counters.analysisQueueDepth.load()));
+
+    auto cacheLookups = (current.metadataCacheHits - previous.metadataCacheHits)
+                          + (current.metadataCacheMisses - previous.metadataCacheMisses);
+    auto totalLookups = current.metadataCacheHits + current.metadataCacheMisses;
+
+    if (cacheLookups > 0)
+        lines.add ("Metadata cache hits: " + juce::String (100.0 * (double) (current.metadataCacheHits - previous.metadataCacheHits)
+                                                              / (double) cacheLookups, 1) + "%");
+    else if (totalLookups > 0)
+        lines.add ("Metadata cache hits: " + juce::String (100.0 * (double) current.metadataCacheHits
+                                                              / (double) totalLookups, 1) + "% (total)");
+    else
+        lines.add ("Metadata cache hits: -");
+
+    // Without workers a crashing decoder takes the host down with it
+    if (counters.analysingInProcess.load())
+        lines.add ("Workers: none, analysing in-process");
+    else
+        lines.add ("Workers: " + juce::String (counters.analysisWorkers.load()) + " running, "
+                     + juce::String (counters.analysisWorkerRestarts.load()) + " restarts, "
+                     + juce::String (counters.filesQuarantined.load()) + " quarantined");
+
+    // Latency, p50 / p99
+    lines.add ("Query p50/p99: " + formatPercentiles (current.queryLatency, previous.queryLatency));
+    lines.add ("paintCell/frame p50/p99: " + formatPercentiles (current.paintCellFrameTime, previous.paintCellFrameTime));
+    lines.add ("paintCell calls: " + juce::String ((double) (current.paintCellCalls - previous.paintCellCalls) / seconds, 0) + "/s");
+
+    // Audio callback load: time spent over the real time the blocks covered
+    auto blockTicks = current.audioBlockTicks - previous.audioBlockTicks;
+    auto peakLoad = counters.peakAudioLoad.exchange (0.0f);
+
+    if (blockTicks > 0)
+        lines.add ("Audio load: " + juce::String (100.0 * (double) (current.audioCallbackTicks - previous.audioCallbackTicks)
+                                                    / (double) blockTicks, 1)
+                     + "% avg, " + juce::String (100.0f * peakLoad, 1) + "% peak");
+    else
+        lines.add ("Audio load: idle");
+
+    // Preview voices, and how often a preview found its reader still open
+    auto readerLookups = counters.pooledReaderHits.load() + counters.pooledReaderMisses.load();
+
+    lines.add ("Preview: " + juce::String (counters.previewVoices.load()) + "/" + juce::String (PreviewVoicePool::maxVoices)
+                 + " voices, reader reuse "
+                 + (readerLookups > 0 ? juce::String (100.0 * (double) counters.pooledReaderHits.load() / (double) readerLookups, 0) + "%"
+                                      : juce::String ("-")));
+
+    // Memory
+    if (refreshMemoryEstimate != nullptr && current.time - lastMemoryRefreshTime >= memoryRefreshIntervalMs)
+    {
+        lastMemoryRefreshTime = current.time;
+        refreshMemoryEstimate();
+    }
+
+    auto formatBytes = [] (juce::int64 bytes) { return juce::File::descriptionOfSizeInBytes (bytes); };
+
+    lines.add ("Library: " + formatBytes (counters.libraryBytes.load()));
+    lines.add ("Similarity index: " + formatBytes (counters.similarityIndexBytes.load()));
+    lines.add ("Metadata cache: " + formatBytes (counters.metadataCacheBytes.load()));
+
+    if (auto resident = PerformanceCounters::getResidentMemoryBytes(); resident > 0)
+        lines.add ("Process resident: " + formatBytes (resident));
+
+    previous = current;
+    repaint();
+}
+
+void PerformanceHud::paint (juce::Graphics& g)
+{
+    using LF = SoundXplorerLookAndFeel;
+
+    auto bounds = getLocalBounds().toFloat();
+    g.setColour (juce::Colour (LF::bgDark).withAlpha (0.88f));
+    g.fillRoundedRectangle (bounds, LF::radiusSmall);
+    g.setColour (juce::Colour (LF::bgHighlight));
+    g.drawRoundedRectangle (bounds.reduced (0.5f), LF::radiusSmall, 1.0f);
+
+    auto area = getLocalBounds().reduced (10, 8);
+
+    g.setColour (juce::Colour (LF::rausch));
+    g.setFont (LF::getBoldFont (11.0f));
+    g.drawText ("Performance", area.removeFromTop (16), juce::Justification::centredLeft);
+
+    g.setColour (juce::Colour (LF::textSecondary));
+    g.setFont (LF::getBookFont (11.0f));
+
+    if (lines.isEmpty())
+        g.drawText ("Sampling...", area.removeFromTop (16), juce::Justification::centredLeft);
+
+    for (auto& line : lines)
+        g.drawText (line, area.removeFromTop (16), juce::Justification::centredLeft, true);
+}
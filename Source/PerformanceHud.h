@@ -0,0 +1,57 @@
+#pragma once
+#include <JuceHeader.h>
+#include "PerformanceCounters.h"
+
+//==============================================================================
+// Overlay showing live figures from PerformanceCounters: scan throughput,
+// query and paint latency, cache hit rate, audio load, preview voices and
+// memory.
+//
+// It samples the counters a few times a second while visible and shows the
+// change over the last second or so, so it costs nothing while hidden. The
+// memory figures take a walk over the library, so they are refreshed through
+// refreshMemoryEstimate, and only every few seconds.
+//==============================================================================
+class PerformanceHud : public juce::Component,
+                       private juce::Timer
+{
+public:
+    PerformanceHud();
+    ~PerformanceHud() override = default;
+
+    void paint (juce::Graphics& g) override;
+    void visibilityChanged() override;
+
+    // Called on the message thread to update the memory counters
+    std::function<void()> refreshMemoryEstimate;
+
+    // Size that fits all lines
+    static constexpr int preferredWidth = 270;
+    static constexpr int preferredHeight = 232;
+
+private:
+    static constexpr double memoryRefreshIntervalMs = 5000.0;
+
+    void timerCallback() override;
+
+    struct Sample
+    {
+        double time = 0.0;
+        juce::int64 filesAnalysed = 0;
+        juce::int64 metadataCacheHits = 0;
+        juce::int64 metadataCacheMisses = 0;
+        juce::int64 paintCellCalls = 0;
+        juce::int64 audioCallbackTicks = 0;
+        juce::int64 audioBlockTicks = 0;
+        LatencyHistogram::Snapshot queryLatency {};
+        LatencyHistogram::Snapshot paintCellFrameTime {};
+    };
+
+    static Sample takeSample();
+
+    Sample previous;
+    juce::StringArray lines;
+    double lastMemoryRefreshTime = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerformanceHud)
+};
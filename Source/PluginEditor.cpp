@@ -1,18 +1,72 @@
 #include "PluginEditor.h"
+#include "TraceRecorder.h"
+#include "BatchExporter.h"
+
+namespace
+{
+    // Runs a batch export behind a progress bar with a cancel button, then
+    // reports back and deletes itself
+    class ExportProgressWindow : public juce::ThreadWithProgressWindow
+    {
+    public:
+        ExportProgressWindow (const BatchExporter::Settings& settings, const juce::Array<juce::File>& filesToExport,
+                              std::function<void (const BatchExporter::Result&)> completionCallback)
+            : juce::ThreadWithProgressWindow ("Exporting " + juce::String (filesToExport.size()) + " samples", true, true, 30000),
+              exporter (settings),
+              files (filesToExport),
+              onComplete (std::move (completionCallback))
+        {
+        }
+
+        void run() override
+        {
+            result = exporter.run (files, [this] (float progress)
+            {
+                setProgress (progress);
+                return ! threadShouldExit();
+            });
+        }
+
+        void threadComplete (bool) override
+        {
+            if (onComplete)
+                onComplete (result);
+
+            delete this;
+        }
+
+    private:
+        BatchExporter exporter;
+        juce::Array<juce::File> files;
+        BatchExporter::Result result;
+        std::function<void (const BatchExporter::Result&)> onComplete;
+    };
+}
 
 //==============================================================================
 SoundXplorerEditor::SoundXplorerEditor (SoundXplorerProcessor& p)
     : AudioProcessorEditor (&p),
       processor (p),
+      viewModel (p.getViewModel()),
       libraryBrowser (p.getSampleLibrary()),
       fileList (p.getSampleLibrary()),
-      transportBar (p.getPreviewEngine())
+      transportBar (p.getPreviewEngine()),
+      queryWorker (p.getSampleLibrary())
 {
     setLookAndFeel (&lookAndFeel);
 
     // Listen for library changes
     processor.getSampleLibrary().addChangeListener (this);
 
+    // Query results arrive asynchronously from the worker thread
+    queryWorker.onResultsReady = [this] (const juce::Array<SampleItem>& samples, const SampleLibrary::TagCounts& facetCounts)
+    {
+        onResultsReady (samples, facetCounts);
+    };
+
+    // A host restoring its project while the window is open
+    viewModel.onStateRestored = [this] { restoreViewState(); };
+
     // ─── Search bar ───
     searchBar.onSearchChanged = [this] (const juce::String& q) { onSearchChanged (q); };
     addAndMakeVisible (searchBar);
@@ -31,6 +85,20 @@ SoundXplorerEditor::SoundXplorerEditor (SoundXplorerProcessor& p)
     fileList.onSampleSelected = [this] (const SampleItem& item) { onSampleSelected (item); };
     fileList.onSampleDoubleClicked = [this] (const SampleItem& item) { onSampleDoubleClicked (item); };
     fileList.onFavoriteToggled = [this] (const juce::File& file) { onFavoriteToggled (file); };
+    fileList.onFindSimilar = [this] (const SampleItem& item) { onFindSimilar (item); };
+    fileList.onShowDuplicates = [this] (const SampleItem& item) { onShowDuplicates (item); };
+    fileList.onExport = [this] (const juce::Array<juce::File>& files) { exportSamples (files); };
+    fileList.onHideDuplicatesChanged = [this] (bool shouldHide)
+    {
+        auto query = viewModel.getQuery();
+        query.hideDuplicates = shouldHide;
+        viewModel.setQuery (query);
+
+        fileList.setHideDuplicates (shouldHide);
+        refreshFileList();
+    };
+    fileList.onSortOrderChanged = [this] (int columnId, bool forward) { viewModel.setSortOrder (columnId, forward); };
+    fileList.onScrolled = [this] (int position) { viewModel.setScrollPosition (position); };
     addAndMakeVisible (fileList);
 
     // ─── Tag filter ───
@@ -52,7 +120,10 @@ SoundXplorerEditor::SoundXplorerEditor (SoundXplorerProcessor& p)
     favoritesButton.setColour (juce::TextButton::textColourOffId, juce::Colour (SoundXplorerLookAndFeel::textTertiary));
     favoritesButton.onClick = [this]
     {
-        showFavoritesOnly = favoritesButton.getToggleState();
+        auto query = viewModel.getQuery();
+        query.favoritesOnly = favoritesButton.getToggleState();
+        viewModel.setQuery (query);
+
         refreshFileList();
     };
     addAndMakeVisible (favoritesButton);
@@ -67,8 +138,16 @@ SoundXplorerEditor::SoundXplorerEditor (SoundXplorerProcessor& p)
         sidebarButtons.add (btn);
     }
 
-    // Initial refresh
-    refreshFileList();
+    // The gear opens the diagnostics menu
+    sidebarButtons.getLast()->onClick = [this] { showDiagnosticsMenu(); };
+
+    // ─── Performance HUD (hidden until toggled) ───
+    addChildComponent (performanceHud);
+    performanceHud.refreshMemoryEstimate = [this] { processor.getSampleLibrary().updateMemoryEstimate(); };
+    setWantsKeyboardFocus (true);
+
+    // Pick up where the last editor left off
+    restoreViewState();
 
     // Set size
     setSize (1200, 700);
@@ -79,6 +158,7 @@ SoundXplorerEditor::SoundXplorerEditor (SoundXplorerProcessor& p)
 SoundXplorerEditor::~SoundXplorerEditor()
 {
     processor.getSampleLibrary().removeChangeListener (this);
+    viewModel.onStateRestored = nullptr;
     setLookAndFeel (nullptr);
 }
 
@@ -112,9 +192,10 @@ void SoundXplorerEditor::paintOverChildren (juce::Graphics& g)
     // Draw heart icon on favorites button
     {
         auto b = favoritesButton.getBounds().toFloat().reduced (5.0f);
+        auto favoritesOnly = favoritesButton.getToggleState();
         LF::drawHeartIcon (g, b,
-            showFavoritesOnly ? juce::Colour (LF::heartColor) : juce::Colour (LF::textTertiary),
-            showFavoritesOnly);
+            favoritesOnly ? juce::Colour (LF::heartColor) : juce::Colour (LF::textTertiary),
+            favoritesOnly);
     }
 }
 
@@ -153,6 +234,144 @@ void SoundXplorerEditor::resized()
 
     // ─── File list (main area) ───
     fileList.setBounds (bounds);
+
+    // ─── Performance HUD, over the top-right of the file list ───
+    performanceHud.setBounds (bounds.getRight() - PerformanceHud::preferredWidth - 8, bounds.getY() + 28,
+                              PerformanceHud::preferredWidth, PerformanceHud::preferredHeight);
+}
+
+void SoundXplorerEditor::showDiagnosticsMenu()
+{
+    auto& tracer = TraceRecorder::getInstance();
+    juce::PopupMenu menu;
+
+    menu.addItem ("Show Performance HUD", true, performanceHud.isVisible(), [this]
+    {
+        performanceHud.setVisible (! performanceHud.isVisible());
+        performanceHud.toFront (false);
+    });
+
+    menu.addSeparator();
+
+    menu.addItem ("Record Trace", true, TraceRecorder::isEnabled(), [&tracer]
+    {
+        if (TraceRecorder::isEnabled())
+            tracer.stop();
+        else
+            tracer.start();
+    });
+
+    menu.addItem ("Save Trace...", [this, &tracer]
+    {
+        auto chooser = std::make_shared<juce::FileChooser> ("Save Chrome Trace",
+                                                            juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                                                                .getChildFile ("SoundXplorer-trace.json"),
+                                                            "*.json");
+
+        // The host may close the editor while the chooser is open
+        juce::Component::SafePointer<SoundXplorerEditor> safeThis (this);
+
+        chooser->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::warnAboutOverwriting,
+                              [safeThis, &tracer, chooser] (const juce::FileChooser& fc)
+        {
+            auto file = fc.getResult();
+            if (file == juce::File())
+                return;
+
+            auto written = tracer.writeChromeTrace (file);
+
+            if (safeThis != nullptr)
+                safeThis->transportBar.setStatusMessage (written ? "Trace saved to " + file.getFileName()
+                                                                 : "Couldn't write " + file.getFileName());
+        });
+    });
+
+    menu.showMenuAsync (juce::PopupMenu::Options().withTargetComponent (sidebarButtons.getLast()));
+}
+
+void SoundXplorerEditor::exportSamples (const juce::Array<juce::File>& files)
+{
+    if (files.isEmpty())
+        return;
+
+    auto* dialog = new juce::AlertWindow ("Export " + juce::String (files.size()) + (files.size() == 1 ? " Sample" : " Samples"),
+                                          "The samples are converted and written into a folder you choose next.",
+                                          juce::MessageBoxIconType::NoIcon, this);
+
+    dialog->addComboBox ("format", BatchExporter::getFormatNames(), "Format");
+    dialog->addComboBox ("rate", { "Keep original", "44100 Hz", "48000 Hz", "88200 Hz", "96000 Hz" }, "Sample rate");
+    dialog->addComboBox ("bits", { "16-bit", "24-bit", "32-bit" }, "Bit depth");
+    dialog->addComboBox ("normalise", { "Off", "Peak -1 dB", "Peak -0.1 dB" }, "Normalise");
+    dialog->getComboBoxComponent ("bits")->setSelectedItemIndex (1);
+
+    dialog->addButton ("Choose Folder...", 1, juce::KeyPress (juce::KeyPress::returnKey));
+    dialog->addButton ("Cancel", 0, juce::KeyPress (juce::KeyPress::escapeKey));
+
+    // Callbacks run before the dialog is deleted, so it can still be read.
+    // The host may close the editor while the dialog or chooser is open.
+    juce::Component::SafePointer<SoundXplorerEditor> safeThis (this);
+
+    dialog->enterModalState (true, juce::ModalCallbackFunction::create ([safeThis, dialog, files] (int button)
+    {
+        if (button != 1 || safeThis == nullptr)
+            return;
+
+        BatchExporter::Settings settings;
+        settings.formatName = dialog->getComboBoxComponent ("format")->getText();
+        settings.sampleRate = dialog->getComboBoxComponent ("rate")->getText().getDoubleValue();
+        settings.bitsPerSample = dialog->getComboBoxComponent ("bits")->getText().getIntValue();
+
+        auto normalise = dialog->getComboBoxComponent ("normalise")->getSelectedItemIndex();
+        settings.normalise = normalise > 0;
+        settings.normalisePeakDb = normalise == 2 ? -0.1f : -1.0f;
+
+        auto chooser = std::make_shared<juce::FileChooser> ("Export To",
+                                                            juce::File::getSpecialLocation (juce::File::userMusicDirectory));
+
+        chooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+                              [safeThis, chooser, settings, files] (const juce::FileChooser& fc) mutable
+        {
+            settings.destination = fc.getResult();
+            if (settings.destination == juce::File() || safeThis == nullptr)
+                return;
+
+            if (auto error = BatchExporter (settings).validate(); error.isNotEmpty())
+            {
+                safeThis->transportBar.setStatusMessage (error);
+                return;
+            }
+
+            (new ExportProgressWindow (settings, files, [safeThis, folder = settings.destination] (const BatchExporter::Result& result)
+            {
+                if (safeThis == nullptr)
+                    return;
+
+                juce::String message;
+
+                if (result.cancelled)
+                    message = "Export cancelled after " + juce::String (result.numExported) + " samples";
+                else
+                    message = "Exported " + juce::String (result.numExported) + " samples to " + folder.getFullPathName();
+
+                if (! result.failures.isEmpty())
+                    message << " (" << result.failures.size() << " failed: " << result.failures[0] << ")";
+
+                safeThis->transportBar.setStatusMessage (message);
+            }))->launchThread();
+        });
+    }), true);
+}
+
+bool SoundXplorerEditor::keyPressed (const juce::KeyPress& key)
+{
+    if (key == juce::KeyPress ('p', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0))
+    {
+        performanceHud.setVisible (! performanceHud.isVisible());
+        performanceHud.toFront (false);
+        return true;
+    }
+
+    return false;
 }
 
 //==============================================================================
@@ -161,25 +380,80 @@ void SoundXplorerEditor::changeListenerCallback (juce::ChangeBroadcaster*)
     refreshFileList();
 }
 
+void SoundXplorerEditor::restoreViewState()
+{
+    // Put the controls back as they were, without their change callbacks
+    auto query = viewModel.getQuery();
+    searchBar.setSearchText (query.searchText);
+    tagFilter.setActiveTags (query.activeTags);
+    favoritesButton.setToggleState (query.favoritesOnly, juce::dontSendNotification);
+    fileList.setHideDuplicates (query.hideDuplicates);
+
+    if (viewModel.getSortColumnId() >= 0)
+        fileList.setSortOrder (viewModel.getSortColumnId(), viewModel.isSortForward());
+
+    fileList.setScrollPosition (viewModel.getScrollPosition());
+
+    // The last result stands as long as neither the query nor the library
+    // has changed since; otherwise the query runs again
+    if (auto results = viewModel.getCurrentResults())
+    {
+        fileList.showResults (results);
+        tagFilter.setAvailableTags (processor.getSampleLibrary().getAllTags());
+        tagFilter.setTagCounts (results->facetCounts);
+    }
+    else
+    {
+        refreshFileList();
+    }
+
+    repaint();
+}
+
 void SoundXplorerEditor::refreshFileList()
 {
-    auto& library = processor.getSampleLibrary();
-    auto filtered = library.getFilteredSamples (currentSearchQuery, currentActiveTags, showFavoritesOnly);
-    fileList.updateContent (filtered);
+    const TraceScope traceScope ("refreshFileList");
+
+    // Cheap: supersedes any query still running and returns immediately
+    queryWorker.submit (viewModel.getQuery().toQuery());
+}
+
+void SoundXplorerEditor::onResultsReady (const juce::Array<SampleItem>& samples, const SampleLibrary::TagCounts& facetCounts)
+{
+    auto results = std::make_shared<BrowserViewModel::Results>();
+    results->query = viewModel.getQuery();
+    results->items = samples;
+    results->facetCounts = facetCounts;
+
+    // Sorted by the file list, then kept for the next editor
+    fileList.showResults (results);
+    viewModel.setResults (results);
 
-    // Update available tags
-    tagFilter.setAvailableTags (library.getAllTags());
+    // Update available tags and their counts within the current result
+    tagFilter.setAvailableTags (processor.getSampleLibrary().getAllTags());
+    tagFilter.setTagCounts (facetCounts);
 }
 
-void SoundXplorerEditor::onSearchChanged (const juce::String& query)
+void SoundXplorerEditor::onSearchChanged (const juce::String& text)
 {
-    currentSearchQuery = query;
+    auto query = viewModel.getQuery();
+
+    // Ranked results read best-first; going back to browsing (or to field
+    // predicates only) restores name order
+    auto hasText = SampleQuery::parse (text).text.isNotEmpty();
+    if (hasText != SampleQuery::parse (query.searchText).text.isNotEmpty())
+        fileList.setSortByRelevance (hasText);
+
+    query.searchText = text;
+    viewModel.setQuery (query);
     refreshFileList();
 }
 
 void SoundXplorerEditor::onTagFilterChanged (const juce::StringArray& tags)
 {
-    currentActiveTags = tags;
+    auto query = viewModel.getQuery();
+    query.activeTags = tags;
+    viewModel.setQuery (query);
     refreshFileList();
 }
 
@@ -191,8 +465,10 @@ void SoundXplorerEditor::onSampleSelected (const SampleItem& item)
 
 void SoundXplorerEditor::onSampleDoubleClicked (const SampleItem& item)
 {
-    // Double-click plays the sample
-    processor.getPreviewEngine().loadAndPlay (item.file);
+    // Double-click plays the sample; with shift held it layers on top of
+    // what is already playing
+    auto layered = juce::ModifierKeys::currentModifiers.isShiftDown();
+    processor.getPreviewEngine().loadAndPlay (item.file, layered, { item.loudness, item.onsetSeconds });
     transportBar.setCurrentFileName (item.name);
 }
 
@@ -201,3 +477,31 @@ void SoundXplorerEditor::onFavoriteToggled (const juce::File& file)
     processor.getSampleLibrary().toggleFavorite (file);
     refreshFileList();
 }
+
+void SoundXplorerEditor::onFindSimilar (const SampleItem& item)
+{
+    // An index lookup, cheap enough to answer right here on the message thread
+    auto similar = processor.getSampleLibrary().getSimilarSamples (item.file, 50);
+
+    auto results = std::make_shared<BrowserViewModel::Results>();
+    results->items = similar;
+
+    fileList.setSortByRelevance (true);
+    fileList.showResults (results);
+
+    transportBar.setStatusMessage (similar.isEmpty() ? "No similarity data for " + item.name + " yet"
+                                                     : "Sounds similar to " + item.name);
+}
+
+void SoundXplorerEditor::onShowDuplicates (const SampleItem& item)
+{
+    auto copies = processor.getSampleLibrary().getDuplicatesOf (item.file);
+
+    auto results = std::make_shared<BrowserViewModel::Results>();
+    results->items = copies;
+
+    fileList.setSortByRelevance (true);
+    fileList.showResults (results);
+
+    transportBar.setStatusMessage (juce::String (copies.size()) + " copies of " + item.name);
+}
@@ -7,6 +7,8 @@
 #include "FileListComponent.h"
 #include "TransportBarComponent.h"
 #include "TagFilterComponent.h"
+#include "SearchQueryWorker.h"
+#include "PerformanceHud.h"
 
 //==============================================================================
 // Main editor — assembles all UI components
@@ -21,18 +23,26 @@ public:
     void paint (juce::Graphics& g) override;
     void paintOverChildren (juce::Graphics& g) override;
     void resized() override;
+    bool keyPressed (const juce::KeyPress& key) override;
     
     void changeListenerCallback (juce::ChangeBroadcaster* source) override;
 
 private:
+    void restoreViewState();
     void refreshFileList();
-    void onSearchChanged (const juce::String& query);
+    void onResultsReady (const juce::Array<SampleItem>& samples, const SampleLibrary::TagCounts& facetCounts);
+    void onSearchChanged (const juce::String& text);
     void onTagFilterChanged (const juce::StringArray& tags);
     void onSampleSelected (const SampleItem& item);
     void onSampleDoubleClicked (const SampleItem& item);
     void onFavoriteToggled (const juce::File& file);
+    void onFindSimilar (const SampleItem& item);
+    void onShowDuplicates (const SampleItem& item);
+    void showDiagnosticsMenu();
+    void exportSamples (const juce::Array<juce::File>& files);
     
     SoundXplorerProcessor& processor;
+    BrowserViewModel& viewModel;    // query, sort, scroll and last result
     SoundXplorerLookAndFeel lookAndFeel;
     
     // UI Components
@@ -41,6 +51,9 @@ private:
     SampleFileListComponent fileList;
     TransportBarComponent transportBar;
     TagFilterComponent tagFilter;
+
+    // Toggled with Cmd/Ctrl+Shift+P
+    PerformanceHud performanceHud;
     
     // Tab bar
     juce::TabbedButtonBar tabBar { juce::TabbedButtonBar::TabsAtTop };
@@ -50,11 +63,10 @@ private:
     
     // Favorites filter button
     juce::TextButton favoritesButton;
-    bool showFavoritesOnly = false;
-    
-    // Current state
-    juce::String currentSearchQuery;
-    juce::StringArray currentActiveTags;
+
+    // Declared last so it is destroyed (and its thread stopped) before the
+    // components its callback touches
+    SearchQueryWorker queryWorker;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SoundXplorerEditor)
 };
@@ -1,32 +1,41 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "PerformanceCounters.h"
+#include "TraceRecorder.h"
 
 //==============================================================================
 SoundXplorerProcessor::SoundXplorerProcessor()
     : AudioProcessor (BusesProperties()
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true))
 {
+    TraceRecorder::getInstance().enableFromEnvironment();
 }
 
 SoundXplorerProcessor::~SoundXplorerProcessor()
 {
+    TraceRecorder::getInstance().writeEnvironmentTrace();
 }
 
 //==============================================================================
 void SoundXplorerProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     currentSampleRate = sampleRate;
-    previewEngine.getTransportSource().prepareToPlay (samplesPerBlock, sampleRate);
+    previewEngine.prepareToPlay (sampleRate, samplesPerBlock);
+
+    // processBlock() mustn't allocate its trace buffer, so it claims this one
+    TraceRecorder::getInstance().reserveAudioThreadBuffer();
 }
 
 void SoundXplorerProcessor::releaseResources()
 {
-    previewEngine.getTransportSource().releaseResources();
+    // The preview voices keep their buffers; prepareToPlay resizes them
 }
 
 void SoundXplorerProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
 {
     juce::ScopedNoDenormals noDenormals;
+    const TraceScope traceScope ("processBlock");
+    auto startTicks = juce::Time::getHighResolutionTicks();
 
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -53,8 +62,10 @@ void SoundXplorerProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce
 #endif
 
     // Get audio from preview engine
-    juce::AudioSourceChannelInfo info (&buffer, 0, buffer.getNumSamples());
-    previewEngine.getTransportSource().getNextAudioBlock (info);
+    previewEngine.getNextAudioBlock (buffer);
+
+    PerformanceCounters::getInstance().recordAudioCallback (juce::Time::getHighResolutionTicks() - startTicks,
+                                                            buffer.getNumSamples(), currentSampleRate);
 }
 
 //==============================================================================
@@ -64,14 +75,14 @@ juce::AudioProcessorEditor* SoundXplorerProcessor::createEditor()
 }
 
 //==============================================================================
-void SoundXplorerProcessor::getStateInformation (juce::MemoryBlock& /*destData*/)
+void SoundXplorerProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // Save state if needed
+    viewModel.getState (destData);
 }
 
-void SoundXplorerProcessor::setStateInformation (const void* /*data*/, int /*sizeInBytes*/)
+void SoundXplorerProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // Restore state if needed
+    viewModel.setState (data, sizeInBytes);
 }
 
 //==============================================================================
@@ -2,6 +2,7 @@
 #include <JuceHeader.h>
 #include "SampleLibrary.h"
 #include "AudioPreviewEngine.h"
+#include "BrowserViewModel.h"
 
 //==============================================================================
 // Audio processor for Sound Xplorer (works for both VST3 and Standalone)
@@ -37,10 +38,13 @@ public:
     // Shared components
     SampleLibrary& getSampleLibrary() { return sampleLibrary; }
     AudioPreviewEngine& getPreviewEngine() { return previewEngine; }
+    BrowserViewModel& getViewModel() { return viewModel; }
 
 private:
-    SampleLibrary sampleLibrary;
+    // Files are decoded in worker processes, so a malformed one can't crash the host
+    SampleLibrary sampleLibrary { {}, AnalysisWorkerPool::findWorkerExecutable() };
     AudioPreviewEngine previewEngine;
+    BrowserViewModel viewModel { sampleLibrary };
 
     double currentSampleRate = 44100.0;
 
@@ -0,0 +1,369 @@
+#include "PreviewVoicePool.h"
+#include "PerformanceCounters.h"
+
+//==============================================================================
+PreviewVoicePool::PreviewVoicePool() = default;
+PreviewVoicePool::~PreviewVoicePool() = default;
+
+void PreviewVoicePool::prepareToPlay (double newSampleRate, int maximumBlockSize)
+{
+    // Voices were set up for the old device; cutting them beats playing them
+    // at the wrong pitch
+    for (auto& voice : voices)
+        if (voice.active)
+            finishVoice (voice, false);
+
+    voiceBuffer.setSize (2, juce::jmax (1, maximumBlockSize));
+    gainRamp.allocate ((size_t) voiceBuffer.getNumSamples(), true);
+    fadeStep = (float) (1.0 / juce::jmax (1.0, fadeSeconds * newSampleRate));
+
+    blockSize = voiceBuffer.getNumSamples();
+    sampleRate = newSampleRate;
+}
+
+void PreviewVoicePool::renderNextBlock (juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    handleCommands();
+
+    buffer.clear (startSample, numSamples);
+
+    // Hosts may send blocks longer than announced, so render in pieces that
+    // fit the voice buffer
+    for (int done = 0; done < numSamples;)
+    {
+        auto numThisTime = juce::jmin (voiceBuffer.getNumSamples(), numSamples - done);
+        if (numThisTime <= 0)
+            return;
+
+        for (auto& voice : voices)
+            if (voice.active && ! voice.paused)
+                renderVoice (voice, buffer, startSample + done, numThisTime);
+
+        done += numThisTime;
+    }
+
+    auto gain = masterGain.load();
+    buffer.applyGainRamp (startSample, numSamples, lastMasterGain, gain);
+    lastMasterGain = gain;
+}
+
+void PreviewVoicePool::renderVoice (Voice& voice, juce::AudioBuffer<float>& output, int startSample, int numSamples)
+{
+    juce::AudioSourceChannelInfo info (&voiceBuffer, 0, numSamples);
+    voice.input->getNextAudioBlock (info);
+
+    // Fades are linear across the block, and gain changes ride along with them
+    if (voice.fadeLevel < voice.fadeTarget)
+        voice.fadeLevel = juce::jmin (voice.fadeTarget, voice.fadeLevel + fadeStep * (float) numSamples);
+    else if (voice.fadeLevel > voice.fadeTarget)
+        voice.fadeLevel = juce::jmax (voice.fadeTarget, voice.fadeLevel - fadeStep * (float) numSamples);
+
+    auto startGain = voice.appliedGain;
+    auto endGain = voice.fadeLevel * voice.gain;
+    voice.appliedGain = endGain;
+
+    auto numChannels = juce::jmin (output.getNumChannels(), voiceBuffer.getNumChannels());
+
+    if (startGain != endGain)
+    {
+        auto step = (endGain - startGain) / (float) numSamples;
+
+        for (int i = 0; i < numSamples; ++i)
+            gainRamp[i] = startGain + step * (float) (i + 1);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            juce::FloatVectorOperations::addWithMultiply (output.getWritePointer (ch, startSample),
+                                                          voiceBuffer.getReadPointer (ch), gainRamp.get(), numSamples);
+    }
+    else if (endGain != 0.0f)
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+            juce::FloatVectorOperations::addWithMultiply (output.getWritePointer (ch, startSample),
+                                                          voiceBuffer.getReadPointer (ch), endGain, numSamples);
+    }
+
+    auto position = voice.source->getNextReadPosition();
+    voice.position.store (position, std::memory_order_relaxed);
+
+    if (voice.fadeLevel == 0.0f && voice.fadeTarget == 0.0f)
+    {
+        if (voice.stopping)
+        {
+            finishVoice (voice, false);
+        }
+        else if (voice.pausing)
+        {
+            voice.paused = true;
+            voice.pausing = false;
+        }
+    }
+    else if (position >= voice.length && ! voice.source->isLooping())
+    {
+        finishVoice (voice, true);
+    }
+}
+
+void PreviewVoicePool::finishVoice (Voice& voice, bool reachedEnd)
+{
+    voice.active = false;
+    voice.reachedEnd.store (reachedEnd, std::memory_order_relaxed);
+    voice.finished.store (true, std::memory_order_release);
+}
+
+void PreviewVoicePool::handleCommands()
+{
+    const auto scope = commandFifo.read (commandFifo.getNumReady());
+
+    scope.forEach ([this] (int index)
+    {
+        auto& command = commands[(size_t) index];
+        auto& voice = voices[(size_t) command.voice];
+
+        if (command.type == Command::start)
+        {
+            voice.active = true;
+            voice.paused = voice.stopping = voice.pausing = false;
+            voice.gain = command.gain;
+            voice.fadeLevel = voice.appliedGain = 0.0f;
+            voice.fadeTarget = 1.0f;
+
+            // Set up before prepareToPlay moved to another device rate
+            if (voice.preparedSampleRate != sampleRate.load())
+                finishVoice (voice, false);
+
+            return;
+        }
+
+        // Commands can outlive their voice; the slot may even be reused, but
+        // then its start command comes later in the queue
+        if (! voice.active)
+            return;
+
+        switch (command.type)
+        {
+            case Command::stop:
+                voice.stopping = true;
+                voice.pausing = false;
+                voice.fadeTarget = 0.0f;
+
+                if (voice.paused)
+                    finishVoice (voice, false);
+                break;
+
+            case Command::pause:
+                if (! voice.stopping && ! voice.paused)
+                {
+                    voice.pausing = true;
+                    voice.fadeTarget = 0.0f;
+                }
+                break;
+
+            case Command::resume:
+                if (! voice.stopping)
+                {
+                    voice.paused = voice.pausing = false;
+                    voice.fadeTarget = 1.0f;
+                }
+                break;
+
+            case Command::seek:
+                // Restarts with a fade-in from the new position
+                voice.source->setNextReadPosition (command.position);
+                if (voice.resampler != nullptr)
+                    voice.resampler->flushBuffers();
+
+                voice.fadeLevel = voice.appliedGain = 0.0f;
+                voice.position.store (command.position, std::memory_order_relaxed);
+                break;
+
+            case Command::setGain:
+                voice.gain = command.gain;
+                break;
+
+            case Command::start:
+                break;
+        }
+    });
+}
+
+//==============================================================================
+bool PreviewVoicePool::post (const Command& command)
+{
+    // Only fails if the audio thread has stopped taking commands
+    const auto scope = commandFifo.write (1);
+
+    if (scope.blockSize1 == 0)
+        return false;
+
+    commands[(size_t) scope.startIndex1] = command;
+    return true;
+}
+
+int PreviewVoicePool::startVoice (std::unique_ptr<juce::PositionableAudioSource> source, double sourceSampleRate, float gain)
+{
+    auto deviceSampleRate = sampleRate.load();
+    auto maximumBlockSize = blockSize.load();
+
+    if (source == nullptr || sourceSampleRate <= 0.0 || deviceSampleRate <= 0.0)
+        return -1;
+
+    update();
+
+    // Steal the oldest voice once all are sounding; it fades out in a spare slot
+    Voice* oldest = nullptr;
+    int numSounding = 0;
+
+    for (auto& voice : voices)
+    {
+        if (voice.inUse && ! voice.stopRequested)
+        {
+            ++numSounding;
+
+            if (oldest == nullptr || voice.startOrder < oldest->startOrder)
+                oldest = &voice;
+        }
+    }
+
+    if (numSounding >= maxVoices)
+        stopVoice ((int) (oldest - voices.data()));
+
+    int slot = 0;
+    while (slot < numSlots && voices[(size_t) slot].inUse)
+        ++slot;
+
+    if (slot == numSlots)
+        return -1;
+
+    auto& voice = voices[(size_t) slot];
+    voice.source = std::move (source);
+    voice.sourceSampleRate = sourceSampleRate;
+    voice.preparedSampleRate = deviceSampleRate;
+    voice.length = voice.source->getTotalLength();
+
+    // Everything that allocates happens here, before the audio thread sees it
+    if (std::abs (sourceSampleRate - deviceSampleRate) > 0.01)
+    {
+        voice.resampler = std::make_unique<juce::ResamplingAudioSource> (voice.source.get(), false, 2);
+        voice.resampler->setResamplingRatio (sourceSampleRate / deviceSampleRate);
+        voice.resampler->prepareToPlay (maximumBlockSize, deviceSampleRate);
+        voice.input = voice.resampler.get();
+    }
+    else
+    {
+        voice.source->prepareToPlay (maximumBlockSize, deviceSampleRate);
+        voice.input = voice.source.get();
+    }
+
+    voice.position = voice.source->getNextReadPosition();
+    voice.finished = false;
+    voice.reachedEnd = false;
+    voice.stopRequested = voice.pauseRequested = false;
+    voice.startOrder = nextStartOrder++;
+
+    if (! post ({ Command::start, slot, 0, gain }))
+    {
+        voice.input = nullptr;
+        voice.resampler.reset();
+        voice.source.reset();
+        return -1;
+    }
+
+    voice.inUse = true;
+    return slot;
+}
+
+void PreviewVoicePool::stopVoice (int voice)
+{
+    if (isValid (voice) && post ({ Command::stop, voice }))
+        voices[(size_t) voice].stopRequested = true;
+}
+
+void PreviewVoicePool::stopAllVoices()
+{
+    for (int i = 0; i < numSlots; ++i)
+        if (voices[(size_t) i].inUse && ! voices[(size_t) i].stopRequested)
+            stopVoice (i);
+}
+
+void PreviewVoicePool::setVoicePaused (int voice, bool shouldBePaused)
+{
+    if (isValid (voice) && post ({ shouldBePaused ? Command::pause : Command::resume, voice }))
+        voices[(size_t) voice].pauseRequested = shouldBePaused;
+}
+
+void PreviewVoicePool::setVoicePosition (int voice, double proportion)
+{
+    if (isValid (voice))
+        post ({ Command::seek, voice, (juce::int64) (juce::jlimit (0.0, 1.0, proportion) * (double) voices[(size_t) voice].length) });
+}
+
+void PreviewVoicePool::setVoiceGain (int voice, float gain)
+{
+    if (isValid (voice))
+        post ({ Command::setGain, voice, 0, gain });
+}
+
+void PreviewVoicePool::update()
+{
+    for (int i = 0; i < numSlots; ++i)
+    {
+        auto& voice = voices[(size_t) i];
+
+        if (! voice.inUse || ! voice.finished.load (std::memory_order_acquire))
+            continue;
+
+        auto reachedEnd = voice.reachedEnd.load (std::memory_order_relaxed);
+
+        voice.input = nullptr;
+        voice.resampler.reset();
+        voice.source.reset();
+        voice.inUse = false;
+
+        if (onVoiceFinished)
+            onVoiceFinished (i, reachedEnd);
+    }
+
+    PerformanceCounters::getInstance().previewVoices = getNumSoundingVoices();
+}
+
+//==============================================================================
+bool PreviewVoicePool::isVoiceActive (int voice) const
+{
+    return isValid (voice)
+            && ! voices[(size_t) voice].stopRequested
+            && ! voices[(size_t) voice].finished.load (std::memory_order_acquire);
+}
+
+bool PreviewVoicePool::isVoicePaused (int voice) const
+{
+    return isValid (voice) && voices[(size_t) voice].pauseRequested;
+}
+
+double PreviewVoicePool::getVoicePosition (int voice) const
+{
+    if (! isValid (voice) || voices[(size_t) voice].length <= 0)
+        return 0.0;
+
+    auto& v = voices[(size_t) voice];
+    return juce::jlimit (0.0, 1.0, (double) v.position.load (std::memory_order_relaxed) / (double) v.length);
+}
+
+double PreviewVoicePool::getVoiceLengthSeconds (int voice) const
+{
+    if (! isValid (voice))
+        return 0.0;
+
+    auto& v = voices[(size_t) voice];
+    return (double) v.length / v.sourceSampleRate;
+}
+
+int PreviewVoicePool::getNumSoundingVoices() const
+{
+    int count = 0;
+
+    for (int i = 0; i < numSlots; ++i)
+        if (isVoiceActive (i) && ! voices[(size_t) i].pauseRequested)
+            ++count;
+
+    return count;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// A fixed set of preview voices, mixed on the audio thread.
+//
+// Everything a voice needs is allocated on the message thread before it
+// starts, and the audio thread hears about voices only through a lock-free
+// command queue, so a block costs the same whatever the UI is doing. Each
+// voice has its own gain and fades in and out over a few milliseconds, so
+// starting, stopping, pausing and seeking never click. Voices are summed
+// with FloatVectorOperations (SSE, NEON or vDSP underneath).
+//
+// Up to maxVoices voices sound at once. Starting another fades out the
+// oldest; the extra slots give stolen voices room to finish their fade.
+// Finished voices go back to the message thread, which destroys their
+// sources in update(): nothing is freed on the audio thread.
+//==============================================================================
+class PreviewVoicePool
+{
+public:
+    static constexpr int maxVoices = 16;
+
+    PreviewVoicePool();
+    ~PreviewVoicePool();
+
+    // Audio thread, or while the audio thread is stopped
+    void prepareToPlay (double newSampleRate, int maximumBlockSize);
+    void renderNextBlock (juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+    //==============================================================================
+    // Message thread. Voices are named by the number startVoice() returns,
+    // which stays theirs until update() reports them finished.
+    int startVoice (std::unique_ptr<juce::PositionableAudioSource> source, double sourceSampleRate, float gain);
+    void stopVoice (int voice);
+    void stopAllVoices();
+    void setVoicePaused (int voice, bool shouldBePaused);
+    void setVoicePosition (int voice, double proportion);
+    void setVoiceGain (int voice, float gain);
+    void setMasterGain (float gain)                    { masterGain = gain; }
+
+    // Reclaims finished voices, calling onVoiceFinished for each
+    void update();
+    std::function<void (int voice, bool reachedEnd)> onVoiceFinished;
+
+    bool isVoiceActive (int voice) const;      // started, and neither stopped nor finished
+    bool isVoicePaused (int voice) const;
+    double getVoicePosition (int voice) const;  // 0 to 1
+    double getVoiceLengthSeconds (int voice) const;
+    int getNumSoundingVoices() const;
+
+private:
+    static constexpr int numSlots = maxVoices * 2;
+    static constexpr double fadeSeconds = 0.005;
+
+    struct Voice
+    {
+        // Message thread; fixed while the voice is in use
+        std::unique_ptr<juce::PositionableAudioSource> source;
+        std::unique_ptr<juce::ResamplingAudioSource> resampler;
+        juce::AudioSource* input = nullptr;         // resampler or source
+        double preparedSampleRate = 0.0;
+        double sourceSampleRate = 0.0;
+        juce::int64 length = 0;
+        bool inUse = false;
+        bool stopRequested = false;
+        bool pauseRequested = false;
+        juce::uint32 startOrder = 0;
+
+        // Audio thread
+        bool active = false;
+        bool paused = false;
+        bool stopping = false;
+        bool pausing = false;
+        float gain = 1.0f;
+        float fadeLevel = 0.0f;
+        float fadeTarget = 0.0f;
+        float appliedGain = 0.0f;                   // at the end of the last block
+
+        // Published by the audio thread
+        std::atomic<juce::int64> position { 0 };
+        std::atomic<bool> finished { false };
+        std::atomic<bool> reachedEnd { false };
+    };
+
+    struct Command
+    {
+        enum Type { start, stop, pause, resume, seek, setGain };
+
+        Type type = start;
+        int voice = 0;
+        juce::int64 position = 0;
+        float gain = 0.0f;
+    };
+
+    bool post (const Command& command);
+    void handleCommands();
+    void finishVoice (Voice& voice, bool reachedEnd);
+    void renderVoice (Voice& voice, juce::AudioBuffer<float>& output, int startSample, int numSamples);
+    bool isValid (int voice) const              { return juce::isPositiveAndBelow (voice, numSlots) && voices[(size_t) voice].inUse; }
+
+    std::array<Voice, numSlots> voices;
+    juce::uint32 nextStartOrder = 0;
+
+    juce::AbstractFifo commandFifo { 256 };
+    std::array<Command, 256> commands;
+
+    // Written by prepareToPlay, read when a voice is set up
+    std::atomic<double> sampleRate { 0.0 };
+    std::atomic<int> blockSize { 0 };
+
+    juce::AudioBuffer<float> voiceBuffer;       // one voice's block, before gain
+    juce::HeapBlock<float> gainRamp;
+    float fadeStep = 0.0f;
+
+    std::atomic<float> masterGain { 1.0f };
+    float lastMasterGain = 1.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PreviewVoicePool)
+};
@@ -1,307 +1,1542 @@
 #include "SampleLibrary.h"
+#include "PerformanceCounters.h"
+#include "TraceRecorder.h"
+#include "FileReadahead.h"
 
 //==============================================================================
-SampleLibrary::SampleLibrary()
+SampleLibrary::SampleLibrary (const juce::File& stateDir, const juce::File& analysisWorkerExecutable)
+    : juce::Thread ("SoundXplorer Analysis"),
+      stateDirectory (stateDir != juce::File()
+                          ? stateDir
+                          : juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+                                .getChildFile ("SoundXplorer")),
+      scanPool (juce::jmax (1, juce::SystemStats::getNumCpus() - 1)),
+      analysisPool (juce::jmax (1, juce::SystemStats::getNumCpus() - 1), 0, juce::Thread::Priority::low)
 {
-    formatManager.registerBasicFormats();
+    // Before loadState(), whose rescan starts the analysis
+    if (analysisWorkerExecutable.existsAsFile())
+        workerPool = std::make_unique<AnalysisWorkerPool> (analysisWorkerExecutable, analysisPool.getNumThreads());
+    else
+        PerformanceCounters::getInstance().analysingInProcess = true;
+
+    reloadTagTaxonomy();
     loadState();
 }
 
-SampleLibrary::~SampleLibrary()
-{
-    saveState();
-}
+SampleLibrary::~SampleLibrary()
+{
+    // Stops between files. What was analysed is in the metadata cache; the
+    // rest is picked up by the next scan.
+    stopThread (10000);
+    cancelPendingUpdate();
+
+    saveState();
+}
+
+//==============================================================================
+void SampleLibrary::addLibraryFolder (const juce::File& folder)
+{
+    if (folder.isDirectory() && ! libraryFolders.contains (folder))
+    {
+        libraryFolders.add (folder);
+        scanFolder (folder);
+        saveState();
+        sendChangeMessage();
+    }
+}
+
+void SampleLibrary::removeLibraryFolder (const juce::File& folder)
+{
+    libraryFolders.removeAllInstancesOf (folder);
+    analysisQueue.removeFilesIn (folder);
+
+    {
+        // Held across the whole removal so queries never see a half-removed folder
+        const juce::ScopedWriteLock sl (sampleLock);
+
+        // Remove samples from that folder
+        for (int i = allSamples.size(); --i >= 0;)
+        {
+            if (allSamples[i].file.getFullPathName().startsWith (folder.getFullPathName()))
+            {
+                similarityIndex.remove (allSamples[i].file.getFullPathName());
+                similarityIndexChanged = true;
+                removeSample (i);
+            }
+        }
+
+        rebuildIndices();
+    }
+
+    // Hashes are cached, so this only regroups what's left
+    detectDuplicates();
+
+    saveState();
+    sendChangeMessage();
+}
+
+void SampleLibrary::refreshLibraries()
+{
+    analysisQueue.clear();
+
+    {
+        const juce::ScopedWriteLock sl (sampleLock);
+        allSamples.clear();
+        nameCollationKeys.clear();
+        clearIndices();
+        tagHistogram.clear();
+        duplicateGroups.clear();
+    }
+
+    // With the library empty this only picks up taxonomy edits for the rescan
+    reloadTagTaxonomy();
+
+    analysisProgress = 0.0f;
+
+    for (auto& folder : libraryFolders)
+        scanFolder (folder);
+
+    sendChangeMessage();
+}
+
+//==============================================================================
+void SampleLibrary::scanFolder (const juce::File& folder)
+{
+    const TraceScope traceScope ("scanFolder");
+
+    adoptLibraryIndex (folder);
+
+    // One walk of the tree for every extension
+    juce::Array<juce::File> files;
+    for (auto& entry : juce::RangedDirectoryIterator (folder, true, "*.wav;*.aif;*.aiff;*.mp3;*.flac;*.ogg;*.m4a",
+                                                      juce::File::findFiles))
+        files.add (entry.getFile());
+
+    // Files are listed straight away with whatever the name, the path and
+    // the metadata cache say; opening them is left to the analysis thread.
+    // Stat calls only touch file system metadata, so these run in parallel.
+    struct FoundFile
+    {
+        SampleItem item;
+        bool needsAnalysis = false;
+        juce::uint64 layoutKey = 0;
+    };
+
+    std::vector<FoundFile> found ((size_t) files.size());
+    auto& counters = PerformanceCounters::getInstance();
+
+    runOnPool (scanPool, files.size(), [&] (int i)
+    {
+        auto& file = files.getReference (i);
+        auto& result = found[(size_t) i];
+
+        CachedMetadata metadata;
+        bool isCached = metadataCache.lookup (file, metadata);
+        ++(isCached ? counters.metadataCacheHits : counters.metadataCacheMisses);
+
+        result.item = describeFile (file, isCached ? &metadata : nullptr);
+        result.item.tags = guessTagsFromPath (file);
+
+        // Cached files may still lack a timbre embedding or an audio hash
+        result.needsAnalysis = ! isCached
+                                 || (metadata.sampleRate > 0.0
+                                      && (metadata.pcmHash == 0
+                                           || ! similarityIndex.isUpToDate (file.getFullPathName(), metadata.modificationTime)));
+
+        if (! isCached)
+            result.layoutKey = FileReadahead::getLayoutKey (file);
+    });
+
+    for (auto& result : found)
+    {
+        result.item.isFavorite = favoriteFiles.contains (result.item.file.getFullPathName());
+        addSample (result.item);
+    }
+
+    {
+        const juce::ScopedWriteLock sl (sampleLock);
+        rebuildIndices();
+    }
+
+    // Unanalysed files are queued first and in on-disk order to keep reads
+    // sequential, then the cached ones that only need an embedding or a hash
+    std::vector<const FoundFile*> toAnalyse;
+    for (auto& result : found)
+        if (result.needsAnalysis)
+            toAnalyse.push_back (&result);
+
+    std::stable_sort (toAnalyse.begin(), toAnalyse.end(), [] (const FoundFile* a, const FoundFile* b)
+    {
+        if (a->item.isAnalysed != b->item.isAnalysed)
+            return b->item.isAnalysed;
+
+        return a->layoutKey < b->layoutKey;
+    });
+
+    juce::Array<juce::File> queued;
+    queued.ensureStorageAllocated ((int) toAnalyse.size());
+
+    for (auto* result : toAnalyse)
+        queued.add (result->item.file);
+
+    if (! queued.isEmpty())
+    {
+        analysisQueue.add (queued);
+        counters.analysisQueueDepth = analysisQueue.getNumPending();
+        analysisProgress = analysisQueue.getProgress();
+
+        if (! isThreadRunning())
+            startThread (juce::Thread::Priority::low);
+
+        notify();
+    }
+    else if (analysisQueue.isIdle())
+    {
+        detectDuplicates();
+    }
+}
+
+void SampleLibrary::adoptLibraryIndex (const juce::File& folder)
+{
+    const TraceScope traceScope ("adoptLibraryIndex");
+
+    std::vector<LibraryIndexFile::Entry> entries;
+    if (! LibraryIndexFile::read (folder, entries))
+        return;
+
+    const juce::ScopedLock sl (sharedEmbeddingsLock);
+
+    for (auto& entry : entries)
+    {
+        auto path = folder.getChildFile (entry.relativePath.replaceCharacter ('/', juce::File::getSeparatorChar()))
+                          .getFullPathName();
+
+        // Nothing is checked against the disk here: the scan's cache lookup
+        // rejects entries whose file has changed since, as for any entry.
+        // An entry analysed locally at the same state is kept as it is.
+        CachedMetadata local;
+        if (! metadataCache.lookup (path, local)
+             || local.modificationTime != entry.metadata.modificationTime
+             || local.fileSize != entry.metadata.fileSize)
+            metadataCache.store (path, entry.metadata);
+
+        if (entry.embedding.has_value() && ! similarityIndex.isUpToDate (path, entry.metadata.modificationTime))
+            sharedEmbeddings[path] = { entry.metadata.modificationTime, *entry.embedding };
+    }
+}
+
+bool SampleLibrary::takeSharedEmbedding (const juce::String& path, juce::int64 modificationTime,
+                                         std::optional<SimilarityIndex::Embedding>& embedding)
+{
+    const juce::ScopedLock sl (sharedEmbeddingsLock);
+
+    auto it = sharedEmbeddings.find (path);
+    if (it == sharedEmbeddings.end())
+        return false;
+
+    auto isCurrent = it->second.first == modificationTime;
+    if (isCurrent)
+        embedding = it->second.second;
+
+    sharedEmbeddings.erase (it);
+    return isCurrent;
+}
+
+bool SampleLibrary::writeLibraryIndex (const juce::File& folder) const
+{
+    std::vector<LibraryIndexFile::Entry> entries;
+
+    {
+        const juce::ScopedReadLock sl (sampleLock);
+
+        for (auto& item : allSamples)
+        {
+            if (! item.isAnalysed || ! item.file.isAChildOf (folder))
+                continue;
+
+            auto path = item.file.getFullPathName();
+
+            LibraryIndexFile::Entry entry;
+            if (! metadataCache.lookup (path, entry.metadata))
+                continue;
+
+            entry.relativePath = item.file.getRelativePathFrom (folder);
+
+            juce::int64 embeddedTime = 0;
+            SimilarityIndex::Embedding embedding;
+
+            if (similarityIndex.getEmbedding (path, embeddedTime, embedding)
+                 && embeddedTime == entry.metadata.modificationTime)
+                entry.embedding = embedding;
+
+            entries.push_back (std::move (entry));
+        }
+    }
+
+    return LibraryIndexFile::write (folder, entries);
+}
+
+//==============================================================================
+void SampleLibrary::prioritiseAnalysis (const juce::Array<juce::File>& files, AnalysisQueue::Priority priority)
+{
+    analysisQueue.prioritise (files, priority);
+}
+
+void SampleLibrary::finishPendingAnalysis()
+{
+    // Works through the queue alongside the analysis thread, then waits for
+    // its last batch
+    for (auto batch = analysisQueue.takeBatch (std::numeric_limits<int>::max());
+         ! batch.isEmpty();
+         batch = analysisQueue.takeBatch (std::numeric_limits<int>::max()))
+        analyseFiles (batch);
+
+    while (! analysisQueue.isIdle())
+        juce::Thread::sleep (1);
+
+    cancelPendingUpdate();
+    mergeAnalysedFiles();
+}
+
+void SampleLibrary::run()
+{
+    TraceRecorder::getInstance().registerThisThread();
+    auto lastHandOverTime = 0.0;
+
+    while (! threadShouldExit())
+    {
+        // Small batches, so that newly visible rows don't wait long
+        auto batch = analysisQueue.takeBatch (analysisPool.getNumThreads() * 8);
+
+        if (batch.isEmpty())
+        {
+            wait (-1);
+            continue;
+        }
+
+        analyseFiles (batch);
+
+        // Merging re-indexes the whole library on the message thread, so
+        // results are handed over a few times a second at most
+        auto now = juce::Time::getMillisecondCounterHiRes();
+
+        if (analysisQueue.getNumPending() == 0 || now - lastHandOverTime >= 250.0)
+        {
+            lastHandOverTime = now;
+            triggerAsyncUpdate();
+        }
+    }
+}
+
+void SampleLibrary::analyseFiles (const juce::Array<juce::File>& files)
+{
+    struct FileProbe
+    {
+        CachedMetadata metadata;
+        FileProber::Request request;
+        FileProber::Result result;
+        bool isNeeded = false;
+    };
+
+    auto numFiles = files.size();
+    std::vector<AnalysedFile> results ((size_t) numFiles);
+    std::vector<FileProbe> probes ((size_t) numFiles);
+    auto& counters = PerformanceCounters::getInstance();
+
+    // First the cache and index decide which files must be opened. Headers
+    // are read ahead a window in front of that, so the device always has
+    // requests queued; the page cache serves worker processes too.
+    constexpr int prefetchDistance = 64;
+    constexpr juce::int64 prefetchBytes = 256 * 1024;
+    std::atomic<int> nextPrefetch { 0 };
+
+    runOnPool (analysisPool, numFiles, [&] (int i)
+    {
+        // Files left unanalysed at shutdown are simply rescanned next time
+        if (threadShouldExit())
+            return;
+
+        auto prefetchEnd = juce::jmin (numFiles, i + prefetchDistance);
+
+        for (int p = nextPrefetch.load(); p < prefetchEnd; p = nextPrefetch.load())
+            if (nextPrefetch.compare_exchange_weak (p, p + 1))
+                FileReadahead::prefetch (files.getReference (p), prefetchBytes);
+
+        auto& probe = probes[(size_t) i];
+        probe.isNeeded = prepareProbe (files.getReference (i), probe.metadata, probe.request,
+                                       results[(size_t) i].embedding);
+    });
+
+    // Files that must be opened go to the worker processes, if there are any
+    if (workerPool != nullptr && workerPool->isAvailable())
+    {
+        std::vector<int> toProbe;
+        std::vector<FileProber::Request> requests;
+
+        for (int i = 0; i < numFiles; ++i)
+        {
+            if (probes[(size_t) i].isNeeded)
+            {
+                toProbe.push_back (i);
+                requests.push_back (probes[(size_t) i].request);
+            }
+        }
+
+        if (! requests.empty())
+        {
+            std::vector<FileProber::Result> probeResults (requests.size());
+            workerPool->probe (requests, probeResults, [this] { return threadShouldExit(); });
+
+            for (size_t j = 0; j < toProbe.size(); ++j)
+                probes[(size_t) toProbe[j]].result = std::move (probeResults[j]);
+        }
+    }
+
+    // Whatever no worker did is probed here
+    runOnPool (analysisPool, numFiles, [&] (int i)
+    {
+        if (threadShouldExit())
+            return;
+
+        auto& file = files.getReference (i);
+        auto& probe = probes[(size_t) i];
+        auto& result = results[(size_t) i];
+
+        if (probe.isNeeded)
+        {
+            if (! probe.result.completed)
+            {
+                auto prober = acquireProber();
+                prober->probe (probe.request, probe.result);
+                releaseProber (std::move (prober));
+            }
+
+            finishProbe (probe.request, probe.result, probe.metadata, result.embedding);
+        }
+
+        result.item = describeFile (file, &probe.metadata);
+        result.modificationTime = probe.metadata.modificationTime;
+
+        ++counters.filesAnalysed;
+    });
+
+    {
+        const juce::ScopedLock sl (analysedFilesLock);
+
+        for (auto& result : results)
+            if (result.item.file != juce::File())
+                analysedFiles.push_back (std::move (result));
+    }
+
+    // Only after the hand-over, so that an idle queue means every result
+    // is waiting in analysedFiles
+    analysisQueue.markFinished (numFiles);
+
+    counters.analysisQueueDepth = analysisQueue.getNumPending();
+    analysisProgress = analysisQueue.getProgress();
+}
+
+void SampleLibrary::handleAsyncUpdate()
+{
+    mergeAnalysedFiles();
+}
+
+void SampleLibrary::mergeAnalysedFiles()
+{
+    std::vector<AnalysedFile> results;
+
+    {
+        const juce::ScopedLock sl (analysedFilesLock);
+        results.swap (analysedFiles);
+    }
+
+    if (! results.empty())
+    {
+        const TraceScope traceScope ("mergeAnalysedFiles");
+        const juce::ScopedWriteLock sl (sampleLock);
+
+        std::vector<AnalysedFields> previous;
+        previous.reserve (results.size());
+
+        for (auto& result : results)
+        {
+            auto path = result.item.file.getFullPathName();
+
+            // The folder may have been removed since the file was queued
+            auto it = sampleForPath.find (path);
+            if (it == sampleForPath.end())
+                continue;
+
+            // Tags and favourites may have been edited meanwhile, so only
+            // the analysed fields are taken
+            auto& item = allSamples.getReference (it->second);
+            previous.push_back ({ it->second, item.type, item.key, item.bpm, item.lengthSeconds });
+
+            item.fileSize = result.item.fileSize;
+            item.lengthSeconds = result.item.lengthSeconds;
+            item.type = result.item.type;
+            item.bpm = result.item.bpm;
+            item.key = result.item.key;
+            item.loudness = result.item.loudness;
+            item.onsetSeconds = result.item.onsetSeconds;
+            item.isAnalysed = true;
+
+            if (result.embedding.has_value())
+            {
+                similarityIndex.add (path, result.modificationTime, *result.embedding);
+                similarityIndexChanged = true;
+            }
+        }
+
+        // Hand-overs come several times a second during a scan, so only the
+        // indices over the fields just analysed are patched; the columns
+        // they sort are re-ranked once the queue drains
+        if (nameOrder.size() == (size_t) allSamples.size())
+            updateAnalysedIndices (std::move (previous));
+        else
+            rebuildIndices();
+
+        hasUnsavedAnalysis = true;
+    }
+
+    bool changed = ! results.empty();
+
+    // Duplicates need every file's hash, so they wait for the queue to drain
+    if (hasUnsavedAnalysis && analysisQueue.isIdle())
+    {
+        hasUnsavedAnalysis = false;
+
+        {
+            const juce::ScopedWriteLock sl (sampleLock);
+
+            if (nameOrder.size() == (size_t) allSamples.size())
+                rerankAnalysedColumns();
+            else
+                rebuildIndices();
+        }
+
+        detectDuplicates();
+        saveState();
+        changed = true;
+    }
+
+    if (changed)
+        sendChangeMessage();
+}
+
+//==============================================================================
+void SampleLibrary::runOnPool (juce::ThreadPool& pool, int numItems, const std::function<void (int)>& processItem)
+{
+    // The calling thread pulls work too
+    std::atomic<int> nextItem { 0 };
+
+    auto processRemainingItems = [&]
+    {
+        for (int i = nextItem++; i < numItems; i = nextItem++)
+            processItem (i);
+    };
+
+    juce::WaitableEvent allJobsFinished;
+    std::atomic<int> numActiveJobs { pool.getNumThreads() };
+
+    for (int i = 0; i < pool.getNumThreads(); ++i)
+    {
+        pool.addJob ([&]
+        {
+            TraceRecorder::getInstance().registerThisThread();
+            processRemainingItems();
+
+            if (--numActiveJobs == 0)
+                allJobsFinished.signal();
+        });
+    }
+
+    processRemainingItems();
+    allJobsFinished.wait();
+}
+
+void SampleLibrary::detectDuplicates()
+{
+    const TraceScope traceScope ("detectDuplicates");
+
+    // Hashes come from probing, in a worker process where there are any, so
+    // this only groups the ones already cached: identical audio has the same
+    // length, channel count and hash
+    struct Entry
+    {
+        int sample;
+        juce::int64 lengthInSamples;
+        int numChannels;
+        uint64_t pcmHash;
+    };
+
+    std::vector<Entry> entries;
+
+    {
+        const juce::ScopedReadLock sl (sampleLock);
+        entries.reserve ((size_t) allSamples.size());
+
+        for (int i = 0; i < allSamples.size(); ++i)
+        {
+            CachedMetadata metadata;
+            if (metadataCache.lookup (allSamples.getReference (i).file.getFullPathName(), metadata)
+                 && metadata.lengthInSamples > 0 && metadata.hasPcmHash())
+                entries.push_back ({ i, metadata.lengthInSamples, metadata.numChannels, metadata.pcmHash });
+        }
+    }
+
+    auto sameAudio = [] (const Entry& a, const Entry& b)
+    {
+        return a.lengthInSamples == b.lengthInSamples
+            && a.numChannels == b.numChannels
+            && a.pcmHash == b.pcmHash;
+    };
+
+    std::sort (entries.begin(), entries.end(), [] (const Entry& a, const Entry& b)
+    {
+        if (a.lengthInSamples != b.lengthInSamples)
+            return a.lengthInSamples < b.lengthInSamples;
+
+        if (a.numChannels != b.numChannels)
+            return a.numChannels < b.numChannels;
+
+        if (a.pcmHash != b.pcmHash)
+            return a.pcmHash < b.pcmHash;
+
+        return a.sample < b.sample;
+    });
+
+    // Samples only change on this thread, so the indices above still hold
+    const juce::ScopedWriteLock sl (sampleLock);
+
+    for (auto& item : allSamples)
+    {
+        item.duplicateGroup = -1;
+        item.isDuplicateCopy = false;
+    }
+
+    duplicateGroups.clear();
+
+    for (size_t start = 0; start < entries.size();)
+    {
+        auto end = start + 1;
+        while (end < entries.size() && sameAudio (entries[start], entries[end]))
+            ++end;
+
+        if (end - start > 1)
+        {
+            // Sorted by sample within the group, so the copy that was added
+            // first stays visible when duplicates are hidden
+            juce::StringArray paths;
+            for (auto i = start; i < end; ++i)
+            {
+                auto& item = allSamples.getReference (entries[i].sample);
+                item.duplicateGroup = duplicateGroups.size();
+                item.isDuplicateCopy = i != start;
+                paths.add (item.file.getFullPathName());
+            }
+
+            duplicateGroups.add (paths);
+        }
+
+        start = end;
+    }
+}
+
+juce::Array<juce::StringArray> SampleLibrary::getDuplicateGroups() const
+{
+    const juce::ScopedReadLock sl (sampleLock);
+    return duplicateGroups;
+}
+
+juce::Array<SampleItem> SampleLibrary::getDuplicatesOf (const juce::File& file) const
+{
+    const juce::ScopedReadLock sl (sampleLock);
+    juce::Array<SampleItem> results;
+
+    auto it = sampleForPath.find (file.getFullPathName());
+    if (it == sampleForPath.end())
+        return results;
+
+    auto group = allSamples.getReference (it->second).duplicateGroup;
+    if (group < 0)
+        return results;
+
+    for (auto& path : duplicateGroups.getReference (group))
+    {
+        auto member = sampleForPath.find (path);
+        if (member != sampleForPath.end())
+            results.add (allSamples.getReference (member->second));
+    }
+
+    return results;
+}
+
+bool SampleLibrary::prepareProbe (const juce::File& file, CachedMetadata& metadata, FileProber::Request& request,
+                                  std::optional<SimilarityIndex::Embedding>& newEmbedding)
+{
+    auto path = file.getFullPathName();
+    auto modificationTime = file.getLastModificationTime().toMilliseconds();
+
+    // Unchanged files are served from the cache without being opened, unless
+    // they still lack a timbre embedding
+    bool isCached = metadataCache.lookup (file, metadata);
+    bool needsEmbedding = ! similarityIndex.isUpToDate (path, modificationTime)
+                            && (! isCached || metadata.sampleRate > 0.0)
+                            && ! takeSharedEmbedding (path, modificationTime, newEmbedding);
+
+    // Duplicate detection needs every readable file's audio hash
+    bool needsHash = ! isCached || (metadata.sampleRate > 0.0 && metadata.pcmHash == 0);
+
+    request.file = file;
+    request.modificationTime = modificationTime;
+    request.needsMetadata = ! isCached;
+    request.needsEmbedding = needsEmbedding;
+    request.needsHash = needsHash;
+
+    return ! isCached || needsEmbedding || needsHash;
+}
+
+void SampleLibrary::finishProbe (const FileProber::Request& request, const FileProber::Result& probeResult,
+                                 CachedMetadata& metadata, std::optional<SimilarityIndex::Embedding>& newEmbedding)
+{
+    // A quarantined file is cached as unreadable, so it isn't opened again
+    // until it changes
+    if (request.needsMetadata || probeResult.quarantined)
+    {
+        metadata = probeResult.metadata;
+        metadataCache.store (request.file.getFullPathName(), metadata);
+    }
+    else if (request.needsHash)
+    {
+        metadata.pcmHash = probeResult.metadata.pcmHash;
+        metadataCache.setPcmHash (request.file.getFullPathName(), metadata.pcmHash);
+    }
+
+    if (probeResult.embedding.has_value())
+        newEmbedding = probeResult.embedding;
+}
+
+std::unique_ptr<FileProber> SampleLibrary::acquireProber()
+{
+    {
+        const juce::ScopedLock sl (proberPoolLock);
+
+        if (! idleProbers.empty())
+        {
+            auto prober = std::move (idleProbers.back());
+            idleProbers.pop_back();
+            return prober;
+        }
+    }
+
+    return std::make_unique<FileProber>();
+}
+
+void SampleLibrary::releaseProber (std::unique_ptr<FileProber> prober)
+{
+    const juce::ScopedLock sl (proberPoolLock);
+    idleProbers.push_back (std::move (prober));
+}
+
+SampleItem SampleLibrary::describeFile (const juce::File& file, const CachedMetadata* metadata) const
+{
+    SampleItem item;
+    item.file = file;
+    item.name = file.getFileNameWithoutExtension();
+    item.fileSize = metadata != nullptr ? metadata->fileSize : file.getSize();
+    item.lengthSeconds = metadata != nullptr ? metadata->getLengthSeconds() : 0.0;
+    item.loudness = metadata != nullptr ? metadata->loudness : LoudnessAnalyzer::Measurement();
+    item.onsetSeconds = metadata != nullptr && metadata->sampleRate > 0.0 ? (double) metadata->onsetSample / metadata->sampleRate : 0.0;
+    item.isAnalysed = metadata != nullptr;
+
+    // Values declared inside the file beat guesses from its name
+    auto hints = FilenameHints::parse (item.name);
+    if (metadata != nullptr)
+        metadata->embedded.applyTo (hints, item.lengthSeconds);
+
+    item.type = detectType (hints, item.lengthSeconds);
+    item.bpm = hints.bpm;
+    item.key = hints.getKeyName();
+
+    return item;
+}
+
+juce::String SampleLibrary::detectType (const FilenameHints& hints, double lengthSec) const
+{
+    // A name that says what it is wins over the length
+    if (hints.typeHint == FilenameHints::loopHint)
+        return "Loop";
+
+    if (hints.typeHint == FilenameHints::oneShotHint)
+        return "One-Shot";
+
+    return lengthSec > 2.0 ? "Loop" : "One-Shot";
+}
+
+juce::StringArray SampleLibrary::guessTagsFromPath (const juce::File& file)
+{
+    auto tags = tagClassifier.classify (file.getFullPathName());
+
+    // If no tags found, add generic
+    if (tags.isEmpty())
+        tags.add ("UNCATEGORIZED");
+
+    return tags;
+}
+
+//==============================================================================
+void SampleLibrary::addSample (const SampleItem& item)
+{
+    const juce::ScopedWriteLock sl (sampleLock);
+    allSamples.add (item);
+    nameCollationKeys.add (item.name.toLowerCase());
+    countTags (item.tags, 1);
+}
+
+void SampleLibrary::removeSample (int index)
+{
+    const juce::ScopedWriteLock sl (sampleLock);
+    countTags (allSamples.getReference (index).tags, -1);
+    allSamples.remove (index);
+    nameCollationKeys.remove (index);
+
+    // Indices past the removed one have shifted
+    clearIndices();
+}
+
+void SampleLibrary::clearIndices()
+{
+    nameOrder.clear();
+    lengthOrder.clear();
+    sampleForPath.clear();
+    bpmIndex = {};
+    lengthIndex = {};
+    typePostings.clear();
+    keyPostings.clear();
+    tagPostings.clear();
+}
+
+void SampleLibrary::rebuildIndices()
+{
+    const TraceScope traceScope ("rebuildIndices");
+
+    // Caller holds the write lock. Each order is sorted once here so that
+    // views can re-sort any result by comparing integer ranks, and queries
+    // can answer field predicates without scanning every sample.
+    const auto numSamples = allSamples.size();
+
+    std::vector<int> order ((size_t) numSamples);
+    std::iota (order.begin(), order.end(), 0);
+
+    auto assignRanks = [this, &order] (SampleSortColumn column)
+    {
+        for (int rank = 0; rank < (int) order.size(); ++rank)
+            allSamples.getReference (order[(size_t) rank]).sortRanks[column] = rank;
+    };
+
+    std::sort (order.begin(), order.end(), [this] (int a, int b)
+    {
+        auto result = nameCollationKeys[a].compare (nameCollationKeys[b]);
+        return result != 0 ? result < 0 : a < b;
+    });
+
+    assignRanks (sortByName);
+    nameOrder = order;
+
+    // Ranked search visits the shortest names first (see getRankedSamples)
+    lengthOrder = order;
+    std::stable_sort (lengthOrder.begin(), lengthOrder.end(), [this] (int a, int b)
+    {
+        return allSamples.getReference (a).name.length() < allSamples.getReference (b).name.length();
+    });
+
+    // Type, key and BPM ranks break ties by name, so they follow nameOrder
+    rerankAnalysedColumns();
+
+    // Range indices: sample indices sorted by value, unknown (zero) values left out
+    auto buildRangeIndex = [this] (RangeIndex& index, double SampleItem::* field)
+    {
+        index = {};
+
+        for (int i = 0; i < allSamples.size(); ++i)
+            if (allSamples.getReference (i).*field > 0.0)
+                index.samples.push_back (i);
+
+        std::sort (index.samples.begin(), index.samples.end(), [this, field] (int a, int b)
+        {
+            return allSamples.getReference (a).*field < allSamples.getReference (b).*field;
+        });
+
+        index.values.reserve (index.samples.size());
+        for (auto i : index.samples)
+            index.values.push_back (allSamples.getReference (i).*field);
+    };
+
+    buildRangeIndex (bpmIndex, &SampleItem::bpm);
+    buildRangeIndex (lengthIndex, &SampleItem::lengthSeconds);
+
+    // Postings lists, each in ascending sample index
+    typePostings.clear();
+    keyPostings.clear();
+    tagPostings.clear();
+    sampleForPath.clear();
+
+    for (int i = 0; i < allSamples.size(); ++i)
+    {
+        auto& item = allSamples.getReference (i);
+        sampleForPath[item.file.getFullPathName()] = i;
+        typePostings[item.type.toLowerCase()].push_back (i);
+
+        auto keyCode = getKeyPostingsCode (item.key);
+        if (keyCode >= 0)
+            keyPostings[keyCode].push_back (i);
+
+        for (auto& tag : item.tags)
+            tagPostings[tag.toUpperCase()].push_back (i);
+    }
+}
+
+void SampleLibrary::rerankAnalysedColumns()
+{
+    const TraceScope traceScope ("rerankAnalysedColumns");
+
+    // Caller holds the write lock, and nameOrder covers every sample. Ties
+    // are broken by name, so each column is a stable bucketing of nameOrder
+    // by the ordinal of its value, with no comparison sort.
+    std::vector<int> ordinals ((size_t) allSamples.size());
+
+    auto assignRanks = [this, &ordinals] (SampleSortColumn column, int numOrdinals)
+    {
+        std::vector<int> starts ((size_t) numOrdinals + 1, 0);
+        for (auto ordinal : ordinals)
+            ++starts[(size_t) ordinal + 1];
+
+        for (size_t o = 1; o < starts.size(); ++o)
+            starts[o] += starts[o - 1];
+
+        for (auto sample : nameOrder)
+            allSamples.getReference (sample).sortRanks[column] = starts[(size_t) ordinals[(size_t) sample]]++;
+    };
+
+    // Type and key have only a handful of distinct values, collated once
+    auto rankByText = [this, &ordinals, &assignRanks] (SampleSortColumn column, juce::String SampleItem::* field)
+    {
+        std::map<juce::String, int> textOrdinals;
+        for (auto& item : allSamples)
+            textOrdinals.emplace ((item.*field).toLowerCase(), 0);
+
+        int next = 0;
+        for (auto& entry : textOrdinals)
+            entry.second = next++;
+
+        for (int i = 0; i < allSamples.size(); ++i)
+            ordinals[(size_t) i] = textOrdinals[(allSamples.getReference (i).*field).toLowerCase()];
+
+        assignRanks (column, next);
+    };
+
+    rankByText (sortByType, &SampleItem::type);
+    rankByText (sortByKey, &SampleItem::key);
+
+    // So do tempos, mostly whole BPMs
+    std::vector<double> tempos;
+    tempos.reserve ((size_t) allSamples.size());
+
+    for (auto& item : allSamples)
+        tempos.push_back (item.bpm);
+
+    std::sort (tempos.begin(), tempos.end());
+    tempos.erase (std::unique (tempos.begin(), tempos.end()), tempos.end());
+
+    for (int i = 0; i < allSamples.size(); ++i)
+        ordinals[(size_t) i] = (int) (std::lower_bound (tempos.begin(), tempos.end(), allSamples.getReference (i).bpm) - tempos.begin());
+
+    assignRanks (sortByBpm, (int) tempos.size());
+}
+
+// Moves samples between postings lists. Removals and insertions are sorted
+// sample indices per key, merged into each list in one pass.
+template <typename Key>
+static void movePostings (std::map<Key, std::vector<int>>& postings,
+                          const std::map<Key, std::vector<int>>& removals,
+                          const std::map<Key, std::vector<int>>& insertions)
+{
+    for (auto& [key, samples] : removals)
+    {
+        auto it = postings.find (key);
+        if (it == postings.end())
+            continue;
+
+        auto& list = it->second;
+        list.erase (std::remove_if (list.begin(), list.end(), [&samples] (int sample)
+                    {
+                        return std::binary_search (samples.begin(), samples.end(), sample);
+                    }),
+                    list.end());
+
+        if (list.empty())
+            postings.erase (it);
+    }
+
+    for (auto& [key, samples] : insertions)
+    {
+        auto& list = postings[key];
+        auto middle = list.insert (list.end(), samples.begin(), samples.end());
+        std::inplace_merge (list.begin(), middle, list.end());
+    }
+}
+
+void SampleLibrary::updateAnalysedIndices (std::vector<AnalysedFields> previous)
+{
+    const TraceScope traceScope ("updateAnalysedIndices");
+
+    // Caller holds the write lock. A file merged twice in one hand-over is
+    // indexed under what it had before the first merge.
+    std::stable_sort (previous.begin(), previous.end(), [] (const AnalysedFields& a, const AnalysedFields& b)
+    {
+        return a.sample < b.sample;
+    });
+
+    previous.erase (std::unique (previous.begin(), previous.end(), [] (const AnalysedFields& a, const AnalysedFields& b)
+                    {
+                        return a.sample == b.sample;
+                    }),
+                    previous.end());
+
+    std::map<juce::String, std::vector<int>> typeRemovals, typeInsertions;
+    std::map<int, std::vector<int>> keyRemovals, keyInsertions;
+    std::vector<int> bpmRemovals, lengthRemovals;
+    std::vector<std::pair<double, int>> bpmInsertions, lengthInsertions;
 
-//==============================================================================
-void SampleLibrary::addLibraryFolder (const juce::File& folder)
-{
-    if (folder.isDirectory() && ! libraryFolders.contains (folder))
+    auto moveRangeEntry = [] (int sample, double oldValue, double newValue,
+                              std::vector<int>& removals, std::vector<std::pair<double, int>>& insertions)
     {
-        libraryFolders.add (folder);
-        scanFolder (folder);
-        saveState();
-        sendChangeMessage();
+        if (oldValue == newValue)
+            return;
+
+        if (oldValue > 0.0)
+            removals.push_back (sample);
+
+        if (newValue > 0.0)
+            insertions.push_back ({ newValue, sample });
+    };
+
+    for (auto& old : previous)
+    {
+        auto& item = allSamples.getReference (old.sample);
+
+        auto oldType = old.type.toLowerCase();
+        auto newType = item.type.toLowerCase();
+
+        if (oldType != newType)
+        {
+            typeRemovals[oldType].push_back (old.sample);
+            typeInsertions[newType].push_back (old.sample);
+        }
+
+        auto oldKey = getKeyPostingsCode (old.key);
+        auto newKey = getKeyPostingsCode (item.key);
+
+        if (oldKey != newKey)
+        {
+            if (oldKey >= 0)
+                keyRemovals[oldKey].push_back (old.sample);
+
+            if (newKey >= 0)
+                keyInsertions[newKey].push_back (old.sample);
+        }
+
+        moveRangeEntry (old.sample, old.bpm, item.bpm, bpmRemovals, bpmInsertions);
+        moveRangeEntry (old.sample, old.lengthSeconds, item.lengthSeconds, lengthRemovals, lengthInsertions);
     }
+
+    movePostings (typePostings, typeRemovals, typeInsertions);
+    movePostings (keyPostings, keyRemovals, keyInsertions);
+    bpmIndex.update (bpmRemovals, std::move (bpmInsertions));
+    lengthIndex.update (lengthRemovals, std::move (lengthInsertions));
 }
 
-void SampleLibrary::removeLibraryFolder (const juce::File& folder)
+int SampleLibrary::getKeyPostingsCode (const juce::String& key)
 {
-    libraryFolders.removeAllInstancesOf (folder);
-    // Remove samples from that folder
-    for (int i = allSamples.size(); --i >= 0;)
-        if (allSamples[i].file.getFullPathName().startsWith (folder.getFullPathName()))
-            allSamples.remove (i);
-    saveState();
-    sendChangeMessage();
+    int pitchClass = -1;
+    SampleQuery::KeyMode mode = SampleQuery::anyMode;
+
+    return SampleQuery::parseKey (key, pitchClass, mode) ? SampleQuery::getKeyCode (pitchClass, mode) : -1;
 }
 
-void SampleLibrary::refreshLibraries()
+void SampleLibrary::updateMemoryEstimate() const
 {
-    allSamples.clear();
-    analysisProgress = 0.0f;
+    // A rough figure for the HUD: container payloads plus string bytes, not
+    // allocator overhead
+    const juce::ScopedReadLock sl (sampleLock);
+    constexpr auto mapNodeBytes = (juce::int64) (4 * sizeof (void*));
 
-    for (auto& folder : libraryFolders)
-        scanFolder (folder);
+    auto stringBytes = [] (const juce::String& s) { return (juce::int64) s.getNumBytesAsUTF8() + 1; };
 
-    sendChangeMessage();
+    juce::int64 bytes = (juce::int64) allSamples.size() * (juce::int64) sizeof (SampleItem);
+
+    for (auto& item : allSamples)
+    {
+        bytes += stringBytes (item.file.getFullPathName()) + stringBytes (item.name)
+                   + stringBytes (item.type) + stringBytes (item.key);
+
+        for (auto& tag : item.tags)
+            bytes += (juce::int64) sizeof (juce::String) + stringBytes (tag);
+    }
+
+    for (auto& key : nameCollationKeys)
+        bytes += (juce::int64) sizeof (juce::String) + stringBytes (key);
+
+    auto postingsBytes = [mapNodeBytes] (const auto& postings)
+    {
+        juce::int64 total = 0;
+        for (auto& entry : postings)
+            total += mapNodeBytes + (juce::int64) (sizeof (entry) + entry.second.capacity() * sizeof (int));
+        return total;
+    };
+
+    bytes += (juce::int64) ((nameOrder.capacity() + lengthOrder.capacity()) * sizeof (int));
+    bytes += (juce::int64) ((bpmIndex.values.capacity() + lengthIndex.values.capacity()) * sizeof (double)
+                              + (bpmIndex.samples.capacity() + lengthIndex.samples.capacity()) * sizeof (int));
+    bytes += postingsBytes (typePostings) + postingsBytes (keyPostings) + postingsBytes (tagPostings);
+    bytes += (juce::int64) sampleForPath.size() * (mapNodeBytes + (juce::int64) sizeof (juce::String));
+
+    auto& counters = PerformanceCounters::getInstance();
+    counters.libraryBytes = bytes;
+    counters.similarityIndexBytes = similarityIndex.getMemoryUsage();
+    counters.metadataCacheBytes = metadataCache.getMemoryUsage();
 }
 
-//==============================================================================
-void SampleLibrary::scanFolder (const juce::File& folder)
+void SampleLibrary::sortByRank (const juce::Array<SampleItem>& items, SampleSortColumn column, juce::Array<int>& order)
 {
-    auto audioExtensions = juce::StringArray { "wav", "aif", "aiff", "mp3", "flac", "ogg", "m4a" };
+    auto numItems = items.size();
 
-    juce::Array<juce::File> files;
-    for (auto& ext : audioExtensions)
+    int maxRank = 0;
+    for (auto& item : items)
+        maxRank = juce::jmax (maxRank, item.sortRanks[column]);
+
+    order.clearQuick();
+    order.resize (numItems);
+
+    if (maxRank <= numItems * 8)
     {
-        auto found = folder.findChildFiles (juce::File::findFiles, true, "*." + ext);
-        files.addArray (found);
-    }
+        // Result is a dense enough slice of the library: bucket by rank.
+        // Stable, so not-yet-ranked samples (rank 0) keep their query order.
+        std::vector<int> starts ((size_t) maxRank + 2, 0);
+        for (auto& item : items)
+            ++starts[(size_t) item.sortRanks[column] + 1];
 
-    int total = files.size();
-    int processed = 0;
+        for (size_t r = 1; r < starts.size(); ++r)
+            starts[r] += starts[r - 1];
 
-    for (auto& f : files)
+        for (int i = 0; i < numItems; ++i)
+            order.set (starts[(size_t) items.getReference (i).sortRanks[column]]++, i);
+    }
+    else
     {
-        auto item = analyzeFile (f);
-        item.isFavorite = favoriteFiles.contains (f.getFullPathName());
-        allSamples.add (item);
+        // Small result from a large library: compare ranks directly
+        for (int i = 0; i < numItems; ++i)
+            order.set (i, i);
 
-        processed++;
-        analysisProgress = (float) processed / (float) juce::jmax (1, total);
+        std::sort (order.begin(), order.end(), [&items, column] (int a, int b)
+        {
+            auto rankA = items.getReference (a).sortRanks[column];
+            auto rankB = items.getReference (b).sortRanks[column];
+            return rankA != rankB ? rankA < rankB : a < b;
+        });
     }
 }
 
-SampleItem SampleLibrary::analyzeFile (const juce::File& file)
+std::pair<const int*, const int*> SampleLibrary::RangeIndex::find (const SampleQuery::ValueRange& range) const
 {
-    SampleItem item;
-    item.file = file;
-    item.name = file.getFileNameWithoutExtension();
-    item.fileSize = file.getSize();
+    auto first = std::lower_bound (values.begin(), values.end(), range.minimum);
+    auto last = std::upper_bound (first, values.end(), range.maximum);
+
+    auto* base = samples.data();
+    return { base + (first - values.begin()), base + (last - values.begin()) };
+}
 
-    // Try to read audio properties
-    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
-    if (reader != nullptr)
+void SampleLibrary::RangeIndex::update (const std::vector<int>& removedSamples, std::vector<std::pair<double, int>> added)
+{
+    // removedSamples is sorted. One pass drops them, another merges in the
+    // added entries, so an update costs no more than a copy of the index.
+    if (! removedSamples.empty())
     {
-        item.lengthSeconds = (double) reader->lengthInSamples / reader->sampleRate;
+        size_t numKept = 0;
+
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            if (! std::binary_search (removedSamples.begin(), removedSamples.end(), samples[i]))
+            {
+                values[numKept] = values[i];
+                samples[numKept] = samples[i];
+                ++numKept;
+            }
+        }
+
+        values.resize (numKept);
+        samples.resize (numKept);
     }
 
-    item.type = detectType (file, item.lengthSeconds);
-    item.bpm = guessBpmFromFilename (item.name);
-    item.key = guessKeyFromFilename (item.name);
-    item.tags = guessTagsFromPath (file);
+    if (added.empty())
+        return;
+
+    std::sort (added.begin(), added.end());
 
-    return item;
-}
+    std::vector<double> mergedValues;
+    std::vector<int> mergedSamples;
+    mergedValues.reserve (values.size() + added.size());
+    mergedSamples.reserve (values.size() + added.size());
 
-juce::String SampleLibrary::detectType (const juce::File& file, double lengthSec)
-{
-    auto name = file.getFileNameWithoutExtension().toLowerCase();
+    size_t next = 0;
 
-    if (name.contains ("loop") || lengthSec > 2.0)
-        return "Loop";
+    for (size_t i = 0; i <= values.size(); ++i)
+    {
+        while (next < added.size() && (i == values.size() || added[next].first < values[i]))
+        {
+            mergedValues.push_back (added[next].first);
+            mergedSamples.push_back (added[next].second);
+            ++next;
+        }
 
-    return "One-Shot";
+        if (i < values.size())
+        {
+            mergedValues.push_back (values[i]);
+            mergedSamples.push_back (samples[i]);
+        }
+    }
+
+    values.swap (mergedValues);
+    samples.swap (mergedSamples);
 }
 
-juce::String SampleLibrary::guessKeyFromFilename (const juce::String& name)
+void SampleLibrary::countTags (const juce::StringArray& tags, int delta)
 {
-    // Common key patterns: "C maj", "Am", "F#m", etc.
-    juce::StringArray notes = { "C", "C#", "Db", "D", "D#", "Eb", "E", "F", "F#", "Gb", "G", "G#", "Ab", "A", "A#", "Bb", "B" };
-    juce::StringArray qualities = { "maj", "min", "major", "minor", "m" };
+    for (auto& tag : tags)
+    {
+        auto count = (tagHistogram[tag] += delta);
 
-    auto lower = name.toLowerCase();
+        if (count <= 0)
+            tagHistogram.erase (tag);
+    }
+}
 
-    for (auto& note : notes)
+void SampleLibrary::setSampleTags (const juce::File& file, const juce::StringArray& tags)
+{
     {
-        for (auto& qual : qualities)
+        const juce::ScopedWriteLock sl (sampleLock);
+
+        for (int i = 0; i < allSamples.size(); ++i)
         {
-            auto pattern = note.toLowerCase() + " " + qual.toLowerCase();
-            if (lower.contains (pattern))
+            auto& item = allSamples.getReference (i);
+
+            if (item.file == file)
             {
-                juce::String result = note;
-                if (qual == "m" || qual == "min" || qual == "minor")
-                    result += " min";
-                else
-                    result += " maj";
-                return result;
+                countTags (item.tags, -1);
+
+                // Keep the tag postings current so tag: predicates still
+                // find retagged samples without a full re-index
+                if (i < (int) nameOrder.size())
+                {
+                    for (auto& tag : item.tags)
+                    {
+                        auto& posting = tagPostings[tag.toUpperCase()];
+                        auto it = std::lower_bound (posting.begin(), posting.end(), i);
+                        if (it != posting.end() && *it == i)
+                            posting.erase (it);
+                    }
+
+                    for (auto& tag : tags)
+                    {
+                        auto& posting = tagPostings[tag.toUpperCase()];
+                        auto it = std::lower_bound (posting.begin(), posting.end(), i);
+                        if (it == posting.end() || *it != i)
+                            posting.insert (it, i);
+                    }
+                }
+
+                item.tags = tags;
+                countTags (item.tags, 1);
+                break;
             }
         }
     }
 
-    return {};
+    sendChangeMessage();
 }
 
-double SampleLibrary::guessBpmFromFilename (const juce::String& name)
+//==============================================================================
+juce::Array<SampleItem> SampleLibrary::getFilteredSamples (const SampleQuery& query,
+                                                           TagCounts* facetCounts,
+                                                           const std::function<bool()>& shouldCancel) const
 {
-    // Look for patterns like "120bpm", "120 bpm", "bpm120"
-    auto lower = name.toLowerCase();
+    const TraceScope traceScope ("getFilteredSamples");
+    const juce::ScopedReadLock sl (sampleLock);
+
+    std::vector<int> candidates;
+    bool hasCandidates = collectCandidates (query, candidates);
+
+    FuzzyMatcher matcher (query.text);
+    if (! matcher.isEmpty())
+        return getRankedSamples (query, matcher, hasCandidates ? &candidates : nullptr, facetCounts, shouldCancel);
+
+    // Present results in name order: either the indexed candidates sorted by
+    // name rank, or the whole library walked in name order. Anything added
+    // since the last re-index follows in insertion order.
+    const auto numIndexed = (int) nameOrder.size();
 
-    // Pattern: digits followed by "bpm"
-    for (int i = 0; i < lower.length() - 2; ++i)
+    if (hasCandidates)
     {
-        if (juce::CharacterFunctions::isDigit (lower[i]))
+        auto indexedEnd = std::partition_point (candidates.begin(), candidates.end(),
+                                                [numIndexed] (int i) { return i < numIndexed; });
+
+        std::sort (candidates.begin(), indexedEnd, [this] (int a, int b)
         {
-            int start = i;
-            while (i < lower.length() && juce::CharacterFunctions::isDigit (lower[i]))
-                ++i;
+            return allSamples.getReference (a).sortRanks[sortByName] < allSamples.getReference (b).sortRanks[sortByName];
+        });
+    }
 
-            auto numStr = lower.substring (start, i);
+    const auto numToVisit = hasCandidates ? (int) candidates.size() : allSamples.size();
+    juce::Array<SampleItem> results;
 
-            // Check if followed by "bpm"
-            auto remaining = lower.substring (i).trimStart();
-            if (remaining.startsWith ("bpm"))
-            {
-                double bpm = numStr.getDoubleValue();
-                if (bpm >= 40.0 && bpm <= 300.0)
-                    return bpm;
-            }
-        }
+    for (int i = 0; i < numToVisit; ++i)
+    {
+        // Polling every item would dominate short scans, so check in strides
+        if (shouldCancel != nullptr && (i & 1023) == 0 && shouldCancel())
+            break;
+
+        auto index = hasCandidates ? candidates[(size_t) i]
+                                   : (i < numIndexed ? nameOrder[(size_t) i] : i);
+        auto& item = allSamples.getReference (index);
+
+        if (! query.matchesFields (item))
+            continue;
+
+        if (facetCounts != nullptr)
+            for (auto& tag : item.tags)
+                ++(*facetCounts)[tag];
+
+        if (query.matchesAnyOfTags (item))
+            results.add (item);
     }
 
-    // Pattern: "bpm" followed by digits
-    int bpmIdx = lower.indexOf ("bpm");
-    if (bpmIdx >= 0)
+    return results;
+}
+
+bool SampleLibrary::collectCandidates (const SampleQuery& query, std::vector<int>& candidates) const
+{
+    // Caller holds the read lock. Every indexed predicate knows exactly how
+    // many samples it admits, so drive the scan from the most selective one
+    // and let matchesFields() check the rest. Returns false when a full scan
+    // is as cheap, leaving candidates empty.
+    const auto numIndexed = (int) nameOrder.size();
+    if (numIndexed == 0)
+        return false;
+
+    using Span = std::pair<const int*, const int*>;
+    std::vector<Span> bestSpans;
+    auto bestCount = (size_t) numIndexed / 2;
+    bool found = false;
+
+    auto consider = [&] (std::vector<Span> spans)
     {
-        auto after = lower.substring (bpmIdx + 3).trimStart();
-        auto numStr = after.initialSectionContainingOnly ("0123456789.");
-        if (numStr.isNotEmpty())
+        size_t count = 0;
+        for (auto& span : spans)
+            count += (size_t) (span.second - span.first);
+
+        if (count < bestCount || (! found && count == bestCount))
         {
-            double bpm = numStr.getDoubleValue();
-            if (bpm >= 40.0 && bpm <= 300.0)
-                return bpm;
+            bestCount = count;
+            bestSpans = std::move (spans);
+            found = true;
         }
+    };
+
+    auto getPosting = [] (const auto& postings, const auto& key) -> Span
+    {
+        auto it = postings.find (key);
+        if (it == postings.end())
+            return { nullptr, nullptr };
+
+        return { it->second.data(), it->second.data() + it->second.size() };
+    };
+
+    if (query.bpm.active)
+        consider ({ bpmIndex.find (query.bpm) });
+
+    if (query.lengthSeconds.active)
+        consider ({ lengthIndex.find (query.lengthSeconds) });
+
+    if (! query.types.isEmpty())
+    {
+        std::vector<Span> spans;
+        for (auto& type : query.types)
+            spans.push_back (getPosting (typePostings, type));
+
+        consider (std::move (spans));
+    }
+
+    if (query.keyPitchClass >= 0)
+    {
+        std::vector<Span> spans;
+        if (query.keyMode != SampleQuery::minorMode)
+            spans.push_back (getPosting (keyPostings, SampleQuery::getKeyCode (query.keyPitchClass, SampleQuery::majorMode)));
+        if (query.keyMode != SampleQuery::majorMode)
+            spans.push_back (getPosting (keyPostings, SampleQuery::getKeyCode (query.keyPitchClass, SampleQuery::minorMode)));
+
+        consider (std::move (spans));
     }
 
-    return 0.0;
+    for (auto& tag : query.allOfTags)
+        consider ({ getPosting (tagPostings, tag) });
+
+    if (! found)
+        return false;
+
+    candidates.reserve (bestCount + (size_t) (allSamples.size() - numIndexed));
+
+    for (auto& span : bestSpans)
+        candidates.insert (candidates.end(), span.first, span.second);
+
+    // Unindexed samples always need checking
+    for (int i = numIndexed; i < allSamples.size(); ++i)
+        candidates.push_back (i);
+
+    return true;
 }
 
-juce::StringArray SampleLibrary::guessTagsFromPath (const juce::File& file)
+juce::Array<SampleItem> SampleLibrary::getRankedSamples (const SampleQuery& query,
+                                                         const FuzzyMatcher& matcher,
+                                                         const std::vector<int>* candidates,
+                                                         TagCounts* facetCounts,
+                                                         const std::function<bool()>& shouldCancel) const
 {
-    juce::StringArray tags;
-    auto path = file.getFullPathName().toLowerCase();
-    auto name = file.getFileNameWithoutExtension().toLowerCase();
-
-    // Category tags from path/filename
-    struct TagMapping { const char* keyword; const char* tag; };
-    TagMapping mappings[] = {
-        { "kick",      "DRUMS" },
-        { "snare",     "DRUMS" },
-        { "hihat",     "DRUMS" },
-        { "hi-hat",    "DRUMS" },
-        { "hat",       "DRUMS" },
-        { "clap",      "DRUMS" },
-        { "tom",       "DRUMS" },
-        { "cymbal",    "DRUMS" },
-        { "percussion","DRUMS" },
-        { "drum",      "DRUMS" },
-        { "bass",      "BASS" },
-        { "808",       "BASS" },
-        { "sub",       "BASS" },
-        { "synth",     "SYNTHS" },
-        { "lead",      "SYNTHS" },
-        { "pad",       "SYNTHS" },
-        { "keys",      "KEYS" },
-        { "piano",     "KEYS" },
-        { "organ",     "KEYS" },
-        { "guitar",    "GUITAR" },
-        { "vocal",     "VOCALS" },
-        { "vox",       "VOCALS" },
-        { "voice",     "VOCALS" },
-        { "fx",        "FX" },
-        { "effect",    "FX" },
-        { "riser",     "FX" },
-        { "sweep",     "FX" },
-        { "impact",    "FX" },
-        { "foley",     "FOLEY" },
-        { "ambient",   "AMBIENT" },
-        { "atmosphere","AMBIENT" },
-        { "texture",   "TEXTURE" },
-        { "loop",      "LOOPS" },
-        { "one shot",  "ONE-SHOTS" },
-        { "oneshot",   "ONE-SHOTS" },
-        { "one-shot",  "ONE-SHOTS" },
-        { "phone",     "TELEPHONES" },
-        { "telephone", "TELEPHONES" },
-        { "radio",     "RADIOS & STATIC" },
-        { "static",    "RADIOS & STATIC" },
-        { "sound effect", "SOUND EFFECTS" },
-        { "sfx",       "SOUND EFFECTS" },
-        { "string",    "STRINGS" },
-        { "brass",     "BRASS" },
-        { "horn",      "BRASS" },
-        { "flute",     "WOODWINDS" },
-        { "wind",      "WOODWINDS" },
+    // Caller holds the read lock. Keeps the best maxRankedResults matches in a
+    // min-heap. Without candidates the whole library is visited shortest name
+    // first: a name's length bounds its best possible score, so once that
+    // bound can't beat the heap's worst entry no later sample can either and
+    // the scan stops.
+    struct Candidate
+    {
+        int score;
+        int index;
+
+        bool operator> (const Candidate& other) const
+        {
+            return score != other.score ? score > other.score : index < other.index;
+        }
     };
 
-    for (auto& m : mappings)
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> best;
+
+    // Samples added since the last re-index aren't in lengthOrder yet, so
+    // visit them first without the early exit
+    const auto numOrdered = (int) lengthOrder.size();
+    const auto numSamples = allSamples.size();
+    const auto numToVisit = candidates != nullptr ? (int) candidates->size() : numSamples;
+    int stoppedEarlyAt = -1;
+
+    for (int i = 0; i < numToVisit; ++i)
     {
-        if (path.contains (m.keyword) || name.contains (m.keyword))
+        if (shouldCancel != nullptr && (i & 1023) == 0 && shouldCancel())
+            break;
+
+        int index = 0;
+        bool canStopEarly = false;
+
+        if (candidates != nullptr)
+            index = (*candidates)[(size_t) i];
+        else if (i < numSamples - numOrdered)
+            index = numOrdered + i;
+        else
         {
-            if (! tags.contains (m.tag))
-                tags.add (m.tag);
+            index = lengthOrder[(size_t) (i - (numSamples - numOrdered))];
+            canStopEarly = true;
         }
-    }
 
-    // If no tags found, add generic
-    if (tags.isEmpty())
-        tags.add ("UNCATEGORIZED");
+        auto& item = allSamples.getReference (index);
 
-    return tags;
-}
+        if (canStopEarly
+             && (int) best.size() == maxRankedResults
+             && matcher.getMaxScore (item.name.length()) <= best.top().score)
+        {
+            stoppedEarlyAt = i;
+            break;
+        }
 
-//==============================================================================
-juce::Array<SampleItem> SampleLibrary::getFilteredSamples (const juce::String& searchQuery,
-                                                           const juce::StringArray& activeTags,
-                                                           bool favoritesOnly) const
-{
-    juce::Array<SampleItem> results;
-    auto query = searchQuery.toLowerCase();
+        if (! query.matchesFields (item))
+            continue;
 
-    for (auto& item : allSamples)
-    {
-        // Favorites filter
-        if (favoritesOnly && ! item.isFavorite)
+        auto score = matcher.score (item.name, item.tags);
+        if (score <= 0)
             continue;
 
-        // Search filter
-        if (query.isNotEmpty())
-        {
-            bool matchesSearch = item.name.toLowerCase().contains (query);
+        if (facetCounts != nullptr)
+            for (auto& tag : item.tags)
+                ++(*facetCounts)[tag];
 
-            if (! matchesSearch)
-            {
-                for (auto& tag : item.tags)
-                {
-                    if (tag.toLowerCase().contains (query))
-                    {
-                        matchesSearch = true;
-                        break;
-                    }
-                }
-            }
+        if (! query.matchesAnyOfTags (item))
+            continue;
 
-            if (! matchesSearch)
-                continue;
+        Candidate candidate { score, index };
+
+        if ((int) best.size() < maxRankedResults)
+            best.push (candidate);
+        else if (candidate > best.top())
+        {
+            best.pop();
+            best.push (candidate);
         }
+    }
 
-        // Tag filter (OR mode)
-        if (! activeTags.isEmpty())
+    // The early exit only holds for the ranking: facet counts cover every
+    // match, so the rest of the library is still tested, just not scored
+    if (facetCounts != nullptr && stoppedEarlyAt >= 0)
+    {
+        for (int i = stoppedEarlyAt; i < numToVisit; ++i)
         {
-            bool matchesTag = false;
-            for (auto& tag : activeTags)
-            {
-                if (item.tags.contains (tag))
-                {
-                    matchesTag = true;
-                    break;
-                }
-            }
-            if (! matchesTag)
-                continue;
+            if (shouldCancel != nullptr && (i & 1023) == 0 && shouldCancel())
+                break;
+
+            auto& item = allSamples.getReference (lengthOrder[(size_t) (i - (numSamples - numOrdered))]);
+
+            if (query.matchesFields (item) && matcher.matches (item.name, item.tags))
+                for (auto& tag : item.tags)
+                    ++(*facetCounts)[tag];
         }
+    }
 
-        results.add (item);
+    // Heap pops worst first, so fill the result from the back
+    juce::Array<SampleItem> results;
+    results.resize ((int) best.size());
+
+    for (int i = results.size(); --i >= 0;)
+    {
+        results.setUnchecked (i, allSamples.getReference (best.top().index));
+        best.pop();
+    }
+
+    return results;
+}
+
+//==============================================================================
+juce::Array<SampleItem> SampleLibrary::getSimilarSamples (const juce::File& file, int maxResults) const
+{
+    // Ask for extra neighbours: some may belong to folders no longer in the library
+    auto paths = similarityIndex.findNearest (file.getFullPathName(), maxResults * 2);
+
+    const juce::ScopedReadLock sl (sampleLock);
+    juce::Array<SampleItem> results;
+
+    for (auto& path : paths)
+    {
+        auto it = sampleForPath.find (path);
+        if (it != sampleForPath.end())
+            results.add (allSamples.getReference (it->second));
+
+        if (results.size() >= maxResults)
+            break;
     }
 
     return results;
@@ -318,12 +1553,16 @@ void SampleLibrary::toggleFavorite (const juce::File& file)
         favoriteFiles.add (path);
 
     // Update in allSamples
-    for (auto& item : allSamples)
     {
-        if (item.file == file)
+        const juce::ScopedWriteLock sl (sampleLock);
+
+        for (auto& item : allSamples)
         {
-            item.isFavorite = favoriteFiles.contains (path);
-            break;
+            if (item.file == file)
+            {
+                item.isFavorite = favoriteFiles.contains (path);
+                break;
+            }
         }
     }
 
@@ -338,23 +1577,94 @@ bool SampleLibrary::isFavorite (const juce::File& file) const
 
 juce::StringArray SampleLibrary::getAllTags() const
 {
+    // The histogram only holds tags with a non-zero count, so its keys are
+    // already the unique tag set
     juce::StringArray tags;
-    for (auto& item : allSamples)
-        for (auto& tag : item.tags)
-            if (! tags.contains (tag))
-                tags.add (tag);
+    tags.ensureStorageAllocated ((int) tagHistogram.size());
+
+    for (auto& entry : tagHistogram)
+        tags.add (entry.first);
 
     tags.sort (true);
     return tags;
 }
 
+//==============================================================================
+juce::File SampleLibrary::getTagTaxonomyFile() const
+{
+    return getSettingsFile().getSiblingFile ("tag_taxonomy.txt");
+}
+
+bool SampleLibrary::reloadTagTaxonomy()
+{
+    auto file = getTagTaxonomyFile();
+
+    if (! file.existsAsFile())
+        file.replaceWithText (TagClassifier::getDefaultTaxonomy());
+
+    auto modificationTime = file.getLastModificationTime();
+    if (modificationTime == taxonomyModificationTime)
+        return false;
+
+    taxonomyModificationTime = modificationTime;
+
+    if (! tagClassifier.loadTaxonomy (file.loadFileAsString()))
+        return false;
+
+    if (allSamples.isEmpty())
+        return false;
+
+    retagAllSamples();
+    return true;
+}
+
+void SampleLibrary::retagAllSamples()
+{
+    // Classification only needs the paths already in memory, so this is
+    // bounded by CPU rather than disk
+    std::vector<juce::StringArray> newTags ((size_t) allSamples.size());
+
+    runOnPool (scanPool, allSamples.size(), [&] (int i)
+    {
+        newTags[(size_t) i] = guessTagsFromPath (allSamples.getReference (i).file);
+    });
+
+    {
+        const juce::ScopedWriteLock sl (sampleLock);
+
+        tagHistogram.clear();
+        tagPostings.clear();
+
+        for (int i = 0; i < allSamples.size(); ++i)
+        {
+            auto& item = allSamples.getReference (i);
+            item.tags = std::move (newTags[(size_t) i]);
+            countTags (item.tags, 1);
+
+            if (i < (int) nameOrder.size())
+                for (auto& tag : item.tags)
+                    tagPostings[tag.toUpperCase()].push_back (i);
+        }
+    }
+
+    sendChangeMessage();
+}
+
 //==============================================================================
 juce::File SampleLibrary::getSettingsFile() const
 {
-    auto appData = juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
-                       .getChildFile ("SoundXplorer");
-    appData.createDirectory();
-    return appData.getChildFile ("library_settings.xml");
+    stateDirectory.createDirectory();
+    return stateDirectory.getChildFile ("library_settings.xml");
+}
+
+juce::File SampleLibrary::getSimilarityIndexFile() const
+{
+    return getSettingsFile().getSiblingFile ("similarity.index");
+}
+
+juce::File SampleLibrary::getMetadataCacheFile() const
+{
+    return getSettingsFile().getSiblingFile ("metadata.cache");
 }
 
 void SampleLibrary::saveState()
@@ -370,6 +1680,12 @@ void SampleLibrary::saveState()
         favoritesXml->createNewChildElement ("File")->setAttribute ("path", fav);
 
     xml->writeTo (getSettingsFile());
+
+    if (similarityIndexChanged.exchange (false))
+        similarityIndex.save (getSimilarityIndexFile());
+
+    if (metadataCache.hasChanged())
+        metadataCache.save (getMetadataCacheFile());
 }
 
 void SampleLibrary::loadState()
@@ -400,7 +1716,14 @@ void SampleLibrary::loadState()
             favoriteFiles.add (favXml->getStringAttribute ("path"));
     }
 
+    // Metadata and embeddings from earlier sessions spare re-analysing unchanged files
+    metadataCache.load (getMetadataCacheFile());
+    similarityIndex.load (getSimilarityIndexFile());
+
     // Scan all folders
     for (auto& folder : libraryFolders)
         scanFolder (folder);
+
+    if (similarityIndexChanged || metadataCache.hasChanged())
+        saveState();
 }
@@ -1,5 +1,28 @@
 #pragma once
 #include <JuceHeader.h>
+#include "FuzzyMatcher.h"
+#include "SampleQuery.h"
+#include "SimilarityIndex.h"
+#include "MetadataCache.h"
+#include "TagClassifier.h"
+#include "FilenameHints.h"
+#include "AnalysisQueue.h"
+#include "LibraryIndexFile.h"
+#include "AudioFormatRegistry.h"
+#include "FileProber.h"
+#include "AnalysisWorkerPool.h"
+
+//==============================================================================
+// Orders the library maintains for its samples (see SampleItem::sortRanks)
+//==============================================================================
+enum SampleSortColumn
+{
+    sortByName = 0,
+    sortByType,
+    sortByBpm,
+    sortByKey,
+    numSortColumns
+};
 
 //==============================================================================
 // Represents a single audio sample file with metadata
@@ -15,15 +38,54 @@ struct SampleItem
     bool isFavorite = false;
     int64_t fileSize = 0;
     double lengthSeconds = 0.0;
+    LoudnessAnalyzer::Measurement loudness;
+    double onsetSeconds = 0.0;  // leading silence before the first transient
+
+    // Position of this sample in each of the library's sorted orders, indexed
+    // by SampleSortColumn. Ties are broken by name, so ranks are unique once
+    // the library has re-sorted; samples added since then have rank 0, and
+    // samples analysed during a scan keep their type, key and BPM ranks
+    // until the scan's queue drains.
+    int sortRanks[numSortColumns] = {};
+
+    // Samples whose decoded audio is identical share a group (-1 if unique).
+    // All but the first copy in the library are flagged as copies.
+    int duplicateGroup = -1;
+    bool isDuplicateCopy = false;
+
+    // False until the file has been opened: until then length is 0 and type,
+    // BPM and key are guesses from the name
+    bool isAnalysed = true;
 };
 
 //==============================================================================
 // Manages the library of audio samples
+//
+// The library is mutated on the message thread only. Queries may also run on
+// a background thread, so mutations take sampleLock for writing and
+// getFilteredSamples takes it for reading.
+//
+// Scanning a folder lists its files straight away. Files the metadata cache
+// doesn't know are then opened on an analysis thread, and the results are
+// merged back on the message thread a few times a second. Given a worker
+// executable, the files are opened in worker processes instead (see
+// AnalysisWorkerPool), so a decoder crash can't take the library's process
+// with it.
 //==============================================================================
-class SampleLibrary : public juce::ChangeBroadcaster
+class SampleLibrary : public juce::ChangeBroadcaster,
+                      private juce::Thread,
+                      private juce::AsyncUpdater
 {
 public:
-    SampleLibrary();
+    // Tag name -> number of samples carrying that tag
+    using TagCounts = std::map<juce::String, int>;
+
+    // Settings, caches and indices live in stateDirectory, or in the user's
+    // application data folder if none is given. Saved folders are rescanned
+    // on construction. Without an analysisWorkerExecutable, or if it can't be
+    // started, files are analysed in this process.
+    explicit SampleLibrary (const juce::File& stateDirectory = {},
+                            const juce::File& analysisWorkerExecutable = {});
     ~SampleLibrary() override;
 
     // Library management
@@ -33,11 +95,46 @@ public:
 
     const juce::Array<juce::File>& getLibraryFolders() const { return libraryFolders; }
 
+    // Moves files ahead in the analysis queue, e.g. the rows on screen
+    void prioritiseAnalysis (const juce::Array<juce::File>& files, AnalysisQueue::Priority priority);
+
+    // Analyses everything still queued, partly on the calling thread, and
+    // merges the results. For tools that need a complete library at once.
+    void finishPendingAnalysis();
+
+    // Writes the analysis of a library folder's files into a sidecar at its
+    // root (see LibraryIndexFile). Scans adopt a folder's sidecar before
+    // analysing anything, so other machines sharing the folder skip the work.
+    bool writeLibraryIndex (const juce::File& folder) const;
+
     // Sample access
     const juce::Array<SampleItem>& getAllSamples() const { return allSamples; }
-    juce::Array<SampleItem> getFilteredSamples (const juce::String& searchQuery,
-                                                 const juce::StringArray& activeTags,
-                                                 bool favoritesOnly) const;
+    // If facetCounts is given, it receives the tag counts of every sample that
+    // passes the query except its tag bar selection (so that unselected tags
+    // still show how many results they would add).
+    // shouldCancel is polled during the scan; once it returns true the scan
+    // stops early and the partial result should be discarded.
+    // Without search text, results come back sorted by name. With it,
+    // matching is typo-tolerant and only the best maxRankedResults come back,
+    // best match first.
+    juce::Array<SampleItem> getFilteredSamples (const SampleQuery& query,
+                                                 TagCounts* facetCounts = nullptr,
+                                                 const std::function<bool()>& shouldCancel = {}) const;
+
+    static constexpr int maxRankedResults = 5000;
+
+    // Fills order with indices into items sorted by their rank in the given
+    // column. Stable, so samples added since the last re-sort keep their
+    // relative order.
+    static void sortByRank (const juce::Array<SampleItem>& items, SampleSortColumn column, juce::Array<int>& order);
+
+    // Library samples that sound most like the given file, closest first.
+    // Empty if the file hasn't been analysed.
+    juce::Array<SampleItem> getSimilarSamples (const juce::File& file, int maxResults) const;
+
+    // Duplicates: each group lists the paths of files with identical audio
+    juce::Array<juce::StringArray> getDuplicateGroups() const;
+    juce::Array<SampleItem> getDuplicatesOf (const juce::File& file) const;
 
     // Favorites
     void toggleFavorite (const juce::File& file);
@@ -45,6 +142,16 @@ public:
 
     // Tags
     juce::StringArray getAllTags() const;
+    const TagCounts& getTagHistogram() const { return tagHistogram; }
+    void setSampleTags (const juce::File& file, const juce::StringArray& tags);
+
+    // The keyword -> tag taxonomy used to tag scanned files. A default one is
+    // written on first use so that it can be edited.
+    juce::File getTagTaxonomyFile() const;
+    // Re-reads the taxonomy file if it changed and, if so, retags every
+    // sample from its path without touching the audio files. Returns true
+    // if the library was retagged.
+    bool reloadTagTaxonomy();
 
     // Persistence
     void saveState();
@@ -53,23 +160,161 @@ public:
     int getTotalFileCount() const { return allSamples.size(); }
     float getAnalysisProgress() const { return analysisProgress.load(); }
 
+    // Stores estimated heap use in PerformanceCounters. Walks every sample,
+    // index node and cache entry, so only call it while the figures are
+    // being looked at.
+    void updateMemoryEstimate() const;
+
 private:
     void scanFolder (const juce::File& folder);
-    SampleItem analyzeFile (const juce::File& file);
-    juce::String detectType (const juce::File& file, double lengthSec);
-    juce::String guessKeyFromFilename (const juce::String& name);
-    double guessBpmFromFilename (const juce::String& name);
+    void adoptLibraryIndex (const juce::File& folder);
+    bool takeSharedEmbedding (const juce::String& path, juce::int64 modificationTime,
+                              std::optional<SimilarityIndex::Embedding>& embedding);
+
+    // Fills metadata from the cache and works out what opening the file
+    // would add: metadata and an audio hash the cache lacks, and a timbre
+    // embedding unless the similarity index or a sidecar has a current one
+    // (which goes into newEmbedding). Returns false if the file needn't be
+    // opened.
+    bool prepareProbe (const juce::File& file, CachedMetadata& metadata, FileProber::Request& request,
+                       std::optional<SimilarityIndex::Embedding>& newEmbedding);
+    // Takes what a probe found into metadata, the cache and newEmbedding
+    void finishProbe (const FileProber::Request& request, const FileProber::Result& probeResult,
+                      CachedMetadata& metadata, std::optional<SimilarityIndex::Embedding>& newEmbedding);
+    // Everything but tags, from the name and, if known, the metadata
+    SampleItem describeFile (const juce::File& file, const CachedMetadata* metadata) const;
+    juce::String detectType (const FilenameHints& hints, double lengthSec) const;
     juce::StringArray guessTagsFromPath (const juce::File& file);
 
+    // Background analysis
+    struct AnalysedFile
+    {
+        SampleItem item;
+        juce::int64 modificationTime = 0;
+        std::optional<SimilarityIndex::Embedding> embedding;
+    };
+
+    void run() override;
+    void handleAsyncUpdate() override;
+    void analyseFiles (const juce::Array<juce::File>& files);
+    void mergeAnalysedFiles();
+
+    // Spreads items over the pool's threads and the calling thread, and
+    // returns once all are done
+    static void runOnPool (juce::ThreadPool& pool, int numItems, const std::function<void (int)>& processItem);
+    // Groups samples by the audio hashes probing stored in the metadata
+    // cache; decodes nothing
+    void detectDuplicates();
+
+    void retagAllSamples();
+
+    void addSample (const SampleItem& item);
+    void removeSample (int index);
+    void countTags (const juce::StringArray& tags, int delta);
+    void rebuildIndices();
+
+    // A merged sample's analysed fields as they were before the merge
+    struct AnalysedFields
+    {
+        int sample;
+        juce::String type, key;
+        double bpm, lengthSeconds;
+    };
+
+    // Moves merged samples between the type and key postings and the BPM
+    // and length range indices, without touching the rest
+    void updateAnalysedIndices (std::vector<AnalysedFields> previous);
+    // Re-ranks the type, key and BPM columns from nameOrder
+    void rerankAnalysedColumns();
+    static int getKeyPostingsCode (const juce::String& key);     // -1 if the key doesn't parse
+
+    void clearIndices();
+
+    bool collectCandidates (const SampleQuery& query, std::vector<int>& candidates) const;
+    juce::Array<SampleItem> getRankedSamples (const SampleQuery& query,
+                                              const FuzzyMatcher& matcher,
+                                              const std::vector<int>* candidates,
+                                              TagCounts* facetCounts,
+                                              const std::function<bool()>& shouldCancel) const;
+
+    // Sample indices sorted by a numeric field, for range predicates
+    struct RangeIndex
+    {
+        std::vector<double> values;
+        std::vector<int> samples;
+
+        std::pair<const int*, const int*> find (const SampleQuery::ValueRange& range) const;
+
+        // Drops removedSamples (sorted) and adds (value, sample) entries
+        void update (const std::vector<int>& removedSamples, std::vector<std::pair<double, int>> added);
+    };
+
     juce::Array<juce::File> libraryFolders;
     juce::Array<SampleItem> allSamples;
     juce::StringArray favoriteFiles;
 
+    // Maintained incrementally by addSample/removeSample/setSampleTags
+    TagCounts tagHistogram;
+
+    // Lowercased names, parallel to allSamples, so sorting never case-folds
+    juce::StringArray nameCollationKeys;
+
+    // Indices built by rebuildIndices(). They cover the first
+    // nameOrder.size() samples; samples added since sit past their end and
+    // any removal clears them all. Analysis results patch the postings and
+    // range indices as they are merged.
+    std::vector<int> nameOrder;     // by name
+    std::vector<int> lengthOrder;   // by ascending name length
+    RangeIndex bpmIndex;
+    RangeIndex lengthIndex;         // by duration
+    std::map<juce::String, std::vector<int>> typePostings;  // lowercase type
+    std::map<int, std::vector<int>> keyPostings;            // SampleQuery::getKeyCode
+    std::map<juce::String, std::vector<int>> tagPostings;   // uppercase tag
+    std::unordered_map<juce::String, int> sampleForPath;
+
+    juce::Array<juce::StringArray> duplicateGroups;
+
+    juce::ReadWriteLock sampleLock;
+
     std::atomic<float> analysisProgress { 0.0f };
 
+    AnalysisQueue analysisQueue;
+    juce::CriticalSection analysedFilesLock;
+    std::vector<AnalysedFile> analysedFiles;    // waiting to be merged
+    bool hasUnsavedAnalysis = false;
+
+    juce::File stateDirectory;
+
     juce::File getSettingsFile() const;
+    juce::File getSimilarityIndexFile() const;
+    juce::File getMetadataCacheFile() const;
+
+    MetadataCache metadataCache;
+
+    TagClassifier tagClassifier;
+    juce::Time taxonomyModificationTime;
+
+    SimilarityIndex similarityIndex;
+    std::atomic<bool> similarityIndexChanged { false };
+
+    // Embeddings from library sidecars, taken by prepareProbe instead of decoding
+    juce::CriticalSection sharedEmbeddingsLock;
+    std::unordered_map<juce::String, std::pair<juce::int64, SimilarityIndex::Embedding>> sharedEmbeddings;
+
+    // Probers for analysing in this process, reused across files
+    juce::CriticalSection proberPoolLock;
+    std::vector<std::unique_ptr<FileProber>> idleProbers;
+
+    std::unique_ptr<FileProber> acquireProber();
+    void releaseProber (std::unique_ptr<FileProber> prober);
+
+    // Folder scans and retagging, which the message thread waits for, don't
+    // share threads with background analysis, whose jobs can decode and hash
+    // whole files
+    juce::ThreadPool scanPool;
+    juce::ThreadPool analysisPool;
 
-    juce::AudioFormatManager formatManager;
+    std::unique_ptr<AnalysisWorkerPool> workerPool;     // null when analysing in this process
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleLibrary)
 };
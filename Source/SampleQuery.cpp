@@ -0,0 +1,265 @@
+#include "SampleQuery.h"
+#include "SampleLibrary.h"
+
+//==============================================================================
+// Splits on whitespace, keeping double-quoted runs (which may follow a
+// "field:" prefix) together and dropping the quotes
+static juce::StringArray tokenise (const juce::String& text)
+{
+    juce::StringArray tokens;
+    juce::String current;
+    bool inQuotes = false;
+
+    for (auto p = text.getCharPointer(); ! p.isEmpty();)
+    {
+        auto c = p.getAndAdvance();
+
+        if (c == '"')
+            inQuotes = ! inQuotes;
+        else if (! inQuotes && juce::CharacterFunctions::isWhitespace (c))
+        {
+            if (current.isNotEmpty())
+                tokens.add (current);
+
+            current.clear();
+        }
+        else
+            current << juce::String::charToString (c);
+    }
+
+    if (current.isNotEmpty())
+        tokens.add (current);
+
+    return tokens;
+}
+
+// "120", "2s", "500ms" -> value in base units (seconds for lengths)
+static bool parseNumber (const juce::String& text, bool isLength, double& value)
+{
+    auto number = text.initialSectionContainingOnly ("0123456789.");
+    if (number.isEmpty())
+        return false;
+
+    auto unit = text.substring (number.length()).toLowerCase();
+    value = number.getDoubleValue();
+
+    if (! isLength)
+        return unit.isEmpty();
+
+    if (unit.isEmpty() || unit == "s" || unit == "sec")
+        return true;
+
+    if (unit == "ms")
+    {
+        value /= 1000.0;
+        return true;
+    }
+
+    if (unit == "m" || unit == "min")
+    {
+        value *= 60.0;
+        return true;
+    }
+
+    return false;
+}
+
+// "120", "120-128", "<2s", ">=100" -> inclusive range
+static bool parseRange (const juce::String& text, bool isLength, SampleQuery::ValueRange& range)
+{
+    // An exact value matches anything that would display the same
+    const double tolerance = isLength ? 0.05 : 0.5;
+    double value = 0.0;
+
+    if (text.startsWith ("<=") || text.startsWith (">="))
+    {
+        if (! parseNumber (text.substring (2), isLength, value))
+            return false;
+
+        (text[0] == '<' ? range.maximum : range.minimum) = value;
+    }
+    else if (text.startsWith ("<") || text.startsWith (">"))
+    {
+        if (! parseNumber (text.substring (1), isLength, value))
+            return false;
+
+        // Strict bounds on continuous values: nudge by the smallest useful step
+        if (text[0] == '<')
+            range.maximum = value - 1.0e-6;
+        else
+            range.minimum = value + 1.0e-6;
+    }
+    else if (text.containsChar ('-'))
+    {
+        double low = 0.0, high = 0.0;
+        if (! parseNumber (text.upToFirstOccurrenceOf ("-", false, false), isLength, low)
+             || ! parseNumber (text.fromFirstOccurrenceOf ("-", false, false), isLength, high))
+            return false;
+
+        range.minimum = juce::jmin (low, high);
+        range.maximum = juce::jmax (low, high);
+    }
+    else
+    {
+        if (! parseNumber (text, isLength, value))
+            return false;
+
+        range.minimum = value - tolerance;
+        range.maximum = value + tolerance;
+    }
+
+    range.active = true;
+    return true;
+}
+
+//==============================================================================
+SampleQuery SampleQuery::parse (const juce::String& searchText)
+{
+    SampleQuery query;
+    juce::StringArray words;
+
+    for (auto& token : tokenise (searchText))
+    {
+        auto negated = token.startsWithChar ('-');
+        auto field = token.substring (negated ? 1 : 0).upToFirstOccurrenceOf (":", false, false).toLowerCase();
+        auto value = token.fromFirstOccurrenceOf (":", false, false).trim();
+
+        bool recognised = token.containsChar (':') && value.isNotEmpty();
+
+        if (recognised)
+        {
+            if (field == "tag")
+                (negated ? query.noneOfTags : query.allOfTags).addIfNotAlreadyThere (value.toUpperCase());
+            else if (field == "type")
+                (negated ? query.excludedTypes : query.types).addIfNotAlreadyThere (normaliseType (value));
+            else if (negated)
+                recognised = false;
+            else if (field == "bpm")
+                recognised = parseRange (value, false, query.bpm);
+            else if (field == "len" || field == "length")
+                recognised = parseRange (value, true, query.lengthSeconds);
+            else if (field == "key")
+                recognised = parseKey (value, query.keyPitchClass, query.keyMode);
+            else
+                recognised = false;
+        }
+
+        if (! recognised)
+            words.add (token);
+    }
+
+    query.text = words.joinIntoString (" ");
+    return query;
+}
+
+//==============================================================================
+bool SampleQuery::matchesFields (const SampleItem& item) const
+{
+    // Cheapest checks first
+    if (favoritesOnly && ! item.isFavorite)
+        return false;
+
+    if (hideDuplicates && item.isDuplicateCopy)
+        return false;
+
+    if (bpm.active && ! bpm.contains (item.bpm))
+        return false;
+
+    if (lengthSeconds.active && ! lengthSeconds.contains (item.lengthSeconds))
+        return false;
+
+    if (! types.isEmpty() && ! types.contains (item.type, true))
+        return false;
+
+    if (excludedTypes.contains (item.type, true))
+        return false;
+
+    if (keyPitchClass >= 0)
+    {
+        int pitchClass = -1;
+        KeyMode mode = anyMode;
+
+        if (! parseKey (item.key, pitchClass, mode) || pitchClass != keyPitchClass)
+            return false;
+
+        if (keyMode != anyMode && mode != keyMode)
+            return false;
+    }
+
+    for (auto& tag : allOfTags)
+        if (! item.tags.contains (tag, true))
+            return false;
+
+    for (auto& tag : noneOfTags)
+        if (item.tags.contains (tag, true))
+            return false;
+
+    return true;
+}
+
+bool SampleQuery::matchesAnyOfTags (const SampleItem& item) const
+{
+    if (anyOfTags.isEmpty())
+        return true;
+
+    for (auto& tag : anyOfTags)
+        if (item.tags.contains (tag))
+            return true;
+
+    return false;
+}
+
+//==============================================================================
+bool SampleQuery::parseKey (const juce::String& keyText, int& pitchClass, KeyMode& mode)
+{
+    auto text = keyText.toLowerCase().removeCharacters (" _-");
+    if (text.isEmpty())
+        return false;
+
+    static const int letterPitches[] = { 9, 11, 0, 2, 4, 5, 7 };  // a b c d e f g
+
+    auto letter = text[0];
+    if (letter < 'a' || letter > 'g')
+        return false;
+
+    int pitch = letterPitches[letter - 'a'];
+    int index = 1;
+
+    if (text[index] == '#')
+    {
+        ++pitch;
+        ++index;
+    }
+    else if (text[index] == 'b')  // no mode suffix starts with 'b', so this is a flat
+    {
+        --pitch;
+        ++index;
+    }
+
+    auto suffix = text.substring (index);
+    KeyMode parsedMode = anyMode;
+
+    if (suffix == "m" || suffix == "min" || suffix == "minor")
+        parsedMode = minorMode;
+    else if (suffix == "maj" || suffix == "major")
+        parsedMode = majorMode;
+    else if (suffix.isNotEmpty())
+        return false;
+
+    pitchClass = (pitch + 12) % 12;
+    mode = parsedMode;
+    return true;
+}
+
+juce::String SampleQuery::normaliseType (const juce::String& typeText)
+{
+    auto compact = typeText.toLowerCase().removeCharacters (" _-");
+
+    if (compact == "oneshot" || compact == "shot")
+        return "one-shot";
+
+    if (compact == "loop" || compact == "loops")
+        return "loop";
+
+    return typeText.toLowerCase();
+}
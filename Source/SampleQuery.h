@@ -0,0 +1,68 @@
+#pragma once
+#include <JuceHeader.h>
+
+struct SampleItem;
+
+//==============================================================================
+// A parsed library query.
+//
+// Search text may mix free text with field predicates, e.g.
+//   kick bpm:120-128 key:"A min" type:loop len:<2s tag:drums -tag:fx
+//
+//   bpm:120  bpm:120-128  bpm:>=100   numeric, also <, <=, >
+//   len:<2s  len:500ms-1.5s           length, seconds unless "ms" is given
+//   key:"A min"  key:F#m  key:Db      pitch class, mode optional
+//   type:loop  type:oneshot           "-type:" excludes
+//   tag:drums                         all must match, "-tag:" excludes
+//
+// Anything that isn't a recognised predicate is free text for the fuzzy
+// matcher. The tag bar's OR selection and the favorites toggle are set by the
+// caller after parsing.
+//==============================================================================
+struct SampleQuery
+{
+    // Inclusive bounds. Zero means "unknown" for both BPM and length, so an
+    // active range never matches it.
+    struct ValueRange
+    {
+        double minimum = 0.0;
+        double maximum = std::numeric_limits<double>::infinity();
+        bool active = false;
+
+        bool contains (double value) const  { return value > 0.0 && value >= minimum && value <= maximum; }
+    };
+
+    enum KeyMode { anyMode, majorMode, minorMode };
+
+    juce::String text;
+
+    ValueRange bpm;
+    ValueRange lengthSeconds;
+
+    int keyPitchClass = -1;     // 0 = C ... 11 = B, -1 for no key predicate
+    KeyMode keyMode = anyMode;
+
+    juce::StringArray types;            // lowercase, any may match
+    juce::StringArray excludedTypes;
+    juce::StringArray allOfTags;        // uppercase
+    juce::StringArray noneOfTags;
+
+    juce::StringArray anyOfTags;        // tag bar selection (OR)
+    bool favoritesOnly = false;
+    bool hideDuplicates = false;        // show only the first copy of identical audio
+
+    static SampleQuery parse (const juce::String& searchText);
+
+    // Everything except the free text and the tag bar selection
+    bool matchesFields (const SampleItem& item) const;
+    bool matchesAnyOfTags (const SampleItem& item) const;
+
+    // Key names such as "F maj", "C# min", "Am", "Bbminor" -> pitch class and
+    // mode. Returns false if the text isn't a key.
+    static bool parseKey (const juce::String& keyText, int& pitchClass, KeyMode& mode);
+
+    // Index key used for per-key postings: pitch class * 2 + (minor ? 1 : 0)
+    static int getKeyCode (int pitchClass, KeyMode mode) { return pitchClass * 2 + (mode == minorMode ? 1 : 0); }
+
+    static juce::String normaliseType (const juce::String& typeText);
+};
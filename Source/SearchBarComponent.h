@@ -17,6 +17,9 @@ public:
     juce::String getSearchText() const { return searchEditor.getText(); }
     void clear() { searchEditor.clear(); }
 
+    // Doesn't call onSearchChanged
+    void setSearchText (const juce::String& text) { searchEditor.setText (text, false); }
+
     std::function<void (const juce::String&)> onSearchChanged;
 
     void textEditorTextChanged (juce::TextEditor& editor) override;
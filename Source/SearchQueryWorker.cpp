@@ -0,0 +1,99 @@
+#include "SearchQueryWorker.h"
+#include "PerformanceCounters.h"
+#include "TraceRecorder.h"
+
+//==============================================================================
+SearchQueryWorker::SearchQueryWorker (SampleLibrary& lib)
+    : juce::Thread ("SoundXplorer Query"),
+      library (lib)
+{
+    startThread();
+}
+
+SearchQueryWorker::~SearchQueryWorker()
+{
+    // Invalidate any running scan so it bails out at its next cancel check
+    ++generation;
+    signalThreadShouldExit();
+    notify();
+    stopThread (2000);
+    cancelPendingUpdate();
+}
+
+//==============================================================================
+void SearchQueryWorker::submit (const SampleQuery& sampleQuery)
+{
+    auto query = std::make_unique<Query>();
+    query->query = sampleQuery;
+    query->generation = ++generation;
+
+    {
+        const juce::ScopedLock sl (lock);
+        pendingQuery = std::move (query);
+    }
+
+    notify();
+}
+
+//==============================================================================
+void SearchQueryWorker::run()
+{
+    TraceRecorder::getInstance().registerThisThread();
+
+    while (! threadShouldExit())
+    {
+        std::unique_ptr<Query> query;
+
+        {
+            const juce::ScopedLock sl (lock);
+            query = std::move (pendingQuery);
+        }
+
+        if (query == nullptr)
+        {
+            wait (-1);
+            continue;
+        }
+
+        auto queryGeneration = query->generation;
+        auto isStale = [this, queryGeneration]
+        {
+            return threadShouldExit() || generation.load() != queryGeneration;
+        };
+
+        auto result = std::make_unique<Result>();
+        result->generation = queryGeneration;
+
+        auto startTime = juce::Time::getMillisecondCounterHiRes();
+        result->samples = library.getFilteredSamples (query->query, &result->facetCounts, isStale);
+
+        // A newer query arrived mid-scan: the partial result is useless
+        if (isStale())
+            continue;
+
+        PerformanceCounters::getInstance().queryLatency.record (juce::Time::getMillisecondCounterHiRes() - startTime);
+
+        {
+            const juce::ScopedLock sl (lock);
+            completedResult = std::move (result);
+        }
+
+        triggerAsyncUpdate();
+    }
+}
+
+void SearchQueryWorker::handleAsyncUpdate()
+{
+    std::unique_ptr<Result> result;
+
+    {
+        const juce::ScopedLock sl (lock);
+        result = std::move (completedResult);
+    }
+
+    if (result == nullptr || result->generation != generation.load())
+        return;
+
+    if (onResultsReady)
+        onResultsReady (result->samples, result->facetCounts);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <JuceHeader.h>
+#include "SampleLibrary.h"
+
+//==============================================================================
+// Runs library queries on a background thread for search-as-you-type.
+//
+// Every submit() bumps a generation counter. A query that is still scanning
+// when a newer one arrives notices the changed generation and stops early, and
+// only the result matching the latest generation is published back to the
+// message thread through onResultsReady.
+//==============================================================================
+class SearchQueryWorker : private juce::Thread,
+                          private juce::AsyncUpdater
+{
+public:
+    explicit SearchQueryWorker (SampleLibrary& library);
+    ~SearchQueryWorker() override;
+
+    // Message thread only
+    void submit (const SampleQuery& query);
+
+    std::function<void (const juce::Array<SampleItem>&, const SampleLibrary::TagCounts&)> onResultsReady;
+
+private:
+    struct Query
+    {
+        SampleQuery query;
+        uint32_t generation = 0;
+    };
+
+    struct Result
+    {
+        juce::Array<SampleItem> samples;
+        SampleLibrary::TagCounts facetCounts;
+        uint32_t generation = 0;
+    };
+
+    void run() override;
+    void handleAsyncUpdate() override;
+
+    SampleLibrary& library;
+
+    std::atomic<uint32_t> generation { 0 };
+
+    juce::CriticalSection lock;
+    std::unique_ptr<Query> pendingQuery;      // guarded by lock
+    std::unique_ptr<Result> completedResult;  // guarded by lock
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SearchQueryWorker)
+};
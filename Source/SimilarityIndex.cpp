@@ -0,0 +1,501 @@
+#include "SimilarityIndex.h"
+
+//==============================================================================
+SimilarityIndex::SimilarityIndex()
+{
+}
+
+float SimilarityIndex::getDistance (const float* query, int node) const
+{
+    // Embeddings are unit length, so this is cosine distance
+    return 1.0f - TimbreAnalyzer::dotProduct (query, getVector (node), TimbreAnalyzer::numDimensions);
+}
+
+//==============================================================================
+std::vector<SimilarityIndex::Neighbour> SimilarityIndex::searchLayer (const float* query, int entry,
+                                                                      int searchWidth, int level) const
+{
+    // Best-first search: candidates is a min-heap of nodes still to expand,
+    // found a max-heap of the best searchWidth nodes seen so far
+    if (visitMarks.size() < nodes.size())
+        visitMarks.resize (nodes.size(), 0);
+
+    if (++visitMark == 0)
+    {
+        std::fill (visitMarks.begin(), visitMarks.end(), 0);
+        visitMark = 1;
+    }
+
+    std::priority_queue<Neighbour, std::vector<Neighbour>, std::greater<Neighbour>> candidates;
+    std::priority_queue<Neighbour> found;
+
+    auto entryDistance = getDistance (query, entry);
+    candidates.push ({ entryDistance, entry });
+    found.push ({ entryDistance, entry });
+    visitMarks[(size_t) entry] = visitMark;
+
+    while (! candidates.empty())
+    {
+        auto current = candidates.top();
+
+        if (current.first > found.top().first && (int) found.size() >= searchWidth)
+            break;
+
+        candidates.pop();
+
+        for (auto neighbour : nodes[(size_t) current.second].links[(size_t) level])
+        {
+            if (visitMarks[(size_t) neighbour] == visitMark)
+                continue;
+
+            visitMarks[(size_t) neighbour] = visitMark;
+            auto distance = getDistance (query, neighbour);
+
+            if ((int) found.size() < searchWidth || distance < found.top().first)
+            {
+                candidates.push ({ distance, neighbour });
+                found.push ({ distance, neighbour });
+
+                if ((int) found.size() > searchWidth)
+                    found.pop();
+            }
+        }
+    }
+
+    std::vector<Neighbour> result;
+    result.reserve (found.size());
+
+    for (; ! found.empty(); found.pop())
+        result.push_back (found.top());
+
+    std::reverse (result.begin(), result.end());
+    return result;
+}
+
+int SimilarityIndex::findClosestOnUpperLayers (const float* query, int level) const
+{
+    // Greedy descent from the top layer down to (but not including) level
+    auto current = entryPoint;
+    auto currentDistance = getDistance (query, current);
+
+    for (int layer = nodes[(size_t) entryPoint].getLevel(); layer > level; --layer)
+    {
+        for (bool improved = true; improved;)
+        {
+            improved = false;
+
+            for (auto neighbour : nodes[(size_t) current].links[(size_t) layer])
+            {
+                auto distance = getDistance (query, neighbour);
+                if (distance < currentDistance)
+                {
+                    current = neighbour;
+                    currentDistance = distance;
+                    improved = true;
+                }
+            }
+        }
+    }
+
+    return current;
+}
+
+void SimilarityIndex::connect (int node, const std::vector<Neighbour>& candidates, int level)
+{
+    auto maxForLevel = level == 0 ? maxLinksBottomLayer : maxLinks;
+
+    auto& links = nodes[(size_t) node].links[(size_t) level];
+    links.clear();
+
+    for (int i = 0; i < (int) candidates.size() && (int) links.size() < maxLinks; ++i)
+        links.push_back (candidates[(size_t) i].second);
+
+    // Link back, keeping only the closest connections of an overfull node
+    for (auto neighbour : links)
+    {
+        auto& backLinks = nodes[(size_t) neighbour].links[(size_t) level];
+        backLinks.push_back (node);
+
+        if ((int) backLinks.size() > maxForLevel)
+        {
+            auto* origin = getVector (neighbour);
+            std::vector<Neighbour> ranked;
+            ranked.reserve (backLinks.size());
+
+            for (auto link : backLinks)
+                ranked.push_back ({ getDistance (origin, link), link });
+
+            std::sort (ranked.begin(), ranked.end());
+            backLinks.clear();
+
+            for (int i = 0; i < maxForLevel; ++i)
+                backLinks.push_back (ranked[(size_t) i].second);
+        }
+    }
+}
+
+void SimilarityIndex::compactIfNeeded()
+{
+    if (numDeleted < minDeletedToCompact || numDeleted * 4 < (int) nodes.size())
+        return;
+
+    // Relink first, while links still use the old numbering. Tombstones only
+    // link to nodes that have the same layer, so their neighbours can stand in.
+    for (int node = 0; node < (int) nodes.size(); ++node)
+    {
+        if (nodes[(size_t) node].deleted)
+            continue;
+
+        auto* origin = getVector (node);
+
+        for (size_t level = 0; level < nodes[(size_t) node].links.size(); ++level)
+        {
+            auto& links = nodes[(size_t) node].links[level];
+
+            if (std::none_of (links.begin(), links.end(), [this] (int link) { return nodes[(size_t) link].deleted; }))
+                continue;
+
+            std::vector<int> candidates;
+
+            for (auto link : links)
+            {
+                if (! nodes[(size_t) link].deleted)
+                    candidates.push_back (link);
+                else
+                    for (auto next : nodes[(size_t) link].links[level])
+                        if (next != node && ! nodes[(size_t) next].deleted)
+                            candidates.push_back (next);
+            }
+
+            std::sort (candidates.begin(), candidates.end());
+            candidates.erase (std::unique (candidates.begin(), candidates.end()), candidates.end());
+
+            std::vector<Neighbour> ranked;
+            ranked.reserve (candidates.size());
+
+            for (auto candidate : candidates)
+                ranked.push_back ({ getDistance (origin, candidate), candidate });
+
+            std::sort (ranked.begin(), ranked.end());
+
+            auto maxForLevel = level == 0 ? maxLinksBottomLayer : maxLinks;
+            links.clear();
+
+            for (int i = 0; i < (int) ranked.size() && i < maxForLevel; ++i)
+                links.push_back (ranked[(size_t) i].second);
+        }
+    }
+
+    auto entryIsLive = entryPoint >= 0 && ! nodes[(size_t) entryPoint].deleted;
+    std::vector<int> newIndex (nodes.size(), -1);
+    std::vector<Node> liveNodes;
+    std::vector<float> liveVectors;
+    liveNodes.reserve (nodes.size() - (size_t) numDeleted);
+    liveVectors.reserve (liveNodes.capacity() * TimbreAnalyzer::numDimensions);
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].deleted)
+            continue;
+
+        newIndex[i] = (int) liveNodes.size();
+        liveNodes.push_back (std::move (nodes[i]));
+        liveVectors.insert (liveVectors.end(), getVector ((int) i), getVector ((int) i) + TimbreAnalyzer::numDimensions);
+    }
+
+    auto newEntryPoint = entryIsLive ? newIndex[(size_t) entryPoint] : -1;
+
+    for (int i = 0; i < (int) liveNodes.size(); ++i)
+    {
+        auto& node = liveNodes[(size_t) i];
+
+        for (auto& layer : node.links)
+            for (auto& link : layer)
+                link = newIndex[(size_t) link];
+
+        // A tombstoned entry point hands over to the highest live node
+        if (! entryIsLive && (newEntryPoint < 0 || node.getLevel() > liveNodes[(size_t) newEntryPoint].getLevel()))
+            newEntryPoint = i;
+    }
+
+    nodes = std::move (liveNodes);
+    vectors = std::move (liveVectors);
+    entryPoint = newEntryPoint;
+    numDeleted = 0;
+    visitMarks.clear();
+
+    for (auto& entry : nodeForPath)
+        entry.second = newIndex[(size_t) entry.second];
+}
+
+//==============================================================================
+bool SimilarityIndex::isUpToDate (const juce::String& path, juce::int64 modificationTime) const
+{
+    const juce::ScopedLock sl (lock);
+
+    auto it = nodeForPath.find (path);
+    return it != nodeForPath.end() && nodes[(size_t) it->second].modificationTime == modificationTime;
+}
+
+bool SimilarityIndex::getEmbedding (const juce::String& path, juce::int64& modificationTime, Embedding& embedding) const
+{
+    const juce::ScopedLock sl (lock);
+
+    auto it = nodeForPath.find (path);
+    if (it == nodeForPath.end())
+        return false;
+
+    modificationTime = nodes[(size_t) it->second].modificationTime;
+    std::copy_n (getVector (it->second), TimbreAnalyzer::numDimensions, embedding.begin());
+    return true;
+}
+
+void SimilarityIndex::add (const juce::String& path, juce::int64 modificationTime, const Embedding& embedding)
+{
+    const juce::ScopedLock sl (lock);
+
+    auto existing = nodeForPath.find (path);
+    if (existing != nodeForPath.end())
+    {
+        // Changed file: tombstone the old node rather than rewiring the graph
+        nodes[(size_t) existing->second].deleted = true;
+        ++numDeleted;
+        nodeForPath.erase (existing);
+
+        compactIfNeeded();
+    }
+
+    // Exponentially decaying level distribution with factor 1 / ln(M)
+    auto level = (int) (-std::log (juce::jmax (1.0e-9, random.nextDouble())) / std::log ((double) maxLinks));
+
+    auto node = (int) nodes.size();
+    nodes.push_back ({ path, modificationTime, false, std::vector<std::vector<int>> ((size_t) level + 1) });
+    vectors.insert (vectors.end(), embedding.begin(), embedding.end());
+    nodeForPath[path] = node;
+
+    if (entryPoint < 0)
+    {
+        entryPoint = node;
+        return;
+    }
+
+    auto* query = getVector (node);
+    auto topLevel = nodes[(size_t) entryPoint].getLevel();
+    auto entry = findClosestOnUpperLayers (query, level);
+
+    for (int layer = juce::jmin (level, topLevel); layer >= 0; --layer)
+    {
+        auto candidates = searchLayer (query, entry, buildSearchWidth, layer);
+        connect (node, candidates, layer);
+        entry = candidates.front().second;
+    }
+
+    if (level > topLevel)
+        entryPoint = node;
+}
+
+void SimilarityIndex::remove (const juce::String& path)
+{
+    const juce::ScopedLock sl (lock);
+
+    auto it = nodeForPath.find (path);
+    if (it == nodeForPath.end())
+        return;
+
+    nodes[(size_t) it->second].deleted = true;
+    ++numDeleted;
+    nodeForPath.erase (it);
+
+    compactIfNeeded();
+}
+
+juce::StringArray SimilarityIndex::findNearest (const juce::String& path, int maxResults) const
+{
+    const juce::ScopedLock sl (lock);
+
+    auto it = nodeForPath.find (path);
+    if (it == nodeForPath.end())
+        return {};
+
+    auto self = it->second;
+    auto* query = getVector (self);
+
+    // Search wider than asked for so tombstones and the file itself can be skipped
+    auto searchWidth = juce::jmax (64, maxResults * 2);
+    auto candidates = searchLayer (query, findClosestOnUpperLayers (query, 0), searchWidth, 0);
+
+    juce::StringArray paths;
+
+    for (auto& candidate : candidates)
+    {
+        auto& node = nodes[(size_t) candidate.second];
+
+        if (candidate.second != self && ! node.deleted)
+            paths.add (node.path);
+
+        if (paths.size() >= maxResults)
+            break;
+    }
+
+    return paths;
+}
+
+int SimilarityIndex::getNumEmbeddings() const
+{
+    const juce::ScopedLock sl (lock);
+    return (int) nodes.size() - numDeleted;
+}
+
+juce::int64 SimilarityIndex::getMemoryUsage() const
+{
+    const juce::ScopedLock sl (lock);
+
+    auto bytes = (juce::int64) (vectors.capacity() * sizeof (float) + nodes.capacity() * sizeof (Node));
+
+    for (auto& node : nodes)
+    {
+        bytes += node.path.getNumBytesAsUTF8() + (juce::int64) (node.links.capacity() * sizeof (std::vector<int>));
+
+        for (auto& layer : node.links)
+            bytes += (juce::int64) (layer.capacity() * sizeof (int));
+    }
+
+    // Path lookup: key, value and bucket overhead
+    bytes += (juce::int64) nodeForPath.size() * (juce::int64) (sizeof (juce::String) + sizeof (int) + 2 * sizeof (void*));
+    return bytes;
+}
+
+//==============================================================================
+// File layout: magic, version, dimensions, node count, entry point, then per
+// node its path, modification time, deleted flag, vector and links per layer
+static constexpr int indexFileMagic = 0x49535853;  // "SXSI"
+static constexpr int indexFileVersion = 1;
+
+bool SimilarityIndex::save (const juce::File& file) const
+{
+    const juce::ScopedLock sl (lock);
+
+    juce::TemporaryFile temp (file);
+    {
+        juce::FileOutputStream out (temp.getFile());
+        if (! out.openedOk())
+            return false;
+
+        out.writeInt (indexFileMagic);
+        out.writeInt (indexFileVersion);
+        out.writeInt (TimbreAnalyzer::numDimensions);
+        out.writeInt ((int) nodes.size());
+        out.writeInt (entryPoint);
+
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            auto& node = nodes[i];
+            out.writeString (node.path);
+            out.writeInt64 (node.modificationTime);
+            out.writeBool (node.deleted);
+            out.write (getVector ((int) i), sizeof (float) * TimbreAnalyzer::numDimensions);
+            out.writeInt ((int) node.links.size());
+
+            for (auto& layer : node.links)
+            {
+                out.writeInt ((int) layer.size());
+                out.write (layer.data(), sizeof (int) * layer.size());
+            }
+        }
+
+        out.flush();
+        if (out.getStatus().failed())
+            return false;
+    }
+
+    return temp.overwriteTargetFileWithTemporary();
+}
+
+bool SimilarityIndex::load (const juce::File& file)
+{
+    juce::FileInputStream in (file);
+    if (! in.openedOk())
+        return false;
+
+    if (in.readInt() != indexFileMagic || in.readInt() != indexFileVersion
+         || in.readInt() != TimbreAnalyzer::numDimensions)
+        return false;
+
+    auto numNodes = in.readInt();
+    auto entry = in.readInt();
+
+    // Searches start at the entry point, so a non-empty graph needs a real one
+    if (numNodes < 0 || (numNodes > 0 ? (entry < 0 || entry >= numNodes) : entry != -1))
+        return false;
+
+    // Every node takes at least this many bytes (an empty path, one empty
+    // layer), so a corrupt count can't size the arrays below past the file
+    constexpr auto minNodeBytes = (juce::int64) (1 + sizeof (juce::int64) + 1
+                                                   + sizeof (float) * TimbreAnalyzer::numDimensions
+                                                   + 2 * sizeof (int));
+
+    if (numNodes > (in.getTotalLength() - in.getPosition()) / minNodeBytes)
+        return false;
+
+    std::vector<Node> loadedNodes ((size_t) numNodes);
+    std::vector<float> loadedVectors ((size_t) numNodes * TimbreAnalyzer::numDimensions);
+    std::unordered_map<juce::String, int> loadedPaths;
+    int loadedDeleted = 0;
+
+    for (int i = 0; i < numNodes; ++i)
+    {
+        auto& node = loadedNodes[(size_t) i];
+        node.path = in.readString();
+        node.modificationTime = in.readInt64();
+        node.deleted = in.readBool();
+
+        auto vectorBytes = sizeof (float) * TimbreAnalyzer::numDimensions;
+        if (in.read (loadedVectors.data() + (size_t) i * TimbreAnalyzer::numDimensions, (int) vectorBytes) != (int) vectorBytes)
+            return false;
+
+        auto numLayers = in.readInt();
+        if (numLayers <= 0 || numLayers > 64)
+            return false;
+
+        node.links.resize ((size_t) numLayers);
+
+        for (auto& layer : node.links)
+        {
+            auto numLinks = in.readInt();
+            if (numLinks < 0 || numLinks > maxLinksBottomLayer)
+                return false;
+
+            layer.resize ((size_t) numLinks);
+            if (in.read (layer.data(), (int) sizeof (int) * numLinks) != (int) sizeof (int) * numLinks)
+                return false;
+
+            for (auto link : layer)
+                if (link < 0 || link >= numNodes)
+                    return false;
+        }
+
+        if (node.deleted)
+            ++loadedDeleted;
+        else
+            loadedPaths[node.path] = i;
+    }
+
+    // A search follows a link on layer L into the target's own layer L
+    for (auto& node : loadedNodes)
+        for (size_t layer = 0; layer < node.links.size(); ++layer)
+            for (auto link : node.links[layer])
+                if (loadedNodes[(size_t) link].links.size() <= layer)
+                    return false;
+
+    const juce::ScopedLock sl (lock);
+    nodes = std::move (loadedNodes);
+    vectors = std::move (loadedVectors);
+    nodeForPath = std::move (loadedPaths);
+    entryPoint = entry;
+    numDeleted = loadedDeleted;
+    visitMarks.clear();
+
+    // Indices saved before tombstones were compacted can hold many
+    compactIfNeeded();
+    return true;
+}
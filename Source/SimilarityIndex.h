@@ -0,0 +1,83 @@
+#pragma once
+#include <JuceHeader.h>
+#include "TimbreAnalyzer.h"
+
+//==============================================================================
+// Approximate nearest-neighbour index over timbre embeddings (HNSW).
+//
+// Nodes are keyed by file path and remember the file's modification time, so
+// a rescan only analyses files that are new or have changed. Replacing or
+// removing a file leaves a tombstone that still helps navigation but never
+// shows up in results; once tombstones make up a quarter of the graph they
+// are dropped and their neighbours relinked to each other. The whole index is
+// saved to and loaded from a single binary file. All methods are thread-safe.
+//==============================================================================
+class SimilarityIndex
+{
+public:
+    using Embedding = TimbreAnalyzer::Embedding;
+
+    SimilarityIndex();
+
+    // True if the index holds an embedding for this file at this modification time
+    bool isUpToDate (const juce::String& path, juce::int64 modificationTime) const;
+
+    void add (const juce::String& path, juce::int64 modificationTime, const Embedding& embedding);
+    void remove (const juce::String& path);
+
+    // Copies out the stored embedding; false if the file has none
+    bool getEmbedding (const juce::String& path, juce::int64& modificationTime, Embedding& embedding) const;
+
+    // Paths of the stored files closest to the given one (which is excluded),
+    // closest first. Empty if the file has no embedding.
+    juce::StringArray findNearest (const juce::String& path, int maxResults) const;
+
+    int getNumEmbeddings() const;
+
+    // Approximate heap use in bytes
+    juce::int64 getMemoryUsage() const;
+
+    bool save (const juce::File& file) const;
+    bool load (const juce::File& file);
+
+private:
+    static constexpr int maxLinks = 16;             // M
+    static constexpr int maxLinksBottomLayer = 32;  // links allowed on layer 0
+    static constexpr int buildSearchWidth = 100;    // efConstruction
+    static constexpr int minDeletedToCompact = 256;
+
+    struct Node
+    {
+        juce::String path;
+        juce::int64 modificationTime = 0;
+        bool deleted = false;
+        std::vector<std::vector<int>> links;  // one list per layer
+
+        int getLevel() const { return (int) links.size() - 1; }
+    };
+
+    using Neighbour = std::pair<float, int>;  // distance, node
+
+    const float* getVector (int node) const { return vectors.data() + (size_t) node * TimbreAnalyzer::numDimensions; }
+    float getDistance (const float* query, int node) const;
+
+    std::vector<Neighbour> searchLayer (const float* query, int entry, int searchWidth, int level) const;
+    void connect (int node, const std::vector<Neighbour>& candidates, int level);
+    int findClosestOnUpperLayers (const float* query, int level) const;
+
+    // Drops the tombstones once there are enough of them, linking each live
+    // node to the closest of its tombstoned neighbours' neighbours instead
+    void compactIfNeeded();
+
+    juce::CriticalSection lock;
+    std::vector<Node> nodes;
+    std::vector<float> vectors;
+    std::unordered_map<juce::String, int> nodeForPath;  // live nodes only
+    int entryPoint = -1;
+    int numDeleted = 0;
+    juce::Random random;
+
+    // Scratch for searchLayer: a node is visited if its mark equals visitMark
+    mutable std::vector<uint32_t> visitMarks;
+    mutable uint32_t visitMark = 0;
+};
@@ -0,0 +1,220 @@
+#include "SyntheticLibrary.h"
+
+//==============================================================================
+namespace
+{
+    constexpr int filesPerPack = 500;
+    constexpr int filesPerJob = 1024;
+    constexpr double sampleRate = 22050.0;
+    constexpr int generatorVersion = 1;
+
+    struct Category
+    {
+        const char* folder;
+        const char* word;
+        bool isLoopy;
+    };
+
+    const Category categories[] = {
+        { "Drums/Kicks",        "Kick",       false },
+        { "Drums/Snares",       "Snare",      false },
+        { "Drums/Hi-Hats",      "Hihat",      false },
+        { "Drums/Claps",        "Clap",       false },
+        { "Drums/Percussion",   "Perc",       false },
+        { "Drums/Drum Loops",   "Drum Loop",  true  },
+        { "Bass/808s",          "808",        false },
+        { "Bass/Bass Loops",    "Bass Loop",  true  },
+        { "Synths/Leads",       "Lead",       true  },
+        { "Synths/Pads",        "Pad",        true  },
+        { "Keys/Piano",         "Piano",      true  },
+        { "Guitar",             "Guitar",     true  },
+        { "Vocals/Chops",       "Vox",        false },
+        { "Vocals/Phrases",     "Vocal",      true  },
+        { "FX/Risers",          "Riser",      false },
+        { "FX/Impacts",         "Impact",     false },
+        { "Foley",              "Foley",      false },
+        { "Textures",           "Texture",    true  },
+    };
+
+    const char* const vendors[] = { "Apex", "Blackbird", "Cinder", "Driftwood", "Echo Park", "Fathom",
+                                    "Glasshouse", "Helix", "Ironside", "Juniper", "Kestrel", "Lumen" };
+
+    const char* const descriptors[] = { "Punchy", "Dark", "Warm", "Dusty", "Bright", "Tight", "Wide",
+                                        "Crunchy", "Airy", "Deep", "Gritty", "Smooth", "Vintage", "Analog" };
+
+    const char* const notes[] = { "C", "C#", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B" };
+
+    const char* const extensions[] = { "wav", "wav", "wav", "aif", "flac" };
+
+    // Independent, reproducible random streams per file
+    juce::Random getRandom (juce::int64 seed, int index, int stream)
+    {
+        return juce::Random ((juce::int64) ((uint64_t) seed * 0x5851f42d4c957f2dull
+                                             + (uint64_t) index * 4 + (uint64_t) stream));
+    }
+
+    template <typename Type, size_t size>
+    const Type& pick (juce::Random& random, const Type (&choices)[size])
+    {
+        return choices[(size_t) random.nextInt ((int) size)];
+    }
+}
+
+//==============================================================================
+SyntheticLibrary::SyntheticLibrary (const juce::File& root, int numFilesToGenerate, juce::int64 randomSeed)
+    : rootFolder (root), numFiles (numFilesToGenerate), seed (randomSeed)
+{
+}
+
+juce::String SyntheticLibrary::getRelativePath (int index) const
+{
+    auto random = getRandom (seed, index, 0);
+
+    auto packIndex = index / filesPerPack;
+    juce::String vendor (vendors[packIndex % juce::numElementsInArray (vendors)]);
+    auto packFolder = vendor + " - Pack " + juce::String (packIndex / juce::numElementsInArray (vendors) + 1).paddedLeft ('0', 2);
+
+    auto& category = pick (random, categories);
+    bool isLoop = category.isLoopy ? random.nextFloat() < 0.8f : random.nextFloat() < 0.05f;
+
+    juce::StringArray tokens;
+    tokens.add (vendor.removeCharacters (" "));
+    tokens.add (pick (random, descriptors));
+    tokens.add (category.word);
+
+    if (isLoop && ! juce::String (category.word).contains ("Loop"))
+        tokens.add ("Loop");
+
+    // Loops mostly carry a tempo, in the spellings packs actually use
+    if (isLoop && random.nextFloat() < 0.85f)
+    {
+        auto bpm = juce::String (70 + random.nextInt (111));
+
+        switch (random.nextInt (3))
+        {
+            case 0:  tokens.add (bpm + "bpm"); break;
+            case 1:  tokens.add (bpm + " BPM"); break;
+            default: tokens.add (bpm); break;
+        }
+    }
+
+    if (random.nextFloat() < (isLoop ? 0.7f : 0.3f))
+    {
+        juce::String note (pick (random, notes));
+        bool isMinor = random.nextBool();
+
+        switch (random.nextInt (3))
+        {
+            case 0:  tokens.add (note + (isMinor ? " min" : " maj")); break;
+            case 1:  tokens.add (note + (isMinor ? "m" : "")); break;
+            default: tokens.add (note + (isMinor ? "min" : "maj")); break;
+        }
+    }
+
+    tokens.add (juce::String (index % filesPerPack + 1).paddedLeft ('0', 3));
+
+    return packFolder + "/" + category.folder + "/"
+         + tokens.joinIntoString ("_") + "." + pick (random, extensions);
+}
+
+//==============================================================================
+bool SyntheticLibrary::isUpToDate() const
+{
+    auto marker = getMarkerFile().loadFileAsString().trim();
+    return marker == juce::String (numFiles) + " " + juce::String (seed) + " " + juce::String (generatorVersion);
+}
+
+bool SyntheticLibrary::generate()
+{
+    if (isUpToDate())
+        return true;
+
+    // Only ever clear a folder this generator wrote
+    if (getMarkerFile().existsAsFile())
+        rootFolder.deleteRecursively();
+    else if (rootFolder.isDirectory() && rootFolder.getNumberOfChildFiles (juce::File::findFilesAndDirectories) > 0)
+        return false;
+
+    if (! rootFolder.createDirectory())
+        return false;
+
+    juce::ThreadPool pool (juce::SystemStats::getNumCpus());
+    std::atomic<bool> failed { false };
+
+    for (int firstIndex = 0; firstIndex < numFiles; firstIndex += filesPerJob)
+    {
+        pool.addJob ([this, firstIndex, &failed]
+        {
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+
+            auto endIndex = juce::jmin (numFiles, firstIndex + filesPerJob);
+
+            for (int i = firstIndex; i < endIndex && ! failed; ++i)
+                if (! writeFile (i, formats))
+                    failed = true;
+        });
+    }
+
+    while (pool.getNumJobs() > 0)
+        juce::Thread::sleep (10);
+
+    if (failed)
+        return false;
+
+    return getMarkerFile().replaceWithText (juce::String (numFiles) + " " + juce::String (seed)
+                                              + " " + juce::String (generatorVersion));
+}
+
+bool SyntheticLibrary::writeFile (int index, juce::AudioFormatManager& formats) const
+{
+    auto file = rootFolder.getChildFile (getRelativePath (index));
+
+    // Other jobs may be creating the same folder, so check the outcome
+    // rather than the result
+    file.getParentDirectory().createDirectory();
+    if (! file.getParentDirectory().isDirectory())
+        return false;
+
+    auto* format = formats.findFormatForFileExtension (file.getFileExtension());
+    if (format == nullptr)
+        return false;
+
+    // About 2% of files repeat an earlier file's audio, possibly in another
+    // container, so duplicate detection has something to find
+    auto audioIndex = index;
+    auto duplicateRandom = getRandom (seed, index, 1);
+    if (index > 0 && duplicateRandom.nextFloat() < 0.02f)
+        audioIndex = duplicateRandom.nextInt (index);
+
+    auto random = getRandom (seed, audioIndex, 2);
+    auto numSamples = 1024 << random.nextInt (3);
+    auto frequency = 40.0 + random.nextDouble() * 4000.0;
+    auto noiseLevel = random.nextFloat() * 0.5f;
+    auto decay = 2.0f + random.nextFloat() * 30.0f;
+
+    juce::AudioBuffer<float> buffer (1, numSamples);
+    auto* data = buffer.getWritePointer (0);
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        auto t = (float) i / (float) numSamples;
+        auto tone = std::sin (juce::MathConstants<double>::twoPi * frequency * (double) i / sampleRate);
+        auto noise = random.nextFloat() * 2.0f - 1.0f;
+        data[i] = 0.8f * std::exp (-decay * t) * ((1.0f - noiseLevel) * (float) tone + noiseLevel * noise);
+    }
+
+    auto stream = file.createOutputStream();
+    if (stream == nullptr)
+        return false;
+
+    stream->setPosition (0);
+    stream->truncate();
+
+    std::unique_ptr<juce::AudioFormatWriter> writer (format->createWriterFor (stream.get(), sampleRate, 1, 16, {}, 0));
+    if (writer == nullptr)
+        return false;
+
+    stream.release();  // now owned by the writer
+    return writer->writeFromAudioSampleBuffer (buffer, 0, numSamples);
+}
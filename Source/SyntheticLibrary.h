@@ -0,0 +1,42 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Generates a synthetic sample library for benchmarking.
+//
+// Files are laid out like commercial packs, e.g.
+//   Vendor - Pack 03/Drums/Kicks/Vendor_Punchy_Kick_128bpm_A min_017.wav
+// with a mix of BPM and key spellings, loop and one-shot names, and a small
+// share of byte-identical copies. Every file is a valid, tiny WAV, AIFF or
+// FLAC file with its own audio, so scanning exercises the real decoders.
+//
+// Generation is deterministic for a given size and seed. A marker file in
+// the root records both, so an existing library is reused rather than
+// written again.
+//==============================================================================
+class SyntheticLibrary
+{
+public:
+    SyntheticLibrary (const juce::File& rootFolder, int numFiles, juce::int64 seed = 1);
+
+    // Writes the library unless the root already holds an identical one.
+    // Returns false if a file couldn't be written.
+    bool generate();
+
+    const juce::File& getRootFolder() const { return rootFolder; }
+    int getNumFiles() const { return numFiles; }
+
+    // Relative path (with extension) of the file at the given index
+    juce::String getRelativePath (int index) const;
+
+private:
+    bool isUpToDate() const;
+    bool writeFile (int index, juce::AudioFormatManager& formats) const;
+    juce::File getMarkerFile() const { return rootFolder.getChildFile (".synthetic_library"); }
+
+    juce::File rootFolder;
+    int numFiles;
+    juce::int64 seed;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SyntheticLibrary)
+};
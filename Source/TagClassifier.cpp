@@ -0,0 +1,194 @@
+#include "TagClassifier.h"
+
+//==============================================================================
+static const char* const defaultTaxonomy =
+    "# Sound Xplorer tag taxonomy\n"
+    "#\n"
+    "# Each line maps keywords found anywhere in a sample's path to a tag:\n"
+    "#   TAG: keyword, keyword, ...\n"
+    "# Matching ignores case. After editing, reload the taxonomy from the\n"
+    "# library panel to retag every sample.\n"
+    "\n"
+    "DRUMS: kick, snare, hihat, hi-hat, hat, clap, tom, cymbal, percussion, drum\n"
+    "BASS: bass, 808, sub\n"
+    "SYNTHS: synth, lead, pad\n"
+    "KEYS: keys, piano, organ\n"
+    "GUITAR: guitar\n"
+    "VOCALS: vocal, vox, voice\n"
+    "FX: fx, effect, riser, sweep, impact\n"
+    "FOLEY: foley\n"
+    "AMBIENT: ambient, atmosphere\n"
+    "TEXTURE: texture\n"
+    "LOOPS: loop\n"
+    "ONE-SHOTS: one shot, oneshot, one-shot\n"
+    "TELEPHONES: phone, telephone\n"
+    "RADIOS & STATIC: radio, static\n"
+    "SOUND EFFECTS: sound effect, sfx\n"
+    "STRINGS: string\n"
+    "BRASS: brass, horn\n"
+    "WOODWINDS: flute, wind\n";
+
+TagClassifier::TagClassifier()
+{
+    loadTaxonomy (defaultTaxonomy);
+}
+
+juce::String TagClassifier::getDefaultTaxonomy()
+{
+    return defaultTaxonomy;
+}
+
+//==============================================================================
+bool TagClassifier::loadTaxonomy (const juce::String& taxonomyText)
+{
+    juce::StringArray newTagNames;
+    std::vector<std::pair<std::string, int>> keywords;  // lowercase UTF-8, tag index
+
+    for (auto& line : juce::StringArray::fromLines (taxonomyText))
+    {
+        auto trimmed = line.trim();
+        if (trimmed.isEmpty() || trimmed.startsWithChar ('#') || ! trimmed.containsChar (':'))
+            continue;
+
+        auto tag = trimmed.upToFirstOccurrenceOf (":", false, false).trim().toUpperCase();
+        if (tag.isEmpty())
+            continue;
+
+        auto tagIndex = newTagNames.indexOf (tag);
+        if (tagIndex < 0)
+        {
+            tagIndex = newTagNames.size();
+            newTagNames.add (tag);
+        }
+
+        for (auto& keyword : juce::StringArray::fromTokens (trimmed.fromFirstOccurrenceOf (":", false, false), ",", "\""))
+        {
+            auto lower = keyword.trim().unquoted().toLowerCase();
+            if (lower.isNotEmpty())
+                keywords.emplace_back (lower.toStdString(), tagIndex);
+        }
+    }
+
+    if (keywords.empty())
+        return false;
+
+    // Symbol classes
+    std::fill (std::begin (symbolForByte), std::end (symbolForByte), (uint8_t) 0);
+    numSymbols = 1;
+
+    for (auto& keyword : keywords)
+        for (auto byte : keyword.first)
+            if (symbolForByte[(uint8_t) byte] == 0 && numSymbols < 256)
+                symbolForByte[(uint8_t) byte] = (uint8_t) numSymbols++;
+
+    // Trie of all keywords, -1 marking a missing edge
+    transitions.assign ((size_t) numSymbols, -1);
+    std::vector<std::vector<int>> stateTags (1);
+
+    for (auto& keyword : keywords)
+    {
+        int state = 0;
+
+        for (auto byte : keyword.first)
+        {
+            auto& next = transitions[(size_t) (state * numSymbols + symbolForByte[(uint8_t) byte])];
+
+            if (next < 0)
+            {
+                next = (int) stateTags.size();
+                stateTags.emplace_back();
+                transitions.resize (transitions.size() + (size_t) numSymbols, -1);
+            }
+
+            // resize() may have moved the table, so don't keep the reference
+            state = transitions[(size_t) (state * numSymbols + symbolForByte[(uint8_t) byte])];
+        }
+
+        stateTags[(size_t) state].push_back (keyword.second);
+    }
+
+    // Breadth-first, turn missing edges into failure transitions and merge
+    // each state's outputs with those of its longest proper suffix
+    auto numStates = (int) stateTags.size();
+    std::vector<int> failure ((size_t) numStates, 0);
+    std::vector<int> queue;
+    queue.reserve ((size_t) numStates);
+
+    for (int symbol = 0; symbol < numSymbols; ++symbol)
+    {
+        auto& next = transitions[(size_t) symbol];
+
+        if (next < 0)
+            next = 0;
+        else
+            queue.push_back (next);
+    }
+
+    for (size_t head = 0; head < queue.size(); ++head)
+    {
+        auto state = queue[head];
+
+        for (int symbol = 0; symbol < numSymbols; ++symbol)
+        {
+            auto fallback = transitions[(size_t) (failure[(size_t) state] * numSymbols + symbol)];
+            auto& next = transitions[(size_t) (state * numSymbols + symbol)];
+
+            if (next < 0)
+            {
+                next = fallback;
+            }
+            else
+            {
+                failure[(size_t) next] = fallback;
+
+                auto& inherited = stateTags[(size_t) fallback];
+                stateTags[(size_t) next].insert (stateTags[(size_t) next].end(), inherited.begin(), inherited.end());
+
+                queue.push_back (next);
+            }
+        }
+    }
+
+    outputStart.assign ((size_t) numStates + 1, 0);
+    outputTags.clear();
+
+    for (int state = 0; state < numStates; ++state)
+    {
+        auto& tags = stateTags[(size_t) state];
+        std::sort (tags.begin(), tags.end());
+        tags.erase (std::unique (tags.begin(), tags.end()), tags.end());
+
+        outputTags.insert (outputTags.end(), tags.begin(), tags.end());
+        outputStart[(size_t) state + 1] = (int) outputTags.size();
+    }
+
+    tagNames = newTagNames;
+    return true;
+}
+
+//==============================================================================
+juce::StringArray TagClassifier::classify (const juce::String& path) const
+{
+    std::vector<bool> found ((size_t) tagNames.size(), false);
+    int state = 0;
+
+    // juce::String stores UTF-8, so this walks the path without converting it
+    for (auto* byte = path.toRawUTF8(); *byte != 0; ++byte)
+    {
+        auto value = (uint8_t) *byte;
+        if (value >= 'A' && value <= 'Z')
+            value = (uint8_t) (value + ('a' - 'A'));
+
+        state = transitions[(size_t) (state * numSymbols + symbolForByte[value])];
+
+        for (auto i = outputStart[(size_t) state]; i < outputStart[(size_t) state + 1]; ++i)
+            found[(size_t) outputTags[(size_t) i]] = true;
+    }
+
+    juce::StringArray tags;
+    for (int i = 0; i < tagNames.size(); ++i)
+        if (found[(size_t) i])
+            tags.add (tagNames[i]);
+
+    return tags;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Assigns category tags to a sample from keywords in its path.
+//
+// The taxonomy maps keywords to tags, one tag per line:
+//   DRUMS: kick, snare, hihat, clap
+// All keywords are compiled into a single Aho-Corasick automaton, so a path
+// is classified in one pass over its bytes however many keywords there are.
+// Matching ignores ASCII case and finds keywords anywhere in the path.
+//
+// classify() is const and may be called from several threads at once.
+//==============================================================================
+class TagClassifier
+{
+public:
+    // Starts out with the built-in taxonomy
+    TagClassifier();
+
+    // Replaces the taxonomy. Blank lines and lines starting with '#' are
+    // ignored, and repeated tags accumulate keywords. Returns false, leaving
+    // the current taxonomy in place, if the text has no mappings.
+    bool loadTaxonomy (const juce::String& taxonomyText);
+
+    static juce::String getDefaultTaxonomy();
+
+    // Tags whose keywords occur in the path, in taxonomy order
+    juce::StringArray classify (const juce::String& path) const;
+
+    const juce::StringArray& getTagNames() const { return tagNames; }
+
+private:
+    juce::StringArray tagNames;
+
+    // Bytes that occur in some keyword get their own symbol; every other
+    // byte shares symbol 0, which always leads back to the root
+    uint8_t symbolForByte[256] = {};
+    int numSymbols = 1;
+
+    // Full transition table, numStates x numSymbols, failure links folded in
+    std::vector<int> transitions;
+
+    // Tags recognised on entering each state: outputTags[outputStart[s] .. outputStart[s + 1])
+    std::vector<int> outputStart;
+    std::vector<int> outputTags;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TagClassifier)
+};
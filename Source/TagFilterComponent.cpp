@@ -1,6 +1,23 @@
 #include "TagFilterComponent.h"
 #include "LookAndFeel.h"
 
+// "12480" -> "12,480"
+static juce::String formatCount (int count)
+{
+    auto digits = juce::String (count);
+    juce::String result;
+
+    for (int i = 0; i < digits.length(); ++i)
+    {
+        if (i > 0 && (digits.length() - i) % 3 == 0)
+            result << ',';
+
+        result << digits[i];
+    }
+
+    return result;
+}
+
 TagFilterComponent::TagFilterComponent()
 {
     modeLabel.setText ("OR", juce::dontSendNotification);
@@ -31,46 +48,67 @@ void TagFilterComponent::resized()
     modeLabel.setBounds (modeArea);
 
     viewport.setBounds (bounds);
-    rebuildTagButtons();
+    layoutTagButtons();
 }
 
 void TagFilterComponent::setAvailableTags (const juce::StringArray& tags)
 {
+    if (tags == allTags)
+        return;
+
     allTags = tags;
     rebuildTagButtons();
 }
 
+void TagFilterComponent::setTagCounts (const SampleLibrary::TagCounts& counts)
+{
+    if (counts == tagCounts)
+        return;
+
+    tagCounts = counts;
+
+    // Counts change on every keystroke, so relabel the existing buttons
+    // instead of recreating them
+    for (auto* button : tagButtons)
+        button->setButtonText (getButtonText (button->getName()));
+
+    layoutTagButtons();
+}
+
+juce::String TagFilterComponent::getButtonText (const juce::String& tag) const
+{
+    auto it = tagCounts.find (tag);
+    return tag + " (" + formatCount (it != tagCounts.end() ? it->second : 0) + ")";
+}
+
 juce::StringArray TagFilterComponent::getActiveTags() const
 {
     return activeTags;
 }
 
+void TagFilterComponent::setActiveTags (const juce::StringArray& tags)
+{
+    activeTags = tags;
+
+    for (auto* button : tagButtons)
+        button->setToggleState (activeTags.contains (button->getName()), juce::dontSendNotification);
+}
+
 void TagFilterComponent::rebuildTagButtons()
 {
     tagButtons.clear();
     tagContainer.removeAllChildren();
 
-    int x = 0;
-    int y = 0;
-    int buttonHeight = 22;
-    int spacing = 4;
-
     for (auto& tag : allTags)
     {
         auto* button = new juce::TextButton (tag);
+        button->setButtonText (getButtonText (tag));
         button->setClickingTogglesState (true);
         button->setToggleState (activeTags.contains (tag), juce::dontSendNotification);
 
-        auto font = SoundXplorerLookAndFeel::getBoldFont (10.0f);
-        juce::GlyphArrangement glyphs;
-        glyphs.addLineOfText (font, tag, 0.0f, 0.0f);
-        int btnWidth = (int) std::ceil (glyphs.getBoundingBox (0, -1, false).getWidth()) + 20;
-
         button->setColour (juce::TextButton::buttonColourId, juce::Colour (SoundXplorerLookAndFeel::bgCard));
         button->setColour (juce::TextButton::buttonOnColourId, juce::Colour (SoundXplorerLookAndFeel::rausch));
 
-        button->setBounds (x, y, btnWidth, buttonHeight);
-
         button->onClick = [this, tag, button]
         {
             if (button->getToggleState())
@@ -84,7 +122,27 @@ void TagFilterComponent::rebuildTagButtons()
 
         tagContainer.addAndMakeVisible (button);
         tagButtons.add (button);
+    }
+
+    layoutTagButtons();
+}
 
+void TagFilterComponent::layoutTagButtons()
+{
+    int x = 0;
+    int y = 0;
+    int buttonHeight = 22;
+    int spacing = 4;
+
+    auto font = SoundXplorerLookAndFeel::getBoldFont (10.0f);
+
+    for (auto* button : tagButtons)
+    {
+        juce::GlyphArrangement glyphs;
+        glyphs.addLineOfText (font, button->getButtonText(), 0.0f, 0.0f);
+        int btnWidth = (int) std::ceil (glyphs.getBoundingBox (0, -1, false).getWidth()) + 20;
+
+        button->setBounds (x, y, btnWidth, buttonHeight);
         x += btnWidth + spacing;
     }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include <JuceHeader.h>
+#include "SampleLibrary.h"
 
 //==============================================================================
 // Tag filter bar with clickable tag buttons (OR logic)
@@ -14,15 +15,20 @@ public:
     void resized() override;
 
     void setAvailableTags (const juce::StringArray& tags);
+    void setTagCounts (const SampleLibrary::TagCounts& counts);
     juce::StringArray getActiveTags() const;
+    void setActiveTags (const juce::StringArray& tags);   // doesn't call onTagFilterChanged
 
     std::function<void (const juce::StringArray&)> onTagFilterChanged;
 
 private:
     void rebuildTagButtons();
+    void layoutTagButtons();
+    juce::String getButtonText (const juce::String& tag) const;
 
     juce::StringArray allTags;
     juce::StringArray activeTags;
+    SampleLibrary::TagCounts tagCounts;
 
     juce::OwnedArray<juce::TextButton> tagButtons;
     juce::Label modeLabel;
@@ -0,0 +1,221 @@
+#include "TimbreAnalyzer.h"
+
+//==============================================================================
+TimbreAnalyzer::TimbreAnalyzer()
+    : fftData ((size_t) fftSize * 2),
+      power ((size_t) numBins),
+      melEnergies ((size_t) numMelBands)
+{
+    // DCT-II basis, skipping c0 so overall level doesn't affect similarity
+    dctMatrix.resize ((size_t) (numCoefficients * numMelBands));
+
+    for (int c = 0; c < numCoefficients; ++c)
+        for (int b = 0; b < numMelBands; ++b)
+            dctMatrix[(size_t) (c * numMelBands + b)]
+                = (float) std::cos (juce::MathConstants<double>::pi * (c + 1) * (b + 0.5) / numMelBands);
+}
+
+float TimbreAnalyzer::dotProduct (const float* a, const float* b, int num)
+{
+    // Plain loop with independent accumulators so the compiler can vectorise it
+    float sums[4] = {};
+    int i = 0;
+
+    for (; i + 4 <= num; i += 4)
+    {
+        sums[0] += a[i]     * b[i];
+        sums[1] += a[i + 1] * b[i + 1];
+        sums[2] += a[i + 2] * b[i + 2];
+        sums[3] += a[i + 3] * b[i + 3];
+    }
+
+    for (; i < num; ++i)
+        sums[0] += a[i] * b[i];
+
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+//==============================================================================
+void TimbreAnalyzer::prepareFilterBank (double sampleRate)
+{
+    if (sampleRate == preparedSampleRate)
+        return;
+
+    preparedSampleRate = sampleRate;
+
+    auto hzToMel = [] (double hz) { return 2595.0 * std::log10 (1.0 + hz / 700.0); };
+    auto melToHz = [] (double mel) { return 700.0 * (std::pow (10.0, mel / 2595.0) - 1.0); };
+
+    binFrequencies.resize ((size_t) numBins);
+    for (int bin = 0; bin < numBins; ++bin)
+        binFrequencies[(size_t) bin] = (float) (bin * sampleRate / fftSize);
+
+    // Triangular filters evenly spaced on the mel scale
+    auto lowMel = hzToMel (20.0);
+    auto highMel = hzToMel (juce::jmin (16000.0, sampleRate * 0.5));
+
+    melFilters.assign ((size_t) (numMelBands * numBins), 0.0f);
+
+    for (int band = 0; band < numMelBands; ++band)
+    {
+        auto left   = melToHz (lowMel + (highMel - lowMel) * band       / (numMelBands + 1));
+        auto centre = melToHz (lowMel + (highMel - lowMel) * (band + 1) / (numMelBands + 1));
+        auto right  = melToHz (lowMel + (highMel - lowMel) * (band + 2) / (numMelBands + 1));
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            auto f = (double) binFrequencies[(size_t) bin];
+            double weight = 0.0;
+
+            if (f > left && f <= centre)
+                weight = (f - left) / (centre - left);
+            else if (f > centre && f < right)
+                weight = (right - f) / (right - centre);
+
+            melFilters[(size_t) (band * numBins + bin)] = (float) weight;
+        }
+    }
+}
+
+void TimbreAnalyzer::analyzeFrame (const float* frame, float* features)
+{
+    // Zero-crossing rate comes from the raw frame, before windowing
+    int crossings = 0;
+    for (int i = 1; i < fftSize; ++i)
+        crossings += (frame[i - 1] >= 0.0f) != (frame[i] >= 0.0f) ? 1 : 0;
+
+    juce::FloatVectorOperations::copy (fftData.data(), frame, fftSize);
+    juce::FloatVectorOperations::clear (fftData.data() + fftSize, fftSize);
+    window.multiplyWithWindowingTable (fftData.data(), (size_t) fftSize);
+    fft.performFrequencyOnlyForwardTransform (fftData.data(), true);
+
+    juce::FloatVectorOperations::multiply (power.data(), fftData.data(), fftData.data(), numBins);
+
+    // Mel energies -> log -> DCT
+    for (int band = 0; band < numMelBands; ++band)
+        melEnergies[(size_t) band] = std::log (dotProduct (melFilters.data() + band * numBins, power.data(), numBins) + 1.0e-10f);
+
+    for (int c = 0; c < numCoefficients; ++c)
+        features[c] = dotProduct (dctMatrix.data() + c * numMelBands, melEnergies.data(), numMelBands);
+
+    // Spectral shape descriptors, all scaled to roughly 0..1
+    auto* magnitudes = fftData.data();
+    auto magnitudeSum = 0.0f;
+    for (int bin = 0; bin < numBins; ++bin)
+        magnitudeSum += magnitudes[bin];
+
+    auto nyquist = (float) (preparedSampleRate * 0.5);
+    auto centroid = dotProduct (binFrequencies.data(), magnitudes, numBins) / juce::jmax (1.0e-10f, magnitudeSum);
+
+    auto powerSum = 0.0f;
+    auto logPowerSum = 0.0f;
+    for (int bin = 1; bin < numBins; ++bin)
+    {
+        powerSum += power[(size_t) bin];
+        logPowerSum += std::log (power[(size_t) bin] + 1.0e-10f);
+    }
+
+    auto geometricMean = std::exp (logPowerSum / (numBins - 1));
+    auto arithmeticMean = powerSum / (numBins - 1);
+    auto flatness = geometricMean / juce::jmax (1.0e-10f, arithmeticMean);
+
+    auto rolloffTarget = 0.85f * powerSum;
+    auto cumulative = 0.0f;
+    int rolloffBin = numBins - 1;
+    for (int bin = 1; bin < numBins; ++bin)
+    {
+        cumulative += power[(size_t) bin];
+        if (cumulative >= rolloffTarget)
+        {
+            rolloffBin = bin;
+            break;
+        }
+    }
+
+    features[numCoefficients]     = centroid / nyquist;
+    features[numCoefficients + 1] = flatness;
+    features[numCoefficients + 2] = binFrequencies[(size_t) rolloffBin] / nyquist;
+    features[numCoefficients + 3] = (float) crossings / (float) fftSize;
+    features[numCoefficients + 4] = 0.05f * std::log10 (powerSum + 1.0e-10f);  // frame level, for dynamics
+}
+
+//==============================================================================
+bool TimbreAnalyzer::analyze (juce::AudioFormatReader& reader, Embedding& embedding)
+{
+    if (reader.sampleRate <= 0.0 || reader.lengthInSamples <= 0)
+        return false;
+
+    prepareFilterBank (reader.sampleRate);
+
+    auto numSamples = (int) juce::jmin (reader.lengthInSamples, (juce::int64) (reader.sampleRate * maxSecondsToAnalyze));
+    auto numChannels = juce::jmin (2, (int) reader.numChannels);
+
+    // Pad to at least one frame so one-shots shorter than a frame still count.
+    // The buffer only grows, so a reused analyzer stops allocating.
+    auto& buffer = readBuffer;
+    buffer.setSize (numChannels, juce::jmax (numSamples, fftSize), false, false, true);
+    buffer.clear();
+
+    reader.read (&buffer, 0, numSamples, 0, true, numChannels > 1);
+
+    auto* mono = buffer.getWritePointer (0);
+    if (numChannels > 1)
+    {
+        juce::FloatVectorOperations::add (mono, buffer.getReadPointer (1), numSamples);
+        juce::FloatVectorOperations::multiply (mono, 0.5f, numSamples);
+    }
+
+    float sums[numFrameFeatures] = {};
+    float squares[numFrameFeatures] = {};
+    float features[numFrameFeatures] = {};
+    int numFrames = 0;
+
+    for (int start = 0; start + fftSize <= buffer.getNumSamples(); start += hopSize)
+    {
+        // Silent frames would only drag the statistics towards "silence"
+        auto range = juce::FloatVectorOperations::findMinAndMax (mono + start, fftSize);
+        if (juce::jmax (-range.getStart(), range.getEnd()) < 1.0e-3f)
+            continue;
+
+        analyzeFrame (mono + start, features);
+
+        juce::FloatVectorOperations::add (sums, features, numFrameFeatures);
+        juce::FloatVectorOperations::addWithMultiply (squares, features, features, numFrameFeatures);
+        ++numFrames;
+    }
+
+    if (numFrames == 0)
+        return false;
+
+    // Means and standard deviations, with MFCCs scaled down to the range of
+    // the spectral descriptors so no single group dominates the distance
+    float means[numFrameFeatures], deviations[numFrameFeatures];
+    for (int i = 0; i < numFrameFeatures; ++i)
+    {
+        means[i] = sums[i] / (float) numFrames;
+        deviations[i] = std::sqrt (juce::jmax (0.0f, squares[i] / (float) numFrames - means[i] * means[i]));
+    }
+
+    int d = 0;
+    for (int c = 0; c < numCoefficients; ++c)
+        embedding[(size_t) d++] = means[c] * 0.05f;
+
+    for (int c = 0; c < numCoefficients; ++c)
+        embedding[(size_t) d++] = deviations[c] * 0.1f;
+
+    embedding[(size_t) d++] = means[numCoefficients];
+    embedding[(size_t) d++] = deviations[numCoefficients];
+    embedding[(size_t) d++] = means[numCoefficients + 1];
+    embedding[(size_t) d++] = means[numCoefficients + 2];
+    embedding[(size_t) d++] = means[numCoefficients + 3];
+    embedding[(size_t) d++] = deviations[numCoefficients + 4];
+
+    jassert (d == numDimensions);
+
+    auto norm = std::sqrt (dotProduct (embedding.data(), embedding.data(), numDimensions));
+    if (norm <= 0.0f)
+        return false;
+
+    juce::FloatVectorOperations::multiply (embedding.data(), 1.0f / norm, numDimensions);
+    return true;
+}
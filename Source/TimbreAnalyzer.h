@@ -0,0 +1,54 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Computes a compact timbral fingerprint of a sample for similarity search.
+//
+// The first few seconds are mixed to mono and cut into windowed frames. Per
+// frame we take MFCCs (c1..c13, loudness-independent) plus spectral centroid,
+// flatness, roll-off and zero-crossing rate, then summarise them as means and
+// standard deviations. The result is L2-normalised, so the dot product of two
+// embeddings is their cosine similarity.
+//
+// An analyzer keeps its FFT, filter-bank tables and read buffer between
+// calls, so reuse one for many files rather than building one per file.
+//==============================================================================
+class TimbreAnalyzer
+{
+public:
+    static constexpr int numDimensions = 32;
+    using Embedding = std::array<float, numDimensions>;
+
+    TimbreAnalyzer();
+
+    // Returns false for silent or unreadable audio
+    bool analyze (juce::AudioFormatReader& reader, Embedding& embedding);
+
+    static float dotProduct (const float* a, const float* b, int num);
+
+private:
+    static constexpr int fftOrder = 10;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = fftSize / 2;
+    static constexpr int numBins = fftSize / 2 + 1;
+    static constexpr int numMelBands = 26;
+    static constexpr int numCoefficients = 13;
+    static constexpr int numFrameFeatures = numCoefficients + 5;
+    static constexpr double maxSecondsToAnalyze = 4.0;
+
+    void prepareFilterBank (double sampleRate);
+    void analyzeFrame (const float* frame, float* features);
+
+    juce::dsp::FFT fft { fftOrder };
+    juce::dsp::WindowingFunction<float> window { (size_t) fftSize, juce::dsp::WindowingFunction<float>::hann, false };
+
+    double preparedSampleRate = 0.0;
+    std::vector<float> melFilters;    // numMelBands x numBins
+    std::vector<float> dctMatrix;     // numCoefficients x numMelBands
+    std::vector<float> binFrequencies;
+
+    std::vector<float> fftData;
+    std::vector<float> power;
+    std::vector<float> melEnergies;
+    juce::AudioBuffer<float> readBuffer;
+};
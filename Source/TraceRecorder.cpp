@@ -0,0 +1,302 @@
+#include "TraceRecorder.h"
+
+//==============================================================================
+TraceRecorder& TraceRecorder::getInstance()
+{
+    static TraceRecorder instance;
+    return instance;
+}
+
+void TraceRecorder::start()
+{
+    registerThisThread();
+
+    const juce::ScopedLock sl (bufferLock);
+
+    // Writers restart their own buffers when they see the new generation;
+    // resetting numWritten from here would be undone by a span in flight
+    ++generation;
+
+    for (int i = 0; i < numBuffers.load(); ++i)
+        allocateSpans (buffers[(size_t) i]);
+
+    enabled = true;
+}
+
+void TraceRecorder::stop()
+{
+    enabled = false;
+}
+
+//==============================================================================
+// Hands the calling thread's buffer on to a later thread once it exits
+struct TraceRecorder::ThreadRegistration
+{
+    ~ThreadRegistration()
+    {
+        if (buffer != nullptr)
+            buffer->state.store (BufferState::free, std::memory_order_release);
+    }
+
+    ThreadBuffer* buffer = nullptr;
+};
+
+TraceRecorder::ThreadRegistration& TraceRecorder::getThreadRegistration() noexcept
+{
+    thread_local ThreadRegistration registration;
+    return registration;
+}
+
+static juce::String getCurrentThreadName()
+{
+    if (juce::MessageManager::getInstanceWithoutCreating() != nullptr
+          && juce::MessageManager::getInstanceWithoutCreating()->isThisTheMessageThread())
+        return "Message thread";
+
+    if (auto* thread = juce::Thread::getCurrentThread())
+        return thread->getThreadName();
+
+    return "Thread " + juce::String::toHexString ((juce::int64) (juce::pointer_sized_int) juce::Thread::getCurrentThreadId());
+}
+
+void TraceRecorder::registerThisThread()
+{
+    auto& registration = getThreadRegistration();
+
+    if (registration.buffer != nullptr)
+        return;
+
+    const juce::ScopedLock sl (bufferLock);
+
+    if (auto* buffer = takeFreeBuffer())
+    {
+        buffer->threadName = getCurrentThreadName();
+
+        if (enabled)
+            allocateSpans (*buffer);
+
+        registration.buffer = buffer;
+    }
+}
+
+void TraceRecorder::reserveAudioThreadBuffer()
+{
+    const juce::ScopedLock sl (bufferLock);
+
+    // One waiting at a time; the next prepareToPlay() sets aside another
+    // once it has been claimed
+    for (int i = 0; i < numBuffers.load(); ++i)
+        if (buffers[(size_t) i].state.load() == BufferState::reserved)
+            return;
+
+    if (auto* buffer = takeFreeBuffer())
+    {
+        buffer->threadName = "Audio thread";
+
+        if (enabled)
+            allocateSpans (*buffer);
+
+        buffer->state.store (BufferState::reserved, std::memory_order_release);
+    }
+}
+
+TraceRecorder::ThreadBuffer* TraceRecorder::claimReservedBuffer() noexcept
+{
+    auto num = numBuffers.load (std::memory_order_acquire);
+
+    for (int i = 0; i < num; ++i)
+    {
+        auto expected = BufferState::reserved;
+
+        if (buffers[(size_t) i].state.compare_exchange_strong (expected, BufferState::owned, std::memory_order_acq_rel))
+            return &buffers[(size_t) i];
+    }
+
+    return nullptr;
+}
+
+TraceRecorder::ThreadBuffer* TraceRecorder::takeFreeBuffer()
+{
+    auto num = numBuffers.load();
+
+    for (int i = 0; i < num; ++i)
+    {
+        auto& buffer = buffers[(size_t) i];
+        auto expected = BufferState::free;
+
+        // Its thread has exited, so nothing writes to it any more; the spans
+        // it left are dropped rather than shown under the new thread's name
+        if (buffer.state.compare_exchange_strong (expected, BufferState::owned, std::memory_order_acq_rel))
+        {
+            buffer.numWritten.store (0, std::memory_order_relaxed);
+            return &buffer;
+        }
+    }
+
+    if (num == maxThreads)
+        return nullptr;
+
+    auto& buffer = buffers[(size_t) num];
+    buffer.state.store (BufferState::owned, std::memory_order_relaxed);
+    buffer.generation.store (generation.load(), std::memory_order_relaxed);
+    numBuffers.store (num + 1, std::memory_order_release);
+    return &buffer;
+}
+
+void TraceRecorder::allocateSpans (ThreadBuffer& buffer)
+{
+    if (buffer.storage == nullptr)
+    {
+        buffer.storage.reset (new Span[(size_t) spansPerThread]);
+        buffer.spans.store (buffer.storage.get(), std::memory_order_release);
+    }
+}
+
+void TraceRecorder::record (const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept
+{
+    auto& registration = getThreadRegistration();
+
+    // An unregistered thread may only take a buffer prepareToPlay() set aside
+    if (registration.buffer == nullptr)
+        registration.buffer = claimReservedBuffer();
+
+    if (registration.buffer == nullptr)
+        return;
+
+    auto& buffer = *registration.buffer;
+    auto* spans = buffer.spans.load (std::memory_order_acquire);
+
+    if (spans == nullptr)
+        return;
+
+    // Only this thread writes here, so it restarts its own buffer for a new
+    // recording; the release stores publish the restart and the span
+    auto currentGeneration = generation.load (std::memory_order_acquire);
+
+    if (buffer.generation.load (std::memory_order_relaxed) != currentGeneration)
+    {
+        buffer.numWritten.store (0, std::memory_order_relaxed);
+        buffer.generation.store (currentGeneration, std::memory_order_release);
+    }
+
+    auto index = buffer.numWritten.load (std::memory_order_relaxed);
+    auto& span = spans[index % (juce::uint32) spansPerThread];
+    span.name = name;
+    span.startTicks = startTicks;
+    span.endTicks = endTicks;
+
+    buffer.numWritten.store (index + 1, std::memory_order_release);
+}
+
+//==============================================================================
+bool TraceRecorder::writeChromeTrace (const juce::File& file) const
+{
+    struct ThreadSpans
+    {
+        juce::String threadName;
+        std::vector<Span> spans;
+    };
+
+    std::vector<ThreadSpans> threads;
+    auto origin = std::numeric_limits<juce::int64>::max();
+
+    {
+        const juce::ScopedLock sl (bufferLock);
+        auto currentGeneration = generation.load();
+
+        for (int bufferIndex = 0; bufferIndex < numBuffers.load(); ++bufferIndex)
+        {
+            constexpr auto capacity = (juce::uint32) spansPerThread;
+            auto* buffer = &buffers[(size_t) bufferIndex];
+            auto* spans = buffer->spans.load (std::memory_order_acquire);
+
+            // Threads that haven't recorded since start() hold an older session
+            if (spans == nullptr || buffer->generation.load (std::memory_order_acquire) != currentGeneration)
+                continue;
+
+            auto end = buffer->numWritten.load (std::memory_order_acquire);
+            auto begin = end > capacity ? end - capacity : 0;
+
+            ThreadSpans thread { buffer->threadName, {} };
+            thread.spans.reserve (end - begin);
+
+            for (auto i = begin; i < end; ++i)
+                thread.spans.push_back (spans[i % capacity]);
+
+            // Drop whatever the thread overwrote while it was being copied
+            auto endAfterCopy = buffer->numWritten.load (std::memory_order_acquire);
+            auto firstIntact = endAfterCopy > capacity ? endAfterCopy - capacity : 0;
+
+            if (firstIntact > begin)
+                thread.spans.erase (thread.spans.begin(),
+                                    thread.spans.begin() + (std::ptrdiff_t) juce::jmin (firstIntact - begin, end - begin));
+
+            for (auto& span : thread.spans)
+                origin = juce::jmin (origin, span.startTicks);
+
+            if (! thread.spans.empty())
+                threads.push_back (std::move (thread));
+        }
+    }
+
+    auto microsecondsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    juce::MemoryOutputStream out;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool isFirst = true;
+    auto startEvent = [&out, &isFirst]
+    {
+        out << (isFirst ? "\n" : ",\n");
+        isFirst = false;
+    };
+
+    for (int tid = 0; tid < (int) threads.size(); ++tid)
+    {
+        auto& thread = threads[(size_t) tid];
+
+        startEvent();
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":" << juce::JSON::toString (thread.threadName) << "}}";
+
+        for (auto& span : thread.spans)
+        {
+            if (span.name == nullptr || span.endTicks < span.startTicks)
+                continue;
+
+            startEvent();
+            out << "{\"ph\":\"X\",\"name\":\"" << span.name << "\",\"pid\":1,\"tid\":" << tid
+                << ",\"ts\":" << juce::String ((double) (span.startTicks - origin) * microsecondsPerTick, 3)
+                << ",\"dur\":" << juce::String ((double) (span.endTicks - span.startTicks) * microsecondsPerTick, 3) << "}";
+        }
+    }
+
+    out << "\n]}\n";
+
+    return file.replaceWithData (out.getData(), out.getDataSize());
+}
+
+//==============================================================================
+void TraceRecorder::enableFromEnvironment()
+{
+    // Further plug-in instances join the session already running
+    if (environmentOutputFile != juce::File())
+        return;
+
+    auto path = juce::SystemStats::getEnvironmentVariable ("SOUNDXPLORER_TRACE", {});
+
+    if (path.isEmpty() || ! juce::File::isAbsolutePath (path))
+        return;
+
+    environmentOutputFile = juce::File (path);
+    start();
+}
+
+void TraceRecorder::writeEnvironmentTrace()
+{
+    if (environmentOutputFile == juce::File())
+        return;
+
+    stop();
+    writeChromeTrace (environmentOutputFile);
+}
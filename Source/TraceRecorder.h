@@ -0,0 +1,130 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// Records timed spans from any thread and writes them as Chrome trace-event
+// JSON, which chrome://tracing and https://ui.perfetto.dev open directly.
+//
+// Each thread appends to its own fixed-size ring buffer, so recording never
+// locks or allocates, and the oldest spans are overwritten on long sessions.
+// While recording is off a TraceScope costs one relaxed atomic load.
+//
+// A thread only gets a buffer by asking for one, as allocating it from
+// record() could happen on the audio thread: threads call registerThisThread()
+// as they start, and prepareToPlay() reserves a buffer that the audio thread
+// claims without locking on its first span. Spans from any other thread are
+// dropped. A buffer is handed on to a later thread once its own has exited,
+// and spans stay until then, so ones from finished pool jobs survive.
+//
+// Setting SOUNDXPLORER_TRACE=<file.json> records from start-up and writes the
+// trace when the host shuts down (see enableFromEnvironment).
+//==============================================================================
+class TraceRecorder
+{
+public:
+    static TraceRecorder& getInstance();
+
+    static bool isEnabled() noexcept { return enabled.load (std::memory_order_relaxed); }
+
+    // Discards earlier spans and starts recording. Registers the calling
+    // thread, which is normally the message thread.
+    void start();
+    void stop();
+
+    // Gives the calling thread a buffer to record into; a no-op if it has one.
+    // Locks and may allocate, so call it where a thread starts, not from
+    // realtime code.
+    void registerThisThread();
+
+    // Sets aside a buffer for the next unregistered thread to record, which is
+    // meant to be the audio thread; call from prepareToPlay()
+    void reserveAudioThreadBuffer();
+
+    // name must be a string literal (it is stored, not copied)
+    void record (const char* name, juce::int64 startTicks, juce::int64 endTicks) noexcept;
+
+    bool writeChromeTrace (const juce::File& file) const;
+
+    // Starts recording if SOUNDXPLORER_TRACE names an output file; call
+    // writeEnvironmentTrace() at shutdown to write the trace there
+    void enableFromEnvironment();
+    void writeEnvironmentTrace();
+
+private:
+    TraceRecorder() = default;
+
+    static constexpr int spansPerThread = 1 << 15;
+    static constexpr int maxThreads = 128;
+
+    struct Span
+    {
+        const char* name = nullptr;
+        juce::int64 startTicks = 0;
+        juce::int64 endTicks = 0;
+    };
+
+    enum class BufferState { free, reserved, owned };
+
+    struct ThreadBuffer
+    {
+        juce::String threadName;                        // changed only under bufferLock
+        std::atomic<BufferState> state { BufferState::free };
+
+        // The span array is only allocated while recording, by start() or on
+        // registering, and then kept; spans is set once it can be written
+        std::unique_ptr<Span[]> storage;
+        std::atomic<Span*> spans { nullptr };
+
+        // Written only by the owning thread, which restarts numWritten when it
+        // finds start() has moved on to a new generation
+        std::atomic<juce::uint32> numWritten { 0 };
+        std::atomic<juce::uint32> generation { 0 };
+    };
+
+    struct ThreadRegistration;
+    static ThreadRegistration& getThreadRegistration() noexcept;
+
+    ThreadBuffer* claimReservedBuffer() noexcept;
+    ThreadBuffer* takeFreeBuffer();                     // call with bufferLock held
+    void allocateSpans (ThreadBuffer& buffer);          // call with bufferLock held
+
+    static inline std::atomic<bool> enabled { false };
+    std::atomic<juce::uint32> generation { 0 };
+
+    // Buffers are never deleted, and slots below numBuffers never change, so
+    // record() can look through them without the lock
+    juce::CriticalSection bufferLock;
+    std::array<ThreadBuffer, maxThreads> buffers;
+    std::atomic<int> numBuffers { 0 };
+
+    juce::File environmentOutputFile;
+
+    JUCE_DECLARE_NON_COPYABLE (TraceRecorder)
+};
+
+//==============================================================================
+// Records the lifetime of a block as a span named after it:
+//
+//     const TraceScope traceScope ("scanFolder");
+//==============================================================================
+class TraceScope
+{
+public:
+    explicit TraceScope (const char* spanName) noexcept
+        : name (TraceRecorder::isEnabled() ? spanName : nullptr),
+          startTicks (name != nullptr ? juce::Time::getHighResolutionTicks() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (name != nullptr)
+            TraceRecorder::getInstance().record (name, startTicks, juce::Time::getHighResolutionTicks());
+    }
+
+private:
+    const char* name;
+    juce::int64 startTicks;
+
+    JUCE_DECLARE_NON_COPYABLE (TraceScope)
+};
@@ -25,15 +25,30 @@ TransportBarComponent::TransportBarComponent (AudioPreviewEngine& eng)
     progressSlider.onValueChange = [this]
     {
         if (progressSlider.isMouseButtonDown())
-        {
-            auto& ts = engine.getTransportSource();
-            auto len = ts.getLengthInSeconds();
-            if (len > 0.0)
-                ts.setPosition (progressSlider.getValue() * len);
-        }
+            engine.setPlaybackPosition (progressSlider.getValue());
     };
     addAndMakeVisible (progressSlider);
 
+    // Loudness normalisation toggle
+    normaliseButton.setButtonText ("LUFS");
+    normaliseButton.setTooltip ("Play previews at matched loudness");
+    normaliseButton.setClickingTogglesState (true);
+    normaliseButton.setToggleState (engine.isLoudnessNormalised(), juce::dontSendNotification);
+    normaliseButton.setColour (juce::TextButton::buttonColourId, juce::Colour (SoundXplorerLookAndFeel::bgCard));
+    normaliseButton.setColour (juce::TextButton::buttonOnColourId, juce::Colour (SoundXplorerLookAndFeel::rausch));
+    normaliseButton.onClick = [this] { engine.setLoudnessNormalised (normaliseButton.getToggleState()); };
+    addAndMakeVisible (normaliseButton);
+
+    // Leading silence toggle
+    onsetButton.setButtonText ("Onset");
+    onsetButton.setTooltip ("Start previews at the first transient");
+    onsetButton.setClickingTogglesState (true);
+    onsetButton.setToggleState (engine.isSkippingLeadingSilence(), juce::dontSendNotification);
+    onsetButton.setColour (juce::TextButton::buttonColourId, juce::Colour (SoundXplorerLookAndFeel::bgCard));
+    onsetButton.setColour (juce::TextButton::buttonOnColourId, juce::Colour (SoundXplorerLookAndFeel::rausch));
+    onsetButton.onClick = [this] { engine.setSkipLeadingSilence (onsetButton.getToggleState()); };
+    addAndMakeVisible (onsetButton);
+
     // Gain label
     gainLabel.setText ("Gain", juce::dontSendNotification);
     gainLabel.setFont (SoundXplorerLookAndFeel::getBookFont (12.0f));
@@ -123,6 +138,10 @@ void TransportBarComponent::resized()
     gainValueLabel.setBounds (rightArea.removeFromRight (50));
     gainSlider.setBounds (rightArea.removeFromRight (120).reduced (0, 6));
     gainLabel.setBounds (rightArea.removeFromRight (40));
+    rightArea.removeFromRight (4);
+    normaliseButton.setBounds (rightArea.removeFromRight (44).reduced (0, 6));
+    rightArea.removeFromRight (4);
+    onsetButton.setBounds (rightArea.removeFromRight (48).reduced (0, 6));
 
     // DAW sync label
     if (dawSyncVisible)
@@ -28,6 +28,8 @@ private:
 
     juce::TextButton playButton;
     juce::TextButton stopButton;
+    juce::TextButton normaliseButton;
+    juce::TextButton onsetButton;
     juce::Slider gainSlider;
     juce::Label gainLabel;
     juce::Label gainValueLabel;